@@ -15,13 +15,37 @@
 //
 
 #include <cmath>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
 #include <iostream>
+#include <type_traits>
 
 //  Define M_PI in the case it's not defined in the math header file
 #ifndef M_PI
 #  define M_PI  3.14159265358979323846
 #endif
 
+//  Visual Studio 2013 has no snprintf(), only _snprintf(), which does not
+//  terminate a truncated string; this one does, and returns the length
+//  that the whole string would have had, as the standard one does.
+#if defined(_MSC_VER) && _MSC_VER < 1900
+inline int angel_snprintf( char* buffer, size_t size, const char* format, ... )
+{
+    va_list args;
+    va_start( args, format );
+    int length = _vscprintf( format, args );
+    va_end( args );
+    if ( size > 0 ) {
+	va_start( args, format );
+	_vsnprintf_s( buffer, size, _TRUNCATE, format, args );
+	va_end( args );
+    }
+    return length;
+}
+#  define snprintf  angel_snprintf
+#endif
+
 //----------------------------------------------------------------------------
 //
 // --- Include OpenGL header files and helpers ---
@@ -67,6 +91,7 @@ const GLfloat  DegreesToRadians = M_PI / 180.0;
 
 #include "vec.h"
 #include "mat-yjc-new.h"
+#include "quat.h"
 #include "CheckError.h"
 
 #define Print(x)  do { std::cerr << #x " = " << (x) << std::endl; } while(0)
@@ -20,11 +20,15 @@ uniform float is_floor_flag;
 uniform float texture_ground_flag;
 uniform float texture_sphere_flag;
 uniform float lattice_flag;
-uniform float fog_linear_start;
-uniform float fog_linear_end;
-uniform float fog_exponential_density;
-uniform vec4 fog_color;
-uniform float fog_flag;
+layout(std140) uniform Frame {      // the same block as in vshader42.glsl
+	vec4 point_light_position_eyeFrame;
+	vec4 spotlight_destination_position_eyeFrame;
+	vec4 fog_color;
+	float fog_linear_start;
+	float fog_linear_end;
+	float fog_exponential_density;
+	float fog_flag;
+};
 
 uniform float is_fireworks_flag;
 
@@ -42,6 +42,7 @@
 #define __ANGEL_MAT_H__
 
 #include "vec.h"
+#include "thread_pool.h"
 #include <stdio.h>
 
 // YJC: added the following for the general rotation function Rotate().
@@ -64,29 +65,30 @@ class mat2 {
     //  --- Constructors and Destructors ---
     //
 
+#if defined(ANGEL_HAS_CONSTEXPR)
+    constexpr mat2( const GLfloat d = GLfloat(1.0) ) :  // Create a diagional matrix
+	_m{ vec2( d, 0.0 ), vec2( 0.0, d ) } {}
+
+    constexpr mat2( const vec2& a, const vec2& b ) :
+	_m{ a, b } {}
+#else  // no array member initializers (Visual Studio 2013)
     mat2( const GLfloat d = GLfloat(1.0) )  // Create a diagional matrix
 	{ _m[0].x = d;  _m[1].y = d;   }
 
     mat2( const vec2& a, const vec2& b )
 	{ _m[0] = a;  _m[1] = b;  }
+#endif
 
     mat2( GLfloat m00, GLfloat m10, GLfloat m01, GLfloat m11 )   //YJC: These 4 items are given in *column order,
                                                                  //     but the matrix is stored in *row order*.
       { _m[0] = vec2( m00, m01 ); _m[1] = vec2( m10, m11 ); }    //YJC: This is in row order.
 
-    mat2( const mat2& m ) {
-	if ( *this != m ) {
-	    _m[0] = m._m[0];
-	    _m[1] = m._m[1];
-	} 
-    }
-
     //
     //  --- Indexing Operator ---
     //
 
     vec2& operator [] ( int i ) { return _m[i]; }
-    const vec2& operator [] ( int i ) const { return _m[i]; }
+    ANGEL_CONSTEXPR const vec2& operator [] ( int i ) const { return _m[i]; }
 
     //
     //  --- (non-modifying) Arithmatic Operators ---
@@ -249,11 +251,19 @@ class mat3 {
     //  --- Constructors and Destructors ---
     //
 
+#if defined(ANGEL_HAS_CONSTEXPR)
+    constexpr mat3( const GLfloat d = GLfloat(1.0) ) :  // Create a diagional matrix
+	_m{ vec3( d, 0.0, 0.0 ), vec3( 0.0, d, 0.0 ), vec3( 0.0, 0.0, d ) } {}
+
+    constexpr mat3( const vec3& a, const vec3& b, const vec3& c ) :
+	_m{ a, b, c } {}
+#else  // no array member initializers (Visual Studio 2013)
     mat3( const GLfloat d = GLfloat(1.0) )  // Create a diagional matrix
 	{ _m[0].x = d;  _m[1].y = d;  _m[2].z = d;   }
 
     mat3( const vec3& a, const vec3& b, const vec3& c )
 	{ _m[0] = a;  _m[1] = b;  _m[2] = c;  }
+#endif
 
     mat3( GLfloat m00, GLfloat m10, GLfloat m20,
 	  GLfloat m01, GLfloat m11, GLfloat m21,
@@ -265,21 +275,12 @@ class mat3 {
 	    _m[2] = vec3( m20, m21, m22 );
 	}
 
-    mat3( const mat3& m )
-	{
-	    if ( *this != m ) {
-		_m[0] = m._m[0];
-		_m[1] = m._m[1];
-		_m[2] = m._m[2];
-	    } 
-	}
-
     //
     //  --- Indexing Operator ---
     //
 
     vec3& operator [] ( int i ) { return _m[i]; }
-    const vec3& operator [] ( int i ) const { return _m[i]; }
+    ANGEL_CONSTEXPR const vec3& operator [] ( int i ) const { return _m[i]; }
 
     //
     //  --- (non-modifying) Arithmatic Operators ---
@@ -471,12 +472,122 @@ mat3 inverse( const mat3& m ) {
   return r;
 }
 
+//----------------------------------------------------------------------------
+//
+//  mat4 kernels - row-major 4x4 products on raw float arrays
+//
+//  C = A * B is computed a row at a time: row i of C is
+//      A[i][0]*B[0] + A[i][1]*B[1] + A[i][2]*B[2] + A[i][3]*B[3],
+//  i.e. four broadcast-multiply-adds of whole rows of B.  All of B is loaded
+//  before anything is stored, and row i of A is read before row i of C is
+//  written, so c may alias a or b (used by mat4::operator*=).
+//  Unaligned loads/stores are used throughout; on aligned data they cost the
+//  same as aligned ones and they keep the kernels safe on 32-bit heaps.
+//
+
+namespace detail {
+
+#if defined(ANGEL_SSE2)
+inline __m128 madd_ps( __m128 a, __m128 b, __m128 c ) {
+    return _mm_add_ps( _mm_mul_ps( a, b ), c );
+}
+#endif
+
+#if defined(ANGEL_AVX)
+
+inline __m256 mat4_madd( __m256 a, __m256 b, __m256 c ) {
+#  if defined(ANGEL_FMA)
+    return _mm256_fmadd_ps( a, b, c );
+#  else
+    return _mm256_add_ps( _mm256_mul_ps( a, b ), c );
+#  endif
+}
+
+inline void mat4_mul( const GLfloat* a, const GLfloat* b, GLfloat* c ) {
+    // Each B row duplicated into both 128-bit lanes, so one instruction
+    // serves two rows of A (low lane: row i, high lane: row i+1).
+    __m256 b0 = _mm256_broadcast_ps( (const __m128*) (b + 0) );
+    __m256 b1 = _mm256_broadcast_ps( (const __m128*) (b + 4) );
+    __m256 b2 = _mm256_broadcast_ps( (const __m128*) (b + 8) );
+    __m256 b3 = _mm256_broadcast_ps( (const __m128*) (b + 12) );
+
+    for ( int i = 0; i < 16; i += 8 ) {
+	__m256 ar = _mm256_loadu_ps( a + i );
+	__m256 r  = _mm256_mul_ps( _mm256_permute_ps( ar, 0x00 ), b0 );
+	r = mat4_madd( _mm256_permute_ps( ar, 0x55 ), b1, r );
+	r = mat4_madd( _mm256_permute_ps( ar, 0xAA ), b2, r );
+	r = mat4_madd( _mm256_permute_ps( ar, 0xFF ), b3, r );
+	_mm256_storeu_ps( c + i, r );
+    }
+}
+
+#elif defined(ANGEL_SSE2)
+
+inline void mat4_mul( const GLfloat* a, const GLfloat* b, GLfloat* c ) {
+    __m128 b0 = _mm_loadu_ps( b + 0 );
+    __m128 b1 = _mm_loadu_ps( b + 4 );
+    __m128 b2 = _mm_loadu_ps( b + 8 );
+    __m128 b3 = _mm_loadu_ps( b + 12 );
+
+    for ( int i = 0; i < 16; i += 4 ) {
+	__m128 ar = _mm_loadu_ps( a + i );
+	__m128 r  = _mm_mul_ps( _mm_shuffle_ps( ar, ar, 0x00 ), b0 );
+	r = _mm_add_ps( r, _mm_mul_ps( _mm_shuffle_ps( ar, ar, 0x55 ), b1 ) );
+	r = _mm_add_ps( r, _mm_mul_ps( _mm_shuffle_ps( ar, ar, 0xAA ), b2 ) );
+	r = _mm_add_ps( r, _mm_mul_ps( _mm_shuffle_ps( ar, ar, 0xFF ), b3 ) );
+	_mm_storeu_ps( c + i, r );
+    }
+}
+
+#else
+
+inline void mat4_mul( const GLfloat* a, const GLfloat* b, GLfloat* c ) {
+    GLfloat  t[16];
+
+    for ( int i = 0; i < 4; ++i ) {
+	for ( int j = 0; j < 4; ++j ) {
+	    t[4*i + j] = a[4*i + 0] * b[0 + j]  + a[4*i + 1] * b[4 + j] +
+			 a[4*i + 2] * b[8 + j]  + a[4*i + 3] * b[12 + j];
+	}
+    }
+
+    for ( int i = 0; i < 16; ++i ) { c[i] = t[i]; }
+}
+
+#endif
+
+//  r = M * v: four row dot products.  The SIMD version multiplies every row
+//  by v, transposes the four products and adds them, so no horizontal adds
+//  are needed.  r may alias v.
+inline void mat4_mul_vec4( const GLfloat* m, const GLfloat* v, GLfloat* r ) {
+#if defined(ANGEL_SSE2)
+    __m128 vv = _mm_loadu_ps( v );
+    __m128 p0 = _mm_mul_ps( _mm_loadu_ps( m + 0 ),  vv );
+    __m128 p1 = _mm_mul_ps( _mm_loadu_ps( m + 4 ),  vv );
+    __m128 p2 = _mm_mul_ps( _mm_loadu_ps( m + 8 ),  vv );
+    __m128 p3 = _mm_mul_ps( _mm_loadu_ps( m + 12 ), vv );
+    _MM_TRANSPOSE4_PS( p0, p1, p2, p3 );
+    _mm_storeu_ps( r, _mm_add_ps( _mm_add_ps( p0, p1 ), _mm_add_ps( p2, p3 ) ) );
+#else
+    GLfloat  t[4];
+    for ( int i = 0; i < 4; ++i ) {
+	t[i] = m[4*i + 0] * v[0] + m[4*i + 1] * v[1] +
+	       m[4*i + 2] * v[2] + m[4*i + 3] * v[3];
+    }
+    r[0] = t[0];  r[1] = t[1];  r[2] = t[2];  r[3] = t[3];
+#endif
+}
+
+}  // namespace detail
+
+template <class E> class mat4_chain;   // chain(a) * b * ... (see below)
+
 //----------------------------------------------------------------------------
 //
 //  mat4.h - 4D square matrix
 //
 
-class mat4 {
+class ANGEL_ALIGN(16) mat4 {
 
     vec4  _m[4];
 
@@ -485,11 +596,20 @@ class mat4 {
     //  --- Constructors and Destructors ---
     //
 
+#if defined(ANGEL_HAS_CONSTEXPR)
+    constexpr mat4( const GLfloat d = GLfloat(1.0) ) :  // Create a diagional matrix
+	_m{ vec4( d, 0.0, 0.0, 0.0 ), vec4( 0.0, d, 0.0, 0.0 ),
+	    vec4( 0.0, 0.0, d, 0.0 ), vec4( 0.0, 0.0, 0.0, d ) } {}
+
+    constexpr mat4( const vec4& a, const vec4& b, const vec4& c, const vec4& d ) :
+	_m{ a, b, c, d } {}
+#else  // no array member initializers (Visual Studio 2013)
     mat4( const GLfloat d = GLfloat(1.0) )  // Create a diagional matrix
 	{ _m[0].x = d;  _m[1].y = d;  _m[2].z = d;  _m[3].w = d; }
 
     mat4( const vec4& a, const vec4& b, const vec4& c, const vec4& d )
 	{ _m[0] = a;  _m[1] = b;  _m[2] = c;  _m[3] = d; }
+#endif
             //
            // YJC: a becomes the first row, b the 2nd row,
            //      c the 3rd row, d the 4th row.
@@ -509,22 +629,23 @@ class mat4 {
 	    _m[3] = vec4( m30, m31, m32, m33 );
 	}
 
-    mat4( const mat4& m )
-	{
-	    if ( *this != m ) {
-		_m[0] = m._m[0];
-		_m[1] = m._m[1];
-		_m[2] = m._m[2];
-		_m[3] = m._m[3];
-	    } 
-	}
+    // Evaluates chain(a) * b * ... directly into the new matrix.
+    template <class E>
+    mat4( const mat4_chain<E>& e );
+
+    //
+    //  --- Assignment ---
+    //
+
+    template <class E>
+    mat4& operator = ( const mat4_chain<E>& e );  // evaluated in place
 
     //
     //  --- Indexing Operator ---
     //
 
     vec4& operator [] ( int i ) { return _m[i]; }
-    const vec4& operator [] ( int i ) const { return _m[i]; }
+    ANGEL_CONSTEXPR const vec4& operator [] ( int i ) const { return _m[i]; }
 
     //
     //  --- (non-modifying) Arithematic Operators ---
@@ -557,15 +678,7 @@ class mat4 {
 	
     mat4 operator * ( const mat4& m ) const {
 	mat4  a( 0.0 );
-
-	for ( int i = 0; i < 4; ++i ) {
-	    for ( int j = 0; j < 4; ++j ) {
-		for ( int k = 0; k < 4; ++k ) {
-		    a[i][j] += _m[i][k] * m[k][j];
-		}
-	    }
-	}
-
+	detail::mat4_mul( *this, m, a );
 	return a;
     }
 
@@ -589,17 +702,8 @@ class mat4 {
     }
 
     mat4& operator *= ( const mat4& m ) {
-	mat4  a( 0.0 );
-
-	for ( int i = 0; i < 4; ++i ) {
-	    for ( int j = 0; j < 4; ++j ) {
-		for ( int k = 0; k < 4; ++k ) {
-		    a[i][j] += _m[i][k] * m[k][j];
-		}
-	    }
-	}
-
-	return *this = a;
+	detail::mat4_mul( *this, m, *this );
+	return *this;
     }
 
     mat4& operator /= ( const GLfloat s ) {
@@ -620,11 +724,9 @@ class mat4 {
     //
 
     vec4 operator * ( const vec4& v ) const {  // m * v
-	return vec4( _m[0][0]*v.x + _m[0][1]*v.y + _m[0][2]*v.z + _m[0][3]*v.w,
-		     _m[1][0]*v.x + _m[1][1]*v.y + _m[1][2]*v.z + _m[1][3]*v.w,
-		     _m[2][0]*v.x + _m[2][1]*v.y + _m[2][2]*v.z + _m[2][3]*v.w,
-		     _m[3][0]*v.x + _m[3][1]*v.y + _m[3][2]*v.z + _m[3][3]*v.w
-	    );
+	vec4  r;
+	detail::mat4_mul_vec4( *this, v, r );
+	return r;
     }
 	
     //
@@ -689,6 +791,200 @@ mat4 transpose1( const mat4& A ) {
                                                        //     so in this way we get the transpose.
 }
 
+//----------------------------------------------------------------------------
+//
+//  Batch transforms - apply one matrix to a whole array
+//
+//    TransformPoints(m, in, out, n):     out[i] = m * in[i] for n point4's (AoS)
+//    TransformNormals(nm, in, out, n):   out[i] = nm * in[i] for n vec3's (AoS),
+//                                        nm e.g. from NormalMatrix()
+//    TransformPointsSoA(m, x, y, z, ox, oy, oz, ow, n):
+//                                        the same for points given as separate
+//                                        x/y/z float streams with w == 1;
+//                                        ow may be NULL if not wanted.
+//
+//  in and out may be the same array.  If a ThreadPool is given, arrays
+//  larger than BatchTransformGrain are split across its threads.
+//
+
+const int BatchTransformGrain = 16384;
+
+namespace detail {
+
+inline void transform_points( const mat4& m, const vec4* in, vec4* out,
+			      int begin, int end ) {
+#if defined(ANGEL_AVX)
+    // out = x*col0 + y*col1 + z*col2 + w*col3, two points per register.
+    mat4 t = transpose1( m );
+    const GLfloat* c = t;
+    __m256 c0 = _mm256_broadcast_ps( (const __m128*) (c + 0) );
+    __m256 c1 = _mm256_broadcast_ps( (const __m128*) (c + 4) );
+    __m256 c2 = _mm256_broadcast_ps( (const __m128*) (c + 8) );
+    __m256 c3 = _mm256_broadcast_ps( (const __m128*) (c + 12) );
+
+    int i = begin;
+    for ( ; i + 2 <= end; i += 2 ) {
+	__m256 p = _mm256_loadu_ps( &in[i].x );
+	__m256 r = _mm256_mul_ps( _mm256_permute_ps( p, 0x00 ), c0 );
+	r = mat4_madd( _mm256_permute_ps( p, 0x55 ), c1, r );
+	r = mat4_madd( _mm256_permute_ps( p, 0xAA ), c2, r );
+	r = mat4_madd( _mm256_permute_ps( p, 0xFF ), c3, r );
+	_mm256_storeu_ps( &out[i].x, r );
+    }
+    for ( ; i < end; ++i ) { mat4_mul_vec4( m, in[i], out[i] ); }
+#elif defined(ANGEL_SSE2)
+    mat4 t = transpose1( m );
+    const GLfloat* c = t;
+    __m128 c0 = _mm_loadu_ps( c + 0 );
+    __m128 c1 = _mm_loadu_ps( c + 4 );
+    __m128 c2 = _mm_loadu_ps( c + 8 );
+    __m128 c3 = _mm_loadu_ps( c + 12 );
+
+    for ( int i = begin; i < end; ++i ) {
+	__m128 p = _mm_loadu_ps( &in[i].x );
+	__m128 r = _mm_mul_ps( _mm_shuffle_ps( p, p, 0x00 ), c0 );
+	r = madd_ps( _mm_shuffle_ps( p, p, 0x55 ), c1, r );
+	r = madd_ps( _mm_shuffle_ps( p, p, 0xAA ), c2, r );
+	r = madd_ps( _mm_shuffle_ps( p, p, 0xFF ), c3, r );
+	_mm_storeu_ps( &out[i].x, r );
+    }
+#else
+    for ( int i = begin; i < end; ++i ) { mat4_mul_vec4( m, in[i], out[i] ); }
+#endif
+}
+
+// SoA kernel: (px, py, pz, w) transformed by m, four points per register.
+inline void transform_soa( const mat4& m, GLfloat w,
+			   const GLfloat* x, const GLfloat* y, const GLfloat* z,
+			   GLfloat* ox, GLfloat* oy, GLfloat* oz, GLfloat* ow,
+			   int begin, int end ) {
+    int i = begin;
+#if defined(ANGEL_SSE2)
+    __m128 m00 = _mm_set1_ps( m[0][0] ), m01 = _mm_set1_ps( m[0][1] ),
+	   m02 = _mm_set1_ps( m[0][2] ), m03 = _mm_set1_ps( m[0][3] * w );
+    __m128 m10 = _mm_set1_ps( m[1][0] ), m11 = _mm_set1_ps( m[1][1] ),
+	   m12 = _mm_set1_ps( m[1][2] ), m13 = _mm_set1_ps( m[1][3] * w );
+    __m128 m20 = _mm_set1_ps( m[2][0] ), m21 = _mm_set1_ps( m[2][1] ),
+	   m22 = _mm_set1_ps( m[2][2] ), m23 = _mm_set1_ps( m[2][3] * w );
+    __m128 m30 = _mm_set1_ps( m[3][0] ), m31 = _mm_set1_ps( m[3][1] ),
+	   m32 = _mm_set1_ps( m[3][2] ), m33 = _mm_set1_ps( m[3][3] * w );
+
+    for ( ; i + 4 <= end; i += 4 ) {
+	__m128 px = _mm_loadu_ps( x + i );
+	__m128 py = _mm_loadu_ps( y + i );
+	__m128 pz = _mm_loadu_ps( z + i );
+	__m128 rx = madd_ps( m02, pz, madd_ps( m01, py, madd_ps( m00, px, m03 ) ) );
+	__m128 ry = madd_ps( m12, pz, madd_ps( m11, py, madd_ps( m10, px, m13 ) ) );
+	__m128 rz = madd_ps( m22, pz, madd_ps( m21, py, madd_ps( m20, px, m23 ) ) );
+	if ( ow ) {
+	    __m128 rw = madd_ps( m32, pz, madd_ps( m31, py, madd_ps( m30, px, m33 ) ) );
+	    _mm_storeu_ps( ow + i, rw );
+	}
+	_mm_storeu_ps( ox + i, rx );
+	_mm_storeu_ps( oy + i, ry );
+	_mm_storeu_ps( oz + i, rz );
+    }
+#endif
+    for ( ; i < end; ++i ) {
+	GLfloat px = x[i], py = y[i], pz = z[i];
+	ox[i] = m[0][0]*px + m[0][1]*py + m[0][2]*pz + m[0][3]*w;
+	oy[i] = m[1][0]*px + m[1][1]*py + m[1][2]*pz + m[1][3]*w;
+	oz[i] = m[2][0]*px + m[2][1]*py + m[2][2]*pz + m[2][3]*w;
+	if ( ow ) { ow[i] = m[3][0]*px + m[3][1]*py + m[3][2]*pz + m[3][3]*w; }
+    }
+}
+
+inline void transform_normals( const mat3& nm, const vec3* in, vec3* out,
+			       int begin, int end ) {
+    int i = begin;
+#if defined(ANGEL_SSE2)
+    // Four vec3's are exactly three registers; shuffle them to x/y/z lanes,
+    // transform as SoA and shuffle back.
+    __m128 m00 = _mm_set1_ps( nm[0][0] ), m01 = _mm_set1_ps( nm[0][1] ), m02 = _mm_set1_ps( nm[0][2] );
+    __m128 m10 = _mm_set1_ps( nm[1][0] ), m11 = _mm_set1_ps( nm[1][1] ), m12 = _mm_set1_ps( nm[1][2] );
+    __m128 m20 = _mm_set1_ps( nm[2][0] ), m21 = _mm_set1_ps( nm[2][1] ), m22 = _mm_set1_ps( nm[2][2] );
+
+    for ( ; i + 4 <= end; i += 4 ) {
+	const GLfloat* p = &in[i].x;
+	__m128 a = _mm_loadu_ps( p + 0 );   // x0 y0 z0 x1
+	__m128 b = _mm_loadu_ps( p + 4 );   // y1 z1 x2 y2
+	__m128 c = _mm_loadu_ps( p + 8 );   // z2 x3 y3 z3
+
+	__m128 t0 = _mm_shuffle_ps( b, c, _MM_SHUFFLE( 1, 1, 2, 2 ) );  // x2 x2 x3 x3
+	__m128 t1 = _mm_shuffle_ps( a, b, _MM_SHUFFLE( 0, 0, 1, 1 ) );  // y0 y0 y1 y1
+	__m128 t2 = _mm_shuffle_ps( b, c, _MM_SHUFFLE( 2, 2, 3, 3 ) );  // y2 y2 y3 y3
+	__m128 t3 = _mm_shuffle_ps( a, b, _MM_SHUFFLE( 1, 1, 2, 2 ) );  // z0 z0 z1 z1
+	__m128 t4 = _mm_shuffle_ps( c, c, _MM_SHUFFLE( 3, 3, 0, 0 ) );  // z2 z2 z3 z3
+	__m128 vx = _mm_shuffle_ps( a,  t0, _MM_SHUFFLE( 2, 0, 3, 0 ) );
+	__m128 vy = _mm_shuffle_ps( t1, t2, _MM_SHUFFLE( 2, 0, 2, 0 ) );
+	__m128 vz = _mm_shuffle_ps( t3, t4, _MM_SHUFFLE( 2, 0, 2, 0 ) );
+
+	__m128 rx = madd_ps( m02, vz, madd_ps( m01, vy, _mm_mul_ps( m00, vx ) ) );
+	__m128 ry = madd_ps( m12, vz, madd_ps( m11, vy, _mm_mul_ps( m10, vx ) ) );
+	__m128 rz = madd_ps( m22, vz, madd_ps( m21, vy, _mm_mul_ps( m20, vx ) ) );
+
+	// back to x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+	GLfloat* q = &out[i].x;
+	_mm_storeu_ps( q + 0, _mm_shuffle_ps( _mm_shuffle_ps( rx, ry, _MM_SHUFFLE( 0, 0, 1, 0 ) ),
+					      _mm_shuffle_ps( rz, rx, _MM_SHUFFLE( 1, 1, 0, 0 ) ),
+					      _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+	_mm_storeu_ps( q + 4, _mm_shuffle_ps( _mm_shuffle_ps( ry, rz, _MM_SHUFFLE( 1, 1, 1, 1 ) ),
+					      _mm_shuffle_ps( rx, ry, _MM_SHUFFLE( 2, 2, 2, 2 ) ),
+					      _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+	_mm_storeu_ps( q + 8, _mm_shuffle_ps( _mm_shuffle_ps( rz, rx, _MM_SHUFFLE( 3, 3, 2, 2 ) ),
+					      _mm_shuffle_ps( ry, rz, _MM_SHUFFLE( 3, 3, 3, 3 ) ),
+					      _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+    }
+#endif
+    for ( ; i < end; ++i ) { out[i] = nm * in[i]; }
+}
+
+}  // namespace detail
+
+inline
+void TransformPoints( const mat4& m, const vec4* in, vec4* out, int n,
+		      ThreadPool* pool = NULL )
+{
+    if ( pool && n > BatchTransformGrain ) {
+	pool->parallel_for( 0, n, BatchTransformGrain, [&]( int b, int e ) {
+	    detail::transform_points( m, in, out, b, e );
+	} );
+    }
+    else {
+	detail::transform_points( m, in, out, 0, n );
+    }
+}
+
+inline
+void TransformNormals( const mat3& nm, const vec3* in, vec3* out, int n,
+		       ThreadPool* pool = NULL )
+{
+    if ( pool && n > BatchTransformGrain ) {
+	pool->parallel_for( 0, n, BatchTransformGrain, [&]( int b, int e ) {
+	    detail::transform_normals( nm, in, out, b, e );
+	} );
+    }
+    else {
+	detail::transform_normals( nm, in, out, 0, n );
+    }
+}
+
+inline
+void TransformPointsSoA( const mat4& m,
+			 const GLfloat* x, const GLfloat* y, const GLfloat* z,
+			 GLfloat* ox, GLfloat* oy, GLfloat* oz, GLfloat* ow,
+			 int n, ThreadPool* pool = NULL )
+{
+    if ( pool && n > BatchTransformGrain ) {
+	pool->parallel_for( 0, n, BatchTransformGrain, [&]( int b, int e ) {
+	    detail::transform_soa( m, 1.0, x, y, z, ox, oy, oz, ow, b, e );
+	} );
+    }
+    else {
+	detail::transform_soa( m, 1.0, x, y, z, ox, oy, oz, ow, 0, n );
+    }
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 //  Helpful Matrix Methods
@@ -801,23 +1097,22 @@ mat4 Rotate(const GLfloat angle, const GLfloat x, const GLfloat y, const GLfloat
 //  Translation matrix generators
 //
 
-inline
+inline ANGEL_CONSTEXPR
 mat4 Translate( const GLfloat x, const GLfloat y, const GLfloat z )
 {
-    mat4 c;
-    c[0][3] = x;
-    c[1][3] = y;
-    c[2][3] = z;
-    return c;
+    return mat4( vec4( 1.0, 0.0, 0.0, x ),
+		 vec4( 0.0, 1.0, 0.0, y ),
+		 vec4( 0.0, 0.0, 1.0, z ),
+		 vec4( 0.0, 0.0, 0.0, 1.0 ) );
 }
 
-inline
+inline ANGEL_CONSTEXPR
 mat4 Translate( const vec3& v )
 {
     return Translate( v.x, v.y, v.z );
 }
 
-inline
+inline ANGEL_CONSTEXPR
 mat4 Translate( const vec4& v )
 {
     return Translate( v.x, v.y, v.z );
@@ -828,17 +1123,16 @@ mat4 Translate( const vec4& v )
 //  Scale matrix generators
 //
 
-inline
+inline ANGEL_CONSTEXPR
 mat4 Scale( const GLfloat x, const GLfloat y, const GLfloat z )
 {
-    mat4 c;
-    c[0][0] = x;
-    c[1][1] = y;
-    c[2][2] = z;
-    return c;
+    return mat4( vec4( x,   0.0, 0.0, 0.0 ),
+		 vec4( 0.0, y,   0.0, 0.0 ),
+		 vec4( 0.0, 0.0, z,   0.0 ),
+		 vec4( 0.0, 0.0, 0.0, 1.0 ) );
 }
 
-inline
+inline ANGEL_CONSTEXPR
 mat4 Scale( const vec3& v )
 {
     return Scale( v.x, v.y, v.z );
@@ -974,6 +1268,426 @@ mat4 mat4WithUpperLeftMat3( const mat3& m){
                vec4(    0.0,     0.0,     0.0, 1.0) );
 }
 
+//----------------------------------------------------------------------------
+//
+//  affine3x4 - affine transformation (a mat4 whose 4th row is (0, 0, 0, 1))
+//
+//  Only the top three rows are stored, in *row order* like mat4:
+//      row i = ( m[i][0], m[i][1], m[i][2], t[i] )
+//  Composing two affine3x4's takes 36 multiply-adds instead of 64, the
+//  inverse of a rigid transform is a transpose, and the normal matrix of a
+//  rotation + translation is just the upper-left 3x3 (no inverse needed).
+//
+//  An affine3x4 converts implicitly to mat4, so it can be mixed with mat4's
+//  (e.g. with Perspective() or a shadow projection) and uploaded as
+//      glUniformMatrix4fv(loc, 1, GL_TRUE, mat4(a));
+//  The affine builders are AffineTranslate(), AffineScale(), AffineRotate()
+//  and AffineLookAt(); they take the same arguments as the mat4 versions.
+//
+
+class ANGEL_ALIGN(16) affine3x4 {
+
+    vec4  _m[3];
+
+   public:
+    //
+    //  --- Constructors and Destructors ---
+    //
+
+#if defined(ANGEL_HAS_CONSTEXPR)
+    constexpr affine3x4( const GLfloat d = GLfloat(1.0) ) :  // d * identity (t = 0)
+	_m{ vec4( d, 0.0, 0.0, 0.0 ), vec4( 0.0, d, 0.0, 0.0 ), vec4( 0.0, 0.0, d, 0.0 ) } {}
+
+    constexpr affine3x4( const vec4& a, const vec4& b, const vec4& c ) :  // the 3 rows
+	_m{ a, b, c } {}
+#else  // no array member initializers (Visual Studio 2013)
+    affine3x4( const GLfloat d = GLfloat(1.0) )  // d * identity (t = 0)
+	{ _m[0].x = d;  _m[1].y = d;  _m[2].z = d; }
+
+    affine3x4( const vec4& a, const vec4& b, const vec4& c )  // the 3 rows
+	{ _m[0] = a;  _m[1] = b;  _m[2] = c; }
+#endif
+
+    // Drops the 4th row, which must be (0, 0, 0, 1) for the result to be exact.
+    explicit affine3x4( const mat4& m )
+	{ _m[0] = m[0];  _m[1] = m[1];  _m[2] = m[2]; }
+
+    //
+    //  --- Indexing Operator ---
+    //
+
+    vec4& operator [] ( int i ) { return _m[i]; }
+    ANGEL_CONSTEXPR const vec4& operator [] ( int i ) const { return _m[i]; }
+
+    //
+    //  --- Composition ---
+    //
+
+    // row i of (A * B) = A[i][0]*B[0] + A[i][1]*B[1] + A[i][2]*B[2] + (0,0,0,A[i][3])
+    affine3x4 operator * ( const affine3x4& b ) const {
+	affine3x4  c;
+#if defined(ANGEL_SSE2)
+	const __m128 wmask = _mm_castsi128_ps( _mm_set_epi32( -1, 0, 0, 0 ) );
+	__m128 b0 = _mm_loadu_ps( b[0] );
+	__m128 b1 = _mm_loadu_ps( b[1] );
+	__m128 b2 = _mm_loadu_ps( b[2] );
+	for ( int i = 0; i < 3; ++i ) {
+	    __m128 ar = _mm_loadu_ps( _m[i] );
+	    __m128 r  = _mm_and_ps( ar, wmask );
+	    r = _mm_add_ps( r, _mm_mul_ps( _mm_shuffle_ps( ar, ar, 0x00 ), b0 ) );
+	    r = _mm_add_ps( r, _mm_mul_ps( _mm_shuffle_ps( ar, ar, 0x55 ), b1 ) );
+	    r = _mm_add_ps( r, _mm_mul_ps( _mm_shuffle_ps( ar, ar, 0xAA ), b2 ) );
+	    _mm_storeu_ps( c[i], r );
+	}
+#else
+	// Without SIMD the 36-term product measures slower than the 64-term
+	// mat4 kernel (which compilers vectorize well), so use that one.
+	c = affine3x4( mat4( *this ) * mat4( b ) );
+#endif
+	return c;
+    }
+
+    affine3x4& operator *= ( const affine3x4& b )
+	{ return *this = *this * b; }
+
+    // Mixing with a general (e.g. projective) matrix gives a general matrix.
+    mat4 operator * ( const mat4& b ) const
+	{ return mat4( *this ) * b; }
+
+    //
+    //  --- Matrix / Vector operators ---
+    //
+
+    vec4 operator * ( const vec4& v ) const {  // a * v, v.w is passed through
+	return vec4( _m[0].x*v.x + _m[0].y*v.y + _m[0].z*v.z + _m[0].w*v.w,
+		     _m[1].x*v.x + _m[1].y*v.y + _m[1].z*v.z + _m[1].w*v.w,
+		     _m[2].x*v.x + _m[2].y*v.y + _m[2].z*v.z + _m[2].w*v.w,
+		     v.w );
+    }
+
+    //
+    //  --- Insertion Operator ---
+    //
+
+    friend std::ostream& operator << ( std::ostream& os, const affine3x4& a ) {
+	return os << std::endl
+		  << a[0] << std::endl
+		  << a[1] << std::endl
+		  << a[2] << std::endl;
+    }
+
+    //
+    //  --- Conversion Operators ---
+    //
+
+    operator mat4 () const
+	{ return mat4( _m[0], _m[1], _m[2], vec4( 0.0, 0.0, 0.0, 1.0 ) ); }
+};
+
+//
+//  --- Non-class affine3x4 Methods ---
+//
+
+// The upper-left 3x3 (rotation/scale) part
+inline
+mat3 upperLeftMat3( const affine3x4& a ) {
+    return mat3( vec3( a[0].x, a[0].y, a[0].z ),
+		 vec3( a[1].x, a[1].y, a[1].z ),
+		 vec3( a[2].x, a[2].y, a[2].z ) );
+}
+
+// Inverse of a *rigid* transform (rotation + translation only):
+//   [R | t]^-1 = [R^T | -R^T t]
+inline
+affine3x4 inverseRigid( const affine3x4& a ) {
+    vec3 t( a[0].w, a[1].w, a[2].w );
+    vec3 c0( a[0].x, a[1].x, a[2].x );   // columns of R = rows of R^T
+    vec3 c1( a[0].y, a[1].y, a[2].y );
+    vec3 c2( a[0].z, a[1].z, a[2].z );
+    return affine3x4( vec4( c0, -dot( c0, t ) ),
+		      vec4( c1, -dot( c1, t ) ),
+		      vec4( c2, -dot( c2, t ) ) );
+}
+
+// Inverse of a general affine transform: [M | t]^-1 = [M^-1 | -M^-1 t]
+inline
+affine3x4 inverse( const affine3x4& a ) {
+    mat3 mi = inverse( upperLeftMat3( a ) );
+    vec3 t  = mi * vec3( a[0].w, a[1].w, a[2].w );
+    return affine3x4( vec4( mi[0], -t.x ),
+		      vec4( mi[1], -t.y ),
+		      vec4( mi[2], -t.z ) );
+}
+
+// Same meaning as NormalMatrix(mv, non_uniform_scale_flag) for a mat4.
+inline
+mat3 NormalMatrix( const affine3x4& mv, int non_uniform_scale_flag ) {
+    if ( non_uniform_scale_flag == 0 )
+	return upperLeftMat3( mv );
+    else
+	return transpose1( inverse( upperLeftMat3( mv ) ) );
+}
+
+inline ANGEL_CONSTEXPR
+affine3x4 AffineTranslate( const GLfloat x, const GLfloat y, const GLfloat z )
+{
+    return affine3x4( vec4( 1.0, 0.0, 0.0, x ),
+		      vec4( 0.0, 1.0, 0.0, y ),
+		      vec4( 0.0, 0.0, 1.0, z ) );
+}
+
+inline ANGEL_CONSTEXPR
+affine3x4 AffineTranslate( const vec3& v )
+{
+    return AffineTranslate( v.x, v.y, v.z );
+}
+
+inline ANGEL_CONSTEXPR
+affine3x4 AffineTranslate( const vec4& v )
+{
+    return AffineTranslate( v.x, v.y, v.z );
+}
+
+inline ANGEL_CONSTEXPR
+affine3x4 AffineScale( const GLfloat x, const GLfloat y, const GLfloat z )
+{
+    return affine3x4( vec4( x,   0.0, 0.0, 0.0 ),
+		      vec4( 0.0, y,   0.0, 0.0 ),
+		      vec4( 0.0, 0.0, z,   0.0 ) );
+}
+
+inline ANGEL_CONSTEXPR
+affine3x4 AffineScale( const vec3& v )
+{
+    return AffineScale( v.x, v.y, v.z );
+}
+
+// Same as Rotate(angle, x, y, z), built directly in row order.
+inline
+affine3x4 AffineRotate( const GLfloat angle, const GLfloat x, const GLfloat y, const GLfloat z )
+{
+    float len = sqrt(x * x + y * y + z * z);
+    if (len < 0.00001)
+      { printf("Error! Rotation axis vector is too close to (0,0,0)\n");
+	exit(-1);
+      }
+    const float x1 = x / len, y1 = y / len, z1 = z / len;
+
+    float rads = float(angle) * 0.0174532925f;
+    const float c = cosf(rads);
+    const float s = sinf(rads);
+    const float omc = 1.0f - c;
+
+    return affine3x4( vec4( x1 * x1 * omc + c,      x1 * y1 * omc - z1 * s, x1 * z1 * omc + y1 * s, 0.0 ),
+		      vec4( y1 * x1 * omc + z1 * s, y1 * y1 * omc + c,      y1 * z1 * omc - x1 * s, 0.0 ),
+		      vec4( x1 * z1 * omc - y1 * s, y1 * z1 * omc + x1 * s, z1 * z1 * omc + c,      0.0 ) );
+}
+
+// Same as LookAt(eye, at, up), without the matrix product:
+// mat4(u, v, n, (0,0,0,1)) * Translate(-eye) has rows (r.xyz, r.w - r.xyz . eye).
+// (As in LookAt(), u and v are converted from vec3's and so carry w = 1.)
+inline
+affine3x4 AffineLookAt( const vec4& eye, const vec4& at, const vec4& up )
+{
+    vec4 n = normalize(eye - at);
+    vec4 u = normalize(cross(up,n));
+    vec4 v = normalize(cross(n,u));
+    return affine3x4( vec4( u.x, u.y, u.z, u.w - (u.x*eye.x + u.y*eye.y + u.z*eye.z) ),
+		      vec4( v.x, v.y, v.z, v.w - (v.x*eye.x + v.y*eye.y + v.z*eye.z) ),
+		      vec4( n.x, n.y, n.z, n.w - (n.x*eye.x + n.y*eye.y + n.z*eye.z) ) );
+}
+
+//----------------------------------------------------------------------------
+//
+//  Fused matrix chains
+//
+//  Every "*" in  a * b * c * d  builds (and zero-fills) a new mat4.
+//  Starting the product with chain() instead,
+//
+//      mv = chain(view) * Translate(t) * shadow * Translate(-t) * model;
+//
+//  only records the operands and evaluates the whole product in one pass
+//  when it is assigned to a mat4: each row of the first matrix is carried
+//  through all of the other matrices in registers, and the 4 result rows
+//  are stored straight into the target.  The operands can be mat4's or
+//  affine3x4's (an affine3x4 costs 3/4 of a mat4), and the target may be
+//  one of the operands.
+//
+//      chain(a) * b * c * v    applies the chain to a vec4, right to left,
+//                              without forming the product at all.
+//
+//  The expression keeps references to its operands, so use it within the
+//  statement that builds it (don't store it in an "auto" variable).
+//
+
+namespace detail {
+
+// The 4 rows of a partial product, multiplied on the right by each matrix
+// of a chain in turn:  row i <- row i * M.
+struct chain_rows {
+#if defined(ANGEL_SSE2)
+    __m128  r[4];
+
+    void load( const mat4& m ) {
+	r[0] = _mm_loadu_ps( m[0] );  r[1] = _mm_loadu_ps( m[1] );
+	r[2] = _mm_loadu_ps( m[2] );  r[3] = _mm_loadu_ps( m[3] );
+    }
+
+    void load( const affine3x4& a ) {
+	r[0] = _mm_loadu_ps( a[0] );  r[1] = _mm_loadu_ps( a[1] );
+	r[2] = _mm_loadu_ps( a[2] );  r[3] = _mm_set_ps( 1.0f, 0.0f, 0.0f, 0.0f );
+    }
+
+    void mul( const mat4& m ) {
+	__m128 m0 = _mm_loadu_ps( m[0] );
+	__m128 m1 = _mm_loadu_ps( m[1] );
+	__m128 m2 = _mm_loadu_ps( m[2] );
+	__m128 m3 = _mm_loadu_ps( m[3] );
+	for ( int i = 0; i < 4; ++i ) {
+	    __m128 x = r[i];
+	    __m128 t = _mm_mul_ps( _mm_shuffle_ps( x, x, 0x00 ), m0 );
+	    t = madd_ps( _mm_shuffle_ps( x, x, 0x55 ), m1, t );
+	    t = madd_ps( _mm_shuffle_ps( x, x, 0xAA ), m2, t );
+	    r[i] = madd_ps( _mm_shuffle_ps( x, x, 0xFF ), m3, t );
+	}
+    }
+
+    // The 4th row of an affine3x4 is (0, 0, 0, 1): w is just passed on.
+    void mul( const affine3x4& a ) {
+	const __m128 wmask = _mm_castsi128_ps( _mm_set_epi32( -1, 0, 0, 0 ) );
+	__m128 a0 = _mm_loadu_ps( a[0] );
+	__m128 a1 = _mm_loadu_ps( a[1] );
+	__m128 a2 = _mm_loadu_ps( a[2] );
+	for ( int i = 0; i < 4; ++i ) {
+	    __m128 x = r[i];
+	    __m128 t = madd_ps( _mm_shuffle_ps( x, x, 0x00 ), a0, _mm_and_ps( x, wmask ) );
+	    t = madd_ps( _mm_shuffle_ps( x, x, 0x55 ), a1, t );
+	    r[i] = madd_ps( _mm_shuffle_ps( x, x, 0xAA ), a2, t );
+	}
+    }
+
+    void store( mat4& m ) const {
+	_mm_storeu_ps( m[0], r[0] );  _mm_storeu_ps( m[1], r[1] );
+	_mm_storeu_ps( m[2], r[2] );  _mm_storeu_ps( m[3], r[3] );
+    }
+#else
+    GLfloat  r[4][4];
+
+    void load( const mat4& m ) {
+	for ( int i = 0; i < 4; ++i )
+	    for ( int j = 0; j < 4; ++j ) { r[i][j] = m[i][j]; }
+    }
+
+    void load( const affine3x4& a ) {
+	for ( int i = 0; i < 3; ++i )
+	    for ( int j = 0; j < 4; ++j ) { r[i][j] = a[i][j]; }
+	r[3][0] = r[3][1] = r[3][2] = 0.0;  r[3][3] = 1.0;
+    }
+
+    void mul( const mat4& m ) {
+	for ( int i = 0; i < 4; ++i ) {
+	    GLfloat x = r[i][0], y = r[i][1], z = r[i][2], w = r[i][3];
+	    for ( int j = 0; j < 4; ++j )
+		r[i][j] = x * m[0][j] + y * m[1][j] + z * m[2][j] + w * m[3][j];
+	}
+    }
+
+    void mul( const affine3x4& a ) {
+	for ( int i = 0; i < 4; ++i ) {
+	    GLfloat x = r[i][0], y = r[i][1], z = r[i][2], w = r[i][3];
+	    for ( int j = 0; j < 4; ++j )
+		r[i][j] = x * a[0][j] + y * a[1][j] + z * a[2][j];
+	    r[i][3] += w;
+	}
+    }
+
+    void store( mat4& m ) const {
+	for ( int i = 0; i < 4; ++i )
+	    m[i] = vec4( r[i][0], r[i][1], r[i][2], r[i][3] );
+    }
+#endif
+};
+
+}  // namespace detail
+
+// Common part of the chain expressions; E is the actual expression type.
+template <class E>
+class mat4_chain {
+   public:
+    const E& self() const { return static_cast<const E&>( *this ); }
+
+    void eval( mat4& m ) const {
+	detail::chain_rows  t;
+	self().rows( t );
+	t.store( m );
+    }
+
+    vec4 operator * ( const vec4& v ) const
+	{ return self().apply( v ); }
+};
+
+// chain(m): the first matrix of a chain
+template <class M>
+class mat4_chain_head : public mat4_chain< mat4_chain_head<M> > {
+    const M&  _m;
+
+   public:
+    explicit mat4_chain_head( const M& m ) : _m(m) {}
+
+    void rows( detail::chain_rows& t ) const { t.load( _m ); }
+    vec4 apply( const vec4& v ) const { return _m * v; }
+};
+
+// e * m
+template <class E, class M>
+class mat4_chain_link : public mat4_chain< mat4_chain_link<E, M> > {
+    E         _e;
+    const M&  _m;
+
+   public:
+    mat4_chain_link( const E& e, const M& m ) : _e(e), _m(m) {}
+
+    void rows( detail::chain_rows& t ) const { _e.rows( t );  t.mul( _m ); }
+    vec4 apply( const vec4& v ) const { return _e.apply( _m * v ); }
+};
+
+inline
+mat4_chain_head<mat4> chain( const mat4& m ) {
+    return mat4_chain_head<mat4>( m );
+}
+
+inline
+mat4_chain_head<affine3x4> chain( const affine3x4& a ) {
+    return mat4_chain_head<affine3x4>( a );
+}
+
+template <class E>
+inline
+mat4_chain_link<E, mat4> operator * ( const mat4_chain<E>& e, const mat4& m ) {
+    return mat4_chain_link<E, mat4>( e.self(), m );
+}
+
+template <class E>
+inline
+mat4_chain_link<E, affine3x4> operator * ( const mat4_chain<E>& e, const affine3x4& a ) {
+    return mat4_chain_link<E, affine3x4>( e.self(), a );
+}
+
+template <class E>
+inline
+mat4::mat4( const mat4_chain<E>& e )
+{
+    e.eval( *this );
+}
+
+template <class E>
+inline
+mat4& mat4::operator = ( const mat4_chain<E>& e )
+{
+    e.eval( *this );
+    return *this;
+}
+
 //----------------------------------------------------------------------------
 
 inline
@@ -991,7 +1705,7 @@ void printv(const vec4& a )
 }
 
 inline
-void printm(const mat4 a)
+void printm(const mat4& a)
 {
     Error( "replace with matrix insertion operator" );
     for(int i=0; i<4; i++) printf("%f %f %f %f \n", a[i][0], a[i][1], a[i][2], a[i][3]);
@@ -1008,6 +1722,28 @@ mat4 identity()
     return c;
 }
 
+//----------------------------------------------------------------------------
+//
+//  Layout guarantees: matrices are uploaded with glUniformMatrix*fv() as
+//  tightly packed rows, and copied with memcpy().
+//
+
+static_assert( sizeof(mat2) == 4 * sizeof(GLfloat) &&
+	       sizeof(mat3) == 9 * sizeof(GLfloat) &&
+	       sizeof(mat4) == 16 * sizeof(GLfloat) &&
+	       sizeof(affine3x4) == 12 * sizeof(GLfloat), "matrices must be packed rows" );
+static_assert( std::alignment_of<mat4>::value == 16 &&
+	       std::alignment_of<affine3x4>::value == 16, "mat4 and affine3x4 must be 16-byte aligned" );
+static_assert( std::is_trivially_copyable<mat2>::value &&
+	       std::is_trivially_copyable<mat3>::value &&
+	       std::is_trivially_copyable<mat4>::value &&
+	       std::is_trivially_copyable<affine3x4>::value, "matrices must be trivially copyable" );
+
+#if defined(ANGEL_HAS_CONSTEXPR)
+static_assert( static_cast<const mat4&>( Translate( 1.0, 2.0, 3.0 ) )[1].w == 2.0 &&
+	       static_cast<const mat4&>( Scale( 4.0, 5.0, 6.0 ) )[2].z == 6.0,
+	       "Translate() and Scale() must be usable at compile time" );
+#endif
 
 }  // namespace Angel
 
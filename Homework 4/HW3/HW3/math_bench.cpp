@@ -0,0 +1,839 @@
+/************************************************************
+ * math_bench.cpp: correctness checks and benchmarks for the math in
+ *                 "vec.h", "mat-yjc-new.h" (including the batch
+ *                 transforms) and "quat.h".
+ *
+ * Needs no GL context or window; only the headers are used.
+ * Not part of the HW4 project (it has its own main()). Build e.g. with
+ *
+ *   g++ -O2 -std=c++11 -pthread math_bench.cpp -o math_bench              (SSE2)
+ *   g++ -O2 -std=c++11 -pthread -mavx2 -mfma math_bench.cpp -o math_bench (AVX+FMA)
+ *   g++ -O2 -std=c++11 -pthread -DANGEL_NO_SIMD math_bench.cpp -o math_bench (scalar)
+ *
+ * (on Linux, a stand-in GL/glew.h that just includes <GL/gl.h> is enough.)
+ *
+ * The mat4 kernels, affine3x4, quat, chain() and the batch transforms are
+ * first checked against the original triple-loop operators.  Then, by default, each new
+ * operation is timed against what it replaces (speedup table); with
+ * --suite, the per-frame math (Rotate, LookAt, Perspective, NormalMatrix,
+ * inverse(mat3), normalize, cross, and the basic mat4 / affine3x4 / quat
+ * products) is timed on its own, two ways:
+ *   latency     - one call at a time, each call's input depending on the
+ *                 previous result (like an accumulated rotation);
+ *   throughput  - independent calls over an array of "bulk" inputs
+ *                 (like transforming a vertex array).
+ *
+ * Every measurement is repeated "samples" times after calibrating the
+ * iteration count so that one sample takes at least "min-time" ms; the
+ * speedups compare medians, and the suite reports the median, min, mean,
+ * standard deviation and median absolute deviation of ns/op.  For stable
+ * numbers pin the process to one core (e.g. taskset -c 2 ./math_bench)
+ * on an otherwise idle machine.
+ *
+ * Usage: math_bench [--suite] [--json FILE|-] [--filter TEXT] [--samples N]
+ *                   [--min-time MS] [--bulk N]
+ ************************************************************/
+
+#include "Angel-yjc.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// Keeps the optimizer from discarding the benchmarked results.
+static volatile float sink;
+
+struct Options {
+	bool        suite;       // the suite instead of the speedup table
+	const char* json;        // NULL: no JSON, "-": JSON on stdout
+	const char* filter;      // only run benchmarks whose name contains this
+	int         samples;
+	double      min_time_ms;
+	int         bulk;
+};
+
+//----------------------------------------------------------------------------
+// The original (pre-SIMD) mat4 operators, kept here as the reference.
+
+static mat4 naive_mul( const mat4& l, const mat4& m )
+{
+	mat4 a(0.0);
+	for (int i = 0; i < 4; ++i)
+		for (int j = 0; j < 4; ++j)
+			for (int k = 0; k < 4; ++k)
+				a[i][j] += l[i][k] * m[k][j];
+	return a;
+}
+
+static vec4 naive_mul( const mat4& m, const vec4& v )
+{
+	return vec4(m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z + m[0][3] * v.w,
+		m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z + m[1][3] * v.w,
+		m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z + m[2][3] * v.w,
+		m[3][0] * v.x + m[3][1] * v.y + m[3][2] * v.z + m[3][3] * v.w);
+}
+
+//----------------------------------------------------------------------------
+
+static float frand()
+{
+	return (rand() % 2001) / 1000.0f - 1.0f;
+}
+
+static bool close_enough( const GLfloat* a, const GLfloat* b, int n )
+{
+	for (int i = 0; i < n; i++)
+		if (fabs(a[i] - b[i]) > 1e-4f * (1.0f + fabs(b[i])))
+			return false;
+	return true;
+}
+
+struct Stats {
+	double median, min, mean, stddev, mad;
+};
+
+struct Result {
+	std::string name;
+	const char* mode;
+	long long   iterations;  // per sample
+	Stats       ns;          // ns per operation
+};
+
+static Stats summarize( std::vector<double> v )
+{
+	Stats s;
+	std::sort(v.begin(), v.end());
+	size_t n = v.size();
+	s.median = n % 2 ? v[n / 2] : 0.5 * (v[n / 2 - 1] + v[n / 2]);
+	s.min = v[0];
+
+	double sum = 0.0, sq = 0.0;
+	for (size_t i = 0; i < n; i++) sum += v[i];
+	s.mean = sum / n;
+	for (size_t i = 0; i < n; i++) sq += (v[i] - s.mean) * (v[i] - s.mean);
+	s.stddev = n > 1 ? std::sqrt(sq / (n - 1)) : 0.0;
+
+	std::vector<double> dev(n);
+	for (size_t i = 0; i < n; i++) dev[i] = std::fabs(v[i] - s.median);
+	std::sort(dev.begin(), dev.end());
+	s.mad = n % 2 ? dev[n / 2] : 0.5 * (dev[n / 2 - 1] + dev[n / 2]);
+	return s;
+}
+
+//----------------------------------------------------------------------------
+// body(n) performs n iterations of ops_per_iter operations each.
+
+template <class Body>
+static double time_ns( const Body& body, long long n )
+{
+	Clock::time_point t0 = Clock::now();
+	body(n);
+	Clock::time_point t1 = Clock::now();
+	return std::chrono::duration<double, std::nano>(t1 - t0).count();
+}
+
+template <class Body>
+static Result measure( const Options& opt, const std::string& name, const char* mode,
+		       long long ops_per_iter, const Body& body )
+{
+	// Calibrate: grow n until one sample is long enough (also warms up).
+	const double target = opt.min_time_ms * 1.0e6;
+	long long n = 1;
+	double t = time_ns(body, n);
+	while (t < target && n < (1LL << 40)) {
+		n = t > 0.0 && t * 2.0 < target ? (long long) (n * std::min(target * 1.2 / t, 100.0)) + 1 : n * 2;
+		t = time_ns(body, n);
+	}
+
+	std::vector<double> ns(opt.samples);
+	for (int i = 0; i < opt.samples; i++)
+		ns[i] = time_ns(body, n) / ((double) n * ops_per_iter);
+
+	Result r;
+	r.name = name;
+	r.mode = mode;
+	r.iterations = n;
+	r.ns = summarize(ns);
+	return r;
+}
+
+//----------------------------------------------------------------------------
+// Correctness: the new operators against the reference ones, on N_CMP
+// random matrices, vectors, affine transforms and quaternions.
+
+static const int N_CMP = 1024;          // power of 2, indexes with & (N_CMP - 1)
+
+struct CompareInputs {
+	std::vector<mat4>      m, rm;       // rm: rotations, from qm
+	std::vector<vec4>      v;
+	std::vector<affine3x4> am;
+	std::vector<quat>      qm;
+
+	CompareInputs() : m(N_CMP), rm(N_CMP), v(N_CMP), am(N_CMP), qm(N_CMP)
+	{
+		for (int i = 0; i < N_CMP; i++) {
+			for (int r = 0; r < 4; r++)
+				m[i][r] = vec4(frand(), frand(), frand(), frand());
+			v[i] = vec4(frand(), frand(), frand(), 1.0);
+		}
+		for (int i = 0; i < N_CMP; i++)
+			am[i] = AffineTranslate(v[i]) * AffineRotate(360.0f * frand(), frand(), frand(), 2.0f);
+		for (int i = 0; i < N_CMP; i++) {
+			qm[i] = QuatRotate(360.0f * frand(), frand(), frand(), 2.0f);
+			rm[i] = Rotate(qm[i]);
+		}
+	}
+};
+
+#ifdef ANGEL_HAS_CONSTEXPR
+static_assert((vec4(1, 2, 3, 4) * vec4(5, 6, 7, 8)).w == 32, "vec4 * vec4 must multiply w by w");
+#endif
+
+static bool check_all( const CompareInputs& in )
+{
+	const std::vector<mat4>& m = in.m;
+	const std::vector<vec4>& v = in.v;
+	const std::vector<affine3x4>& am = in.am;
+
+	vec4 p = v[0] * v[1];
+	if (p.x != v[0].x * v[1].x || p.y != v[0].y * v[1].y || p.z != v[0].z * v[1].z || p.w != v[0].w * v[1].w) {
+		printf("Error! vec4 * vec4 is not component-wise\n");
+		return false;
+	}
+
+	for (int i = 0; i + 1 < N_CMP; i++) {
+		mat4 a = m[i] * m[i + 1];
+		mat4 b = naive_mul(m[i], m[i + 1]);
+		vec4 c = m[i] * v[i];
+		vec4 d = naive_mul(m[i], v[i]);
+		mat4 e = m[i];
+		e *= m[i + 1];
+		if (!close_enough(a, b, 16) || !close_enough(e, b, 16) || !close_enough(c, d, 4)) {
+			printf("Error! SIMD result differs from reference at %d\n", i);
+			return false;
+		}
+		if (!close_enough(mat4(am[i] * am[i + 1]), mat4(am[i]) * mat4(am[i + 1]), 16)) {
+			printf("Error! affine3x4 product differs from mat4 product at %d\n", i);
+			return false;
+		}
+	}
+
+	for (int i = 0; i + 4 < N_CMP; i++) {
+		mat4 a = m[i] * m[i + 1] * m[i + 2] * m[i + 3] * m[i + 4];
+		mat4 b = chain(m[i]) * m[i + 1] * m[i + 2] * m[i + 3] * m[i + 4];
+		mat4 c = am[i] * m[i + 1] * am[i + 2] * m[i + 3] * am[i + 4];
+		mat4 d = chain(am[i]) * m[i + 1] * am[i + 2] * m[i + 3] * am[i + 4];
+		vec4 e = a * v[i];
+		vec4 f = chain(m[i]) * m[i + 1] * m[i + 2] * m[i + 3] * m[i + 4] * v[i];
+		mat4 g = m[i];
+		g = chain(m[i + 1]) * g * g;        // target aliases the operands
+		mat4 h = m[i + 1] * m[i] * m[i];
+		if (!close_enough(b, a, 16) || !close_enough(d, c, 16) || !close_enough(f, e, 4) ||
+			!close_enough(g, h, 16)) {
+			printf("Error! fused chain differs from operator chain at %d\n", i);
+			return false;
+		}
+	}
+	return true;
+}
+
+// The batch transforms against one operator call per element, with a
+// count that leaves a tail for every kernel width and, on a pool, is
+// split across its threads.
+static bool check_batch( const CompareInputs& in )
+{
+	const int NB = 3 * BatchTransformGrain + 7;
+	std::vector<vec4> pts(NB), out(NB);
+	std::vector<vec3> nrm(NB), nrm_out(NB);
+	std::vector<GLfloat> sx(NB), sy(NB), sz(NB), ox(NB), oy(NB), oz(NB), ow(NB);
+	for (int i = 0; i < NB; i++) {
+		pts[i] = vec4(frand(), frand(), frand(), 1.0);
+		nrm[i] = vec3(pts[i].x, pts[i].y, pts[i].z);
+		sx[i] = pts[i].x;  sy[i] = pts[i].y;  sz[i] = pts[i].z;
+	}
+	const mat4& bm = in.m[7];
+	mat3 nm = upperLeftMat3(bm);
+	ThreadPool pool;
+
+	for (int threaded = 0; threaded < 2; threaded++) {
+		ThreadPool* p = threaded ? &pool : NULL;
+		TransformPoints(bm, &pts[0], &out[0], NB, p);
+		TransformNormals(nm, &nrm[0], &nrm_out[0], NB, p);
+		TransformPointsSoA(bm, &sx[0], &sy[0], &sz[0], &ox[0], &oy[0], &oz[0], &ow[0], NB, p);
+		for (int i = 0; i < NB; i++) {
+			vec4 r = naive_mul(bm, pts[i]);
+			GLfloat soa[4] = { ox[i], oy[i], oz[i], ow[i] };
+			vec3 n = nm * nrm[i];
+			if (!close_enough(out[i], r, 4) || !close_enough(soa, r, 4) || !close_enough(nrm_out[i], n, 3)) {
+				printf("Error! batch transform differs from reference at %d (%s)\n", i,
+					threaded ? "pool" : "one thread");
+				return false;
+			}
+		}
+	}
+
+	// in place
+	std::vector<vec4> same(pts);
+	TransformPoints(bm, &same[0], &same[0], NB, &pool);
+	if (memcmp(&same[0], &out[0], NB * sizeof(vec4)) != 0) {
+		printf("Error! TransformPoints in place differs from out of place\n");
+		return false;
+	}
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// Speedups: each new operation against what it replaces, as the median
+// ns per operation of both, measured the same way.
+
+template <class Reference, class New>
+static void compare( const Options& opt, const char* what, const char* ref_name, const Reference& ref,
+		     const char* new_name, const New& simd, long long ops_per_iter = 1 )
+{
+	if (opt.filter && !strstr(what, opt.filter)) return;
+	double r = measure(opt, what, "latency", ops_per_iter, ref).ns.median;
+	double s = measure(opt, what, "latency", ops_per_iter, simd).ns.median;
+	printf("%-20s %-9s %7.2f ns   %-9s %7.2f ns   speedup %.2fx\n", what, ref_name, r, new_name, s, r / s);
+}
+
+static void compare_all( const Options& opt, const CompareInputs& in )
+{
+	const int M = N_CMP - 1;
+	const mat4* m = &in.m[0];
+	const mat4* rm = &in.rm[0];
+	const vec4* v = &in.v[0];
+	const affine3x4* am = &in.am[0];
+	const quat* qm = &in.qm[0];
+
+	/*--- mat4 * mat4: dependent chain, like accum_rotation updates ---*/
+	compare(opt, "mat4 * mat4", "reference", [&]( long long n ) {
+		mat4 acc;
+		for (long long i = 0; i < n; i++)
+			acc = naive_mul(m[i & M], acc);
+		sink = acc[0][0];
+	}, "new", [&]( long long n ) {
+		mat4 acc;
+		for (long long i = 0; i < n; i++)
+			acc = m[i & M] * acc;
+		sink = acc[0][0];
+	});
+
+	/*--- mat4 * vec4: independent products over an array ---*/
+	compare(opt, "mat4 * vec4", "reference", [&]( long long n ) {
+		vec4 sum;
+		for (long long i = 0; i < n; i++)
+			sum += naive_mul(m[(i >> 10) & M], v[i & M]);
+		sink = sum.x;
+	}, "new", [&]( long long n ) {
+		vec4 sum;
+		for (long long i = 0; i < n; i++)
+			sum += m[(i >> 10) & M] * v[i & M];
+		sink = sum.x;
+	});
+
+	/*--- affine3x4 vs mat4 composition (same dependent chain) ---*/
+	compare(opt, "affine * affine", "mat4", [&]( long long n ) {
+		mat4 acc;
+		for (long long i = 0; i < n; i++)
+			acc = mat4(am[i & M]) * acc;
+		sink = acc[0][0];
+	}, "affine3x4", [&]( long long n ) {
+		affine3x4 acc;
+		for (long long i = 0; i < n; i++)
+			acc = am[i & M] * acc;
+		sink = acc[0][0];
+	});
+
+	/*--- quat vs mat4 for accumulating rotations (like accum_rotation) ---*/
+	compare(opt, "rotation accumulate", "mat4", [&]( long long n ) {
+		mat4 acc;
+		for (long long i = 0; i < n; i++)
+			acc = rm[i & M] * acc;
+		sink = acc[0][0];
+	}, "quat", [&]( long long n ) {
+		quat acc;
+		for (long long i = 0; i < n; i++) {
+			acc = qm[i & M] * acc;
+			acc.renormalize();
+		}
+		sink = acc.x;
+	});
+
+	// Drift after many compositions: how far each is from a pure rotation.
+	if (!opt.filter || strstr("rotation drift", opt.filter)) {
+		const long long DRIFT_REPS = 1LL << 24;
+		mat4 acc;
+		quat qacc;
+		for (long long i = 0; i < DRIFT_REPS; i++) {
+			acc = rm[i & M] * acc;
+			qacc = qm[i & M] * qacc;
+			qacc.renormalize();
+		}
+		mat4 ortho = acc * transpose1(acc);
+		float drift = 0.0;
+		for (int i = 0; i < 4; i++)
+			for (int j = 0; j < 4; j++)
+				drift = fmax(drift, fabs(ortho[i][j] - (i == j ? 1.0f : 0.0f)));
+		printf("rotation drift       mat4 |M M^T - I| = %g   quat ||q| - 1| = %g\n",
+			drift, fabs(length(qacc) - 1.0f));
+	}
+
+	/*--- fused chains vs the operators, like the shadow model-view in display() ---*/
+	compare(opt, "5 x mat4 chain", "operators", [&]( long long n ) {
+		mat4 acc;
+		for (long long i = 0; i < n; i++) {
+			int k = (int) (i & M), l = (int) ((i + 1) & M);
+			acc = m[k] * m[l] * acc * m[k] * m[l];
+		}
+		sink = acc[0][0];
+	}, "chain()", [&]( long long n ) {
+		mat4 acc;
+		for (long long i = 0; i < n; i++) {
+			int k = (int) (i & M), l = (int) ((i + 1) & M);
+			acc = chain(m[k]) * m[l] * acc * m[k] * m[l];
+		}
+		sink = acc[0][0];
+	});
+
+	// view (affine) * T * shadow * T * model (affine), with a dependent model
+	compare(opt, "mixed affine chain", "operators", [&]( long long n ) {
+		mat4 acc;
+		for (long long i = 0; i < n; i++) {
+			int k = (int) (i & M), l = (int) ((i + 1) & M);
+			acc = am[k] * m[l] * acc * m[k] * am[l];
+		}
+		sink = acc[0][0];
+	}, "chain()", [&]( long long n ) {
+		mat4 acc;
+		for (long long i = 0; i < n; i++) {
+			int k = (int) (i & M), l = (int) ((i + 1) & M);
+			acc = chain(am[k]) * m[l] * acc * m[k] * am[l];
+		}
+		sink = acc[0][0];
+	});
+
+	// chain * vec4: four mat4 * vec4 instead of three mat4 * mat4 + one mat4 * vec4
+	compare(opt, "4 x mat4 * vec4", "operators", [&]( long long n ) {
+		vec4 sum;
+		for (long long i = 0; i < n; i++) {
+			int k = (int) (i & M), l = (int) ((i >> 10) & M);
+			sum += m[l] * m[k] * m[l] * m[k] * v[k];
+		}
+		sink = sum.x;
+	}, "chain()", [&]( long long n ) {
+		vec4 sum;
+		for (long long i = 0; i < n; i++) {
+			int k = (int) (i & M), l = (int) ((i >> 10) & M);
+			sum += chain(m[l]) * m[k] * m[l] * m[k] * v[k];
+		}
+		sink = sum.x;
+	});
+
+	/*--- batch transforms over an array, against one operator call per element (ns per element) ---*/
+	if (opt.filter && !strstr("TransformPoints TransformPointsSoA TransformNormals", opt.filter)) return;
+	const int NB = 1 << 20;          // 16 MB of points in, 16 MB out
+	std::vector<vec4> pts(NB), out(NB);
+	std::vector<vec3> nrm(NB), nrm_out(NB);
+	std::vector<GLfloat> sx(NB), sy(NB), sz(NB), ox(NB), oy(NB), oz(NB);
+	for (int i = 0; i < NB; i++) {
+		pts[i] = vec4(frand(), frand(), frand(), 1.0);
+		nrm[i] = vec3(pts[i].x, pts[i].y, pts[i].z);
+		sx[i] = pts[i].x;  sy[i] = pts[i].y;  sz[i] = pts[i].z;
+	}
+	const mat4& bm = m[7];
+	mat3 nm = upperLeftMat3(bm);
+	ThreadPool pool;
+	auto point_loop = [&]( long long n ) {
+		for (long long r = 0; r < n; r++)
+			for (int i = 0; i < NB; i++)
+				out[i] = bm * pts[i];
+		sink = out[NB - 1].x;
+	};
+
+	compare(opt, "TransformPoints", "loop", point_loop, "batch", [&]( long long n ) {
+		for (long long r = 0; r < n; r++)
+			TransformPoints(bm, &pts[0], &out[0], NB);
+		sink = out[NB - 1].x;
+	}, NB);
+	compare(opt, "TransformPointsSoA", "loop", point_loop, "batch", [&]( long long n ) {
+		for (long long r = 0; r < n; r++)
+			TransformPointsSoA(bm, &sx[0], &sy[0], &sz[0], &ox[0], &oy[0], &oz[0], NULL, NB);
+		sink = ox[NB - 1];
+	}, NB);
+	compare(opt, "TransformNormals", "loop", [&]( long long n ) {
+		for (long long r = 0; r < n; r++)
+			for (int i = 0; i < NB; i++)
+				nrm_out[i] = nm * nrm[i];
+		sink = nrm_out[NB - 1].x;
+	}, "batch", [&]( long long n ) {
+		for (long long r = 0; r < n; r++)
+			TransformNormals(nm, &nrm[0], &nrm_out[0], NB);
+		sink = nrm_out[NB - 1].x;
+	}, NB);
+	char pooled[32];
+	snprintf(pooled, sizeof(pooled), "TransformPoints x%d", pool.size());
+	compare(opt, pooled, "loop", point_loop, "batch", [&]( long long n ) {
+		for (long long r = 0; r < n; r++)
+			TransformPoints(bm, &pts[0], &out[0], NB, &pool);
+		sink = out[NB - 1].x;
+	}, NB);
+}
+
+//----------------------------------------------------------------------------
+// The suite.  Inputs: N_IN random but well-conditioned values of each kind.
+
+static const int N_IN = 1024;          // power of 2, indexes with & (N_IN - 1)
+
+static float frand( float lo, float hi )
+{
+	return lo + (hi - lo) * (rand() % 10001) / 10000.0f;
+}
+
+struct Inputs {
+	std::vector<GLfloat> angle, fovy;
+	std::vector<vec3>    axis, v3, w3;
+	std::vector<vec4>    v4, w4, eye;
+	std::vector<mat4>    m4, rot4;     // rot4, rota: pure rotations, for
+	std::vector<mat3>    m3;           // dependent chains that must not
+	std::vector<affine3x4> a4, rota;   // grow or shrink
+	std::vector<quat>    q;
+
+	Inputs() : angle(N_IN), fovy(N_IN), axis(N_IN), v3(N_IN), w3(N_IN),
+		   v4(N_IN), w4(N_IN), eye(N_IN), m4(N_IN), rot4(N_IN), m3(N_IN),
+		   a4(N_IN), rota(N_IN), q(N_IN)
+	{
+		for (int i = 0; i < N_IN; i++) {
+			angle[i] = frand(-180.0f, 180.0f);
+			fovy[i]  = frand(30.0f, 90.0f);
+			axis[i]  = vec3(frand(-1, 1), frand(-1, 1), frand(0.5f, 1));
+			v3[i]    = vec3(frand(-5, 5), frand(-5, 5), frand(-5, 5));
+			w3[i]    = vec3(frand(-5, 5), frand(-5, 5), frand(-5, 5));
+			v4[i]    = vec4(v3[i], 1.0);
+			w4[i]    = vec4(w3[i], 0.0);
+			eye[i]   = vec4(frand(-10, 10), frand(2, 10), frand(-10, 10), 1.0);
+			// rotation * non-uniform scale * translation: invertible, like a model-view
+			m4[i] = Translate(v4[i]) * Rotate(angle[i], axis[i].x, axis[i].y, axis[i].z)
+				* Scale(frand(0.5f, 2), frand(0.5f, 2), frand(0.5f, 2));
+			m3[i] = upperLeftMat3(m4[i]);
+			a4[i] = affine3x4(m4[i]);
+			rot4[i] = Rotate(angle[i], axis[i].x, axis[i].y, axis[i].z);
+			rota[i] = affine3x4(rot4[i]);
+			q[i]  = QuatRotate(angle[i], axis[i].x, axis[i].y, axis[i].z);
+		}
+	}
+};
+
+//----------------------------------------------------------------------------
+// Benchmark definitions.
+//
+// Latency bodies make the next input depend on the last result, either
+// directly (products of rotations) or through a "+ r * 0.0f" term, which
+// the compiler has to keep without -ffast-math.
+
+static void run_all( const Options& opt, std::vector<Result>& results )
+{
+	static Inputs in;
+	const int B = opt.bulk;
+	const int M = N_IN - 1;
+
+	std::vector<mat4> out4(B);
+	std::vector<mat3> out3(B);
+	std::vector<vec4> outv4(B);
+	std::vector<vec3> outv3(B);
+	std::vector<affine3x4> outa(B);
+	std::vector<quat> outq(B);
+
+#define BENCH_LATENCY( NAME, BODY ) \
+	if (!opt.filter || strstr(NAME, opt.filter)) \
+		results.push_back(measure(opt, NAME, "latency", 1, [&]( long long n ) { BODY }))
+
+#define BENCH_THROUGHPUT( NAME, BODY ) \
+	if (!opt.filter || strstr(NAME, opt.filter)) \
+		results.push_back(measure(opt, NAME, "throughput", B, [&]( long long n ) { \
+			for (long long k = 0; k < n; k++) { BODY } }))
+
+	/*--- Rotate(angle, x, y, z) ---*/
+	BENCH_LATENCY("Rotate", {
+		mat4 r;
+		for (long long i = 0; i < n; i++) {
+			const vec3& a = in.axis[i & M];
+			r = Rotate(in.angle[i & M] + r[0][1] * 0.0f, a.x, a.y, a.z);
+		}
+		sink = r[0][0];
+	});
+	BENCH_THROUGHPUT("Rotate", {
+		for (int j = 0; j < B; j++) {
+			const vec3& a = in.axis[j & M];
+			out4[j] = Rotate(in.angle[j & M], a.x, a.y, a.z);
+		}
+		sink = out4[k % B][0][0];
+	});
+
+	/*--- LookAt(eye, at, up) ---*/
+	const vec4 at(0.0, 0.0, 0.0, 1.0), up(0.0, 1.0, 0.0, 0.0);
+	BENCH_LATENCY("LookAt", {
+		mat4 r;
+		for (long long i = 0; i < n; i++)
+			r = LookAt(in.eye[i & M] + r[0][1] * 0.0f, at, up);
+		sink = r[0][0];
+	});
+	BENCH_THROUGHPUT("LookAt", {
+		for (int j = 0; j < B; j++)
+			out4[j] = LookAt(in.eye[j & M], at, up);
+		sink = out4[k % B][0][0];
+	});
+
+	/*--- Perspective(fovy, aspect, zNear, zFar) ---*/
+	BENCH_LATENCY("Perspective", {
+		mat4 r;
+		for (long long i = 0; i < n; i++)
+			r = Perspective(in.fovy[i & M] + r[0][0] * 0.0f, 1.25f, 0.5f, 18.0f);
+		sink = r[0][0];
+	});
+	BENCH_THROUGHPUT("Perspective", {
+		for (int j = 0; j < B; j++)
+			out4[j] = Perspective(in.fovy[j & M], 1.25f, 0.5f, 18.0f);
+		sink = out4[k % B][0][0];
+	});
+
+	/*--- NormalMatrix(mv, 0) and NormalMatrix(mv, 1) ---*/
+	BENCH_LATENCY("NormalMatrix/uniform", {
+		mat3 r;
+		for (long long i = 0; i < n; i++)
+			r = NormalMatrix(in.m4[i & M] * (1.0f + r[0][0] * 0.0f), 0);
+		sink = r[0][0];
+	});
+	BENCH_THROUGHPUT("NormalMatrix/uniform", {
+		for (int j = 0; j < B; j++)
+			out3[j] = NormalMatrix(in.m4[j & M], 0);
+		sink = out3[k % B][0][0];
+	});
+	BENCH_LATENCY("NormalMatrix/non_uniform", {
+		mat3 r;
+		for (long long i = 0; i < n; i++)
+			r = NormalMatrix(in.m4[i & M] * (1.0f + r[0][0] * 0.0f), 1);
+		sink = r[0][0];
+	});
+	BENCH_THROUGHPUT("NormalMatrix/non_uniform", {
+		for (int j = 0; j < B; j++)
+			out3[j] = NormalMatrix(in.m4[j & M], 1);
+		sink = out3[k % B][0][0];
+	});
+
+	/*--- inverse(mat3) ---*/
+	BENCH_LATENCY("inverse(mat3)", {
+		mat3 r;
+		for (long long i = 0; i < n; i++)
+			r = inverse(in.m3[i & M] * (1.0f + r[0][0] * 0.0f));
+		sink = r[0][0];
+	});
+	BENCH_THROUGHPUT("inverse(mat3)", {
+		for (int j = 0; j < B; j++)
+			out3[j] = inverse(in.m3[j & M]);
+		sink = out3[k % B][0][0];
+	});
+
+	/*--- normalize(vec3), normalize(vec4) ---*/
+	BENCH_LATENCY("normalize(vec3)", {
+		vec3 r = in.v3[0];
+		for (long long i = 0; i < n; i++)
+			r = normalize(in.v3[i & M] + r * 0.0f);
+		sink = r.x;
+	});
+	BENCH_THROUGHPUT("normalize(vec3)", {
+		for (int j = 0; j < B; j++)
+			outv3[j] = normalize(in.v3[j & M]);
+		sink = outv3[k % B].x;
+	});
+	BENCH_LATENCY("normalize(vec4)", {
+		vec4 r = in.w4[0];
+		for (long long i = 0; i < n; i++)
+			r = normalize(in.w4[i & M] + r * 0.0f);
+		sink = r.x;
+	});
+	BENCH_THROUGHPUT("normalize(vec4)", {
+		for (int j = 0; j < B; j++)
+			outv4[j] = normalize(in.w4[j & M]);
+		sink = outv4[k % B].x;
+	});
+
+	/*--- cross(vec3, vec3) ---*/
+	BENCH_LATENCY("cross(vec3)", {
+		vec3 r = in.v3[0];
+		for (long long i = 0; i < n; i++)
+			r = cross(in.v3[i & M] + r * 0.0f, in.w3[i & M]);
+		sink = r.x;
+	});
+	BENCH_THROUGHPUT("cross(vec3)", {
+		for (int j = 0; j < B; j++)
+			outv3[j] = cross(in.v3[j & M], in.w3[j & M]);
+		sink = outv3[k % B].x;
+	});
+
+	/*--- the products everything else is built from ---*/
+	BENCH_LATENCY("mat4*mat4", {
+		mat4 r;
+		for (long long i = 0; i < n; i++)
+			r = in.rot4[i & M] * r;
+		sink = r[0][0];
+	});
+	BENCH_THROUGHPUT("mat4*mat4", {
+		for (int j = 0; j < B; j++)
+			out4[j] = in.m4[j & M] * in.m4[(j + 1) & M];
+		sink = out4[k % B][0][0];
+	});
+	BENCH_LATENCY("mat4*vec4", {
+		vec4 r = in.v4[0];
+		for (long long i = 0; i < n; i++)
+			r = in.rot4[i & M] * r;
+		sink = r.x;
+	});
+	BENCH_THROUGHPUT("mat4*vec4", {
+		for (int j = 0; j < B; j++)
+			outv4[j] = in.m4[(j >> 4) & M] * in.v4[j & M];
+		sink = outv4[k % B].x;
+	});
+	BENCH_LATENCY("affine3x4*affine3x4", {
+		affine3x4 r;
+		for (long long i = 0; i < n; i++)
+			r = in.rota[i & M] * r;
+		sink = r[0][0];
+	});
+	BENCH_THROUGHPUT("affine3x4*affine3x4", {
+		for (int j = 0; j < B; j++)
+			outa[j] = in.a4[j & M] * in.a4[(j + 1) & M];
+		sink = outa[k % B][0][0];
+	});
+	BENCH_LATENCY("quat*quat", {
+		quat r;
+		for (long long i = 0; i < n; i++)
+			r = in.q[i & M] * r;
+		sink = r.x;
+	});
+	BENCH_THROUGHPUT("quat*quat", {
+		for (int j = 0; j < B; j++)
+			outq[j] = in.q[j & M] * in.q[(j + 1) & M];
+		sink = outq[k % B].x;
+	});
+
+#undef BENCH_LATENCY
+#undef BENCH_THROUGHPUT
+}
+
+//----------------------------------------------------------------------------
+
+static const char* kernel_name()
+{
+#if defined(ANGEL_AVX) && defined(ANGEL_FMA)
+	return "avx+fma";
+#elif defined(ANGEL_AVX)
+	return "avx";
+#elif defined(ANGEL_SSE2)
+	return "sse2";
+#else
+	return "scalar";
+#endif
+}
+
+static const char* compiler_name()
+{
+#if defined(__clang__)
+	return "clang " __clang_version__;
+#elif defined(__GNUC__)
+	return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+	return "msvc";
+#else
+	return "unknown";
+#endif
+}
+
+static void write_json( FILE* f, const Options& opt, const std::vector<Result>& results )
+{
+	fprintf(f, "{\n");
+	fprintf(f, "  \"schema\": 1,\n");
+	fprintf(f, "  \"kernel\": \"%s\",\n", kernel_name());
+	fprintf(f, "  \"compiler\": \"%s\",\n", compiler_name());
+	fprintf(f, "  \"samples\": %d,\n", opt.samples);
+	fprintf(f, "  \"min_time_ms\": %g,\n", opt.min_time_ms);
+	fprintf(f, "  \"bulk\": %d,\n", opt.bulk);
+	fprintf(f, "  \"results\": [\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const Result& r = results[i];
+		fprintf(f, "    { \"name\": \"%s\", \"mode\": \"%s\", \"iterations\": %lld, "
+			"\"ns_per_op\": { \"median\": %.4f, \"min\": %.4f, \"mean\": %.4f, "
+			"\"stddev\": %.4f, \"mad\": %.4f } }%s\n",
+			r.name.c_str(), r.mode, r.iterations, r.ns.median, r.ns.min, r.ns.mean,
+			r.ns.stddev, r.ns.mad, i + 1 < results.size() ? "," : "");
+	}
+	fprintf(f, "  ]\n}\n");
+}
+
+static void usage( const char* prog )
+{
+	fprintf(stderr, "usage: %s [--suite] [--json FILE|-] [--filter TEXT] [--samples N] "
+		"[--min-time MS] [--bulk N]\n", prog);
+	exit(2);
+}
+
+int main( int argc, char** argv )
+{
+	Options opt;
+	opt.suite = false;
+	opt.json = NULL;
+	opt.filter = NULL;
+	opt.samples = 15;
+	opt.min_time_ms = 5.0;
+	opt.bulk = 4096;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--suite")) { opt.suite = true; continue; }
+		if (i + 1 >= argc) usage(argv[0]);
+		if (!strcmp(argv[i], "--json")) opt.json = argv[++i];
+		else if (!strcmp(argv[i], "--filter")) opt.filter = argv[++i];
+		else if (!strcmp(argv[i], "--samples")) opt.samples = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--min-time")) opt.min_time_ms = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--bulk")) opt.bulk = atoi(argv[++i]);
+		else usage(argv[0]);
+	}
+	if (opt.samples < 1 || opt.bulk < 1 || opt.min_time_ms <= 0.0) usage(argv[0]);
+	if (opt.json && !opt.suite) usage(argv[0]);
+
+	static CompareInputs cmp;
+	if (!check_all(cmp) || !check_batch(cmp))
+		return 1;
+
+	if (!opt.suite) {
+		printf("kernel: %s\n", kernel_name());
+		compare_all(opt, cmp);
+		return 0;
+	}
+
+	std::vector<Result> results;
+	run_all(opt, results);
+
+	// The table goes to stderr when the JSON goes to stdout.
+	FILE* table = opt.json && !strcmp(opt.json, "-") ? stderr : stdout;
+	fprintf(table, "kernel: %s   samples: %d   bulk: %d\n\n", kernel_name(), opt.samples, opt.bulk);
+	fprintf(table, "%-26s %-10s %10s %10s %8s %8s\n", "benchmark", "mode", "median ns", "min ns", "mad", "rsd %");
+	for (size_t i = 0; i < results.size(); i++) {
+		const Result& r = results[i];
+		fprintf(table, "%-26s %-10s %10.2f %10.2f %8.2f %8.2f\n", r.name.c_str(), r.mode,
+			r.ns.median, r.ns.min, r.ns.mad, r.ns.mean > 0.0 ? 100.0 * r.ns.stddev / r.ns.mean : 0.0);
+	}
+
+	if (opt.json) {
+		FILE* f = strcmp(opt.json, "-") ? fopen(opt.json, "w") : stdout;
+		if (f == NULL) {
+			printf("Error! Cannot open %s for writing\n", opt.json);
+			return 1;
+		}
+		write_json(f, opt, results);
+		if (f != stdout) fclose(f);
+	}
+	return 0;
+}
@@ -0,0 +1,143 @@
+#include <string.h>
+
+#include "mesh_detail.h"
+
+namespace Angel {
+
+//----------------------------------------------------------------------------
+//
+//  IndexedMesh
+//
+
+namespace {
+
+// -0.0 and +0.0 compare equal, so they must hash equal too.
+inline unsigned
+float_bits( GLfloat f )
+{
+    f += 0.0f;
+    unsigned u;
+    memcpy( &u, &f, sizeof(u) );
+    return u;
+}
+
+inline unsigned
+mix( unsigned h, GLfloat f )
+{
+    h ^= float_bits( f );
+    h *= 0x9e3779b1u;
+    return h ^ ( h >> 15 );
+}
+
+inline unsigned
+vertex_hash( const vec4& p, const vec3* n )
+{
+    unsigned h = mix( mix( mix( 0x811c9dc5u, p.x ), p.y ), p.z );
+    if ( n ) { h = mix( mix( mix( h, n->x ), n->y ), n->z ); }
+    return h;
+}
+
+inline bool
+same_vertex( const vec4& p, const vec3* n, const vec4& q, const vec3* m )
+{
+    if ( p.x != q.x || p.y != q.y || p.z != q.z ) { return false; }
+    return n == NULL || ( n->x == m->x && n->y == m->y && n->z == m->z );
+}
+
+}  // namespace
+
+void
+IndexedMesh::build( const vec4* points, const vec3* normals, int count, bool weld_normals )
+{
+    release();
+
+    // Open addressing, at most half full; slots hold a unique vertex + 1.
+    size_t slots = 1024;
+    while ( slots < 2 * (size_t) count ) { slots *= 2; }
+    Arena scratch( slots * sizeof(int) + 64 );
+    int* table = scratch.allocate<int>( slots );
+    memset( table, 0, slots * sizeof(int) );
+    int* remap = scratch.allocate<int>( (size_t) count );
+
+    // first[v] is the input vertex that unique vertex v was taken from.
+    int* first = scratch.allocate<int>( (size_t) count );
+    int unique = 0;
+    for ( int i = 0; i < count; ++i ) {
+	const vec3* n = weld_normals ? &normals[i] : NULL;
+	size_t s = vertex_hash( points[i], n ) & ( slots - 1 );
+	for ( ;; s = ( s + 1 ) & ( slots - 1 ) ) {
+	    int v = table[s] - 1;
+	    if ( v < 0 ) {
+		table[s] = unique + 1;
+		first[unique] = i;
+		remap[i] = unique++;
+		break;
+	    }
+	    int f = first[v];
+	    if ( same_vertex( points[i], n, points[f], weld_normals ? &normals[f] : NULL ) ) {
+		remap[i] = v;
+		break;
+	    }
+	}
+    }
+
+    _vertex_count = unique;
+    _index_count = count;
+    _points = _arena.allocate<vec4>( (size_t) unique );
+    _normals = _arena.allocate<vec3>( (size_t) unique );
+    for ( int v = 0; v < unique; ++v ) {
+	_points[v] = points[first[v]];
+	_normals[v] = normals ? normals[first[v]] : vec3( 0.0, 0.0, 0.0 );
+    }
+
+    if ( unique <= 65536 ) {
+	_index_type = GL_UNSIGNED_SHORT;
+	GLushort* indices = _arena.allocate<GLushort>( (size_t) count );
+	for ( int i = 0; i < count; ++i ) { indices[i] = (GLushort) remap[i]; }
+	_indices = indices;
+    } else {
+	_index_type = GL_UNSIGNED_INT;
+	GLuint* indices = _arena.allocate<GLuint>( (size_t) count );
+	for ( int i = 0; i < count; ++i ) { indices[i] = (GLuint) remap[i]; }
+	_indices = indices;
+    }
+}
+
+void
+IndexedMesh::build( const vec4* points, int vertex_count, const unsigned* indices, int index_count )
+{
+    IndexedMesh welded;
+    welded.build( points, NULL, vertex_count, false );
+
+    allocate( welded.vertex_count(), index_count );
+    memcpy( _points, welded.points(), (size_t) _vertex_count * sizeof(vec4) );
+    for ( int v = 0; v < _vertex_count; ++v ) { _normals[v] = vec3( 0.0, 0.0, 0.0 ); }
+    if ( index_count == 0 ) { return; }
+    std::vector<unsigned> remapped( (size_t) index_count );
+    for ( int i = 0; i < index_count; ++i ) { remapped[i] = welded.index( (int) indices[i] ); }
+    set_indices( &remapped[0] );
+}
+
+void
+IndexedMesh::allocate( int vertex_count, int index_count )
+{
+    release();
+    _vertex_count = vertex_count;
+    _index_count = index_count;
+    _points = _arena.allocate<vec4>( (size_t) vertex_count );
+    _normals = _arena.allocate<vec3>( (size_t) vertex_count );
+    _index_type = vertex_count <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    _indices = _arena.allocate( index_count * index_size() );
+}
+
+void
+IndexedMesh::unroll( Mesh& mesh ) const
+{
+    if ( _index_type == GL_UNSIGNED_SHORT ) {
+	detail::UnrollTriangles( _points, static_cast<const GLushort*>( _indices ), (size_t) _index_count, mesh );
+    } else {
+	detail::UnrollTriangles( _points, static_cast<const GLuint*>( _indices ), (size_t) _index_count, mesh );
+    }
+}
+
+}  // namespace Angel
@@ -0,0 +1,430 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- mesh.h ---
+//
+//   CPU-side storage for a mesh that is about to be uploaded to the GPU.
+//
+//   Arena - a bump allocator: memory is taken from large blocks and is
+//           only given back all at once by release().
+//
+//   Mesh  - the vertex streams of a triangle list (positions as vec4,
+//           normals as vec3), allocated from an arena and growable to any
+//           size.  Other per-vertex streams (e.g. colors) can be taken from
+//           the same arena with mesh.arena().allocate<T>(n), so that
+//           release() frees all of them once they are on the GPU;
+//           size() stays valid for drawing after that.
+//
+//   IndexedMesh - the same streams with duplicate vertices welded away,
+//           plus a 16- or 32-bit index buffer for glDrawElements(), and
+//           the usual reorderings for the GPU (mesh_optimize.cpp) and
+//           smooth normal generation (mesh_normals.cpp), or generated
+//           as an icosphere (mesh_sphere.cpp).  pack() (mesh_pack.cpp)
+//           converts the vertices to the compact PackedVertex format (a
+//           PackedMesh) for upload, and build_meshlets()
+//           (mesh_meshlets.cpp) splits the triangles into Meshlets that
+//           CullMeshlets() culls per frame.  SimplifyMesh()
+//           (mesh_simplify.cpp) makes coarser levels of detail.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ANGEL_MESH_H__
+#define __ANGEL_MESH_H__
+
+#include "Angel-yjc.h"
+#include "thread_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+namespace Angel {
+
+//----------------------------------------------------------------------------
+//
+//  Arena
+//
+
+class Arena {
+
+    struct Block {
+	char*   base;
+	size_t  size;
+	size_t  used;
+    };
+
+    std::vector<Block>  _blocks;
+    size_t              _block_size;   // minimum size of a new block
+    size_t              _allocated;    // bytes handed out, for statistics
+
+    Arena( const Arena& );                       // not copyable
+    Arena& operator = ( const Arena& );
+
+   public:
+    explicit Arena( size_t block_size = size_t(1) << 20 ) :
+	_block_size(block_size), _allocated(0) {}
+
+    ~Arena() { release(); }
+
+    // "bytes" bytes aligned to "align" (a power of 2).  Allocations larger
+    // than the block size get a block of their own.  Exits on out-of-memory,
+    // like the rest of the program does on fatal errors.
+    void* allocate( size_t bytes, size_t align = 16 ) {
+	if ( !_blocks.empty() ) {
+	    Block& b = _blocks.back();
+	    size_t at = ( (size_t) ( b.base + b.used ) + align - 1 ) & ~( align - 1 );
+	    at -= (size_t) b.base;
+	    if ( at + bytes <= b.size ) {
+		b.used = at + bytes;
+		_allocated += bytes;
+		return b.base + at;
+	    }
+	}
+
+	Block b;
+	b.size = bytes + align > _block_size ? bytes + align : _block_size;
+	b.base = (char*) malloc( b.size );
+	if ( b.base == NULL ) {
+	    printf( "Error! Out of memory allocating %.1f MB for a mesh\n",
+		    b.size / ( 1024.0 * 1024.0 ) );
+	    exit( -1 );
+	}
+	size_t at = ( ( (size_t) b.base + align - 1 ) & ~( align - 1 ) ) - (size_t) b.base;
+	b.used = at + bytes;
+	_blocks.push_back( b );
+	_allocated += bytes;
+	return b.base + at;
+    }
+
+    // An uninitialized array of n T's (T must be trivially copyable).
+    template <class T>
+    T* allocate( size_t n ) {
+	return static_cast<T*>( allocate( n * sizeof(T), 16 ) );
+    }
+
+    // Frees every block; all pointers from this arena become invalid.
+    void release() {
+	for ( size_t i = 0; i < _blocks.size(); ++i ) { free( _blocks[i].base ); }
+	_blocks.clear();
+	_allocated = 0;
+    }
+
+    size_t allocated() const { return _allocated; }
+};
+
+//----------------------------------------------------------------------------
+//
+//  Mesh
+//
+
+// The most vertices a Mesh holds; counts stay well inside an int.
+const int MaxMeshVertices = 0x3fffffff;
+
+class Mesh {
+
+    Arena    _arena;
+    vec4*    _points;
+    vec3*    _normals;
+    int      _size;
+    int      _capacity;
+
+   public:
+    Mesh() : _arena( size_t(4) << 20 ), _points(NULL), _normals(NULL), _size(0), _capacity(0) {}
+
+    // Makes room for n vertices.  Growing copies the streams into a new
+    // part of the arena; the old copies are freed with the arena.
+    void reserve( int n ) {
+	if ( n <= _capacity ) { return; }
+	vec4* points = _arena.allocate<vec4>( (size_t) n );
+	vec3* normals = _arena.allocate<vec3>( (size_t) n );
+	if ( _size > 0 ) {
+	    memcpy( points, _points, _size * sizeof(vec4) );
+	    memcpy( normals, _normals, _size * sizeof(vec3) );
+	}
+	_points = points;
+	_normals = normals;
+	_capacity = n;
+    }
+
+    void push_back( const vec3& position, const vec3& normal ) {
+	if ( _size >= _capacity ) {
+	    if ( _capacity >= MaxMeshVertices ) {
+		printf( "Error! A mesh cannot have more than %d vertices\n", MaxMeshVertices );
+		exit( -1 );
+	    }
+	    reserve( _capacity < 1024 ? 1024 : _capacity > MaxMeshVertices / 2 ? MaxMeshVertices : 2 * _capacity );
+	}
+	_points[_size] = vec4( position, 1.0 );
+	_normals[_size] = normal;
+	++_size;
+    }
+
+    // n vertices; new ones are uninitialized.
+    void resize( int n ) {
+	reserve( n );
+	_size = n;
+    }
+
+    // Frees the CPU copies of all streams (after the upload to the GPU).
+    // size() is kept, since it is still needed for drawing.
+    void release() {
+	_arena.release();
+	_points = NULL;
+	_normals = NULL;
+	_capacity = 0;
+    }
+
+    int size() const { return _size; }
+    const vec4* points() const { return _points; }
+    const vec3* normals() const { return _normals; }
+    vec4* points() { return _points; }
+    vec3* normals() { return _normals; }
+
+    // For more per-vertex streams with the same lifetime as the mesh.
+    Arena& arena() { return _arena; }
+};
+
+//----------------------------------------------------------------------------
+//
+//  IndexedMesh
+//
+
+// Post-transform cache behavior of an index buffer, simulated with a FIFO
+// cache: ACMR is the average number of cache misses (vertex shader runs)
+// per triangle, ATVR the same per unique vertex (1.0 is the optimum).
+struct VertexCacheStats {
+    double  acmr;
+    double  atvr;
+};
+
+// A vertex in the compact format of IndexedMesh::pack(), 12 bytes instead
+// of the 28 of a vec4 position and a vec3 normal.  The position is stored
+// as 16-bit integers in [-32767, 32767] that map onto the mesh's bounding
+// box (w is always 1 and not stored); the normal is octahedral-encoded
+// (Cigolle et al. 2014) in two 16-bit integers of the same range.  Both
+// are read as unnormalized GL_SHORT and decoded in the vertex shader.
+struct PackedVertex {
+    GLshort  position[4];     // x, y, z, and padding to 4-byte alignment
+    GLshort  normal[2];
+};
+
+// A run of about a hundred neighboring triangles in an index buffer, with
+// the bounds needed to cull it as a whole: a bounding sphere, and a cone
+// (around cone_axis, of half-angle cone_angle radians) containing all of
+// its face normals; a cone_angle of 90 degrees or more is never culled as
+// back-facing.
+struct Meshlet {
+    int      first_index;
+    int      index_count;
+    vec3     center;
+    GLfloat  radius;
+    vec3     cone_axis;
+    GLfloat  cone_angle;
+};
+
+// The meshlets that CullMeshlets() kept, as the arguments of
+// glMultiDrawElements(); meshlets that are next to each other in the index
+// buffer are merged into one draw.
+struct MeshletDraws {
+    std::vector<GLsizei>        counts;
+    std::vector<const GLvoid*>  offsets;
+    int                         triangles;          // drawn
+    int                         culled_triangles;
+
+    MeshletDraws() : triangles(0), culled_triangles(0) {}
+    GLsizei size() const { return (GLsizei) counts.size(); }
+};
+
+// An IndexedMesh as it goes to the GPU: its vertices in PackedVertex
+// format, its indices and its meshlets, i.e. all that uploading and
+// drawing it take.  "vertices" and "indices" point into memory that is
+// owned elsewhere (the arena of the mesh that pack() made it from, or a
+// mapped MeshCache, see mesh_io.h) and must outlive the upload; the rest
+// stays valid for drawing after that.
+struct PackedMesh {
+    const PackedVertex*   vertices;
+    const void*           indices;        // GLushort or GLuint, see index_type
+    int                   vertex_count;
+    int                   index_count;
+    GLenum                index_type;
+    std::vector<Meshlet>  meshlets;
+
+    PackedMesh() : vertices(NULL), indices(NULL), vertex_count(0), index_count(0),
+	index_type(GL_UNSIGNED_SHORT) {}
+    size_t index_size() const { return index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint); }
+};
+
+// PackedMeshVersion changes whenever build(), build_smooth(), the
+// reorderings, build_meshlets() or pack() give a different PackedMesh for
+// the same input, so that caches of it (see WriteMeshCache()) can be told
+// apart.
+const unsigned PackedMeshVersion = 1;
+
+// How build_smooth() weights the faces around a vertex.
+enum NormalWeight {
+    NormalWeightArea,         // by face area
+    NormalWeightAngle         // by the face's angle at the vertex
+};
+
+class IndexedMesh {
+
+    Arena    _arena;
+    vec4*    _points;
+    vec3*    _normals;
+    void*    _indices;        // GLushort or GLuint, see index_type()
+    int      _vertex_count;
+    int      _index_count;
+    GLenum   _index_type;
+    std::vector<Meshlet>  _meshlets;   // empty unless build_meshlets() was called
+
+    void set_indices( const unsigned* indices );  // from a 32-bit copy
+    static void tipsify( const unsigned* in, int index_count, int vertex_count, int cache_size,
+			 unsigned* out );
+    void allocate( int vertex_count, int index_count );
+
+    IndexedMesh( const IndexedMesh& );           // not copyable
+    IndexedMesh& operator = ( const IndexedMesh& );
+
+   public:
+    IndexedMesh() : _arena( size_t(4) << 20 ), _points(NULL), _normals(NULL), _indices(NULL),
+	_vertex_count(0), _index_count(0), _index_type(GL_UNSIGNED_SHORT) {}
+
+    // Welds the "count" vertices of a triangle list: vertices with equal
+    // position (and, if "weld_normals", equal normal) become one, found with
+    // a hash table in O(count).  Welding on positions only is for streams
+    // whose normals are not used, e.g. the shadow.  Indices are 16-bit if
+    // there are at most 65536 unique vertices.  "normals" may be NULL if
+    // weld_normals is false; the normals are zero then.
+    void build( const vec4* points, const vec3* normals, int count, bool weld_normals = true );
+
+    // The same from an indexed triangle list (e.g. an ImportedMesh, see
+    // mesh_io.h): only the "vertex_count" points are welded on position,
+    // and the indices remapped, without unrolling the triangles first.
+    // The normals are zero.
+    void build( const vec4* points, int vertex_count, const unsigned* indices, int index_count );
+
+    // Builds the mesh from a triangle list with smooth normals instead:
+    // shared positions are welded, and each corner gets the weighted
+    // average of the unit normals of the faces around its vertex that are
+    // within "crease_angle" degrees of its own face.  Corners that end up
+    // with the same normal are welded, so at 180 degrees every position
+    // is one vertex, while edges sharper than the crease angle stay hard.
+    // Runs on "pool" if one is given.
+    void build_smooth( const vec4* points, int count, GLfloat crease_angle = 180.0,
+		       NormalWeight weight = NormalWeightAngle, ThreadPool* pool = NULL );
+
+    // The same from a mesh that is already welded on position (e.g. one
+    // built with weld_normals false); its normals are ignored.
+    void build_smooth( const IndexedMesh& welded, GLfloat crease_angle = 180.0,
+		       NormalWeight weight = NormalWeightAngle, ThreadPool* pool = NULL );
+
+    // A unit icosphere: the icosahedron with every triangle split into 4
+    // "subdivisions" times (20 * 4^subdivisions triangles), with exact
+    // normals.  Every vertex is shared by all of its triangles.
+    void build_icosphere( int subdivisions );
+
+    // Appends the triangles to "mesh" with flat normals, as a polygon file
+    // would give them: normalize((b - a) x (c - b)); zero if degenerate.
+    void unroll( Mesh& mesh ) const;
+
+    // Reorderings, meant to be applied in this order after build() and
+    // before other per-vertex streams are created:
+    //
+    //   optimize_vertex_cache()  orders the triangles for a post-transform
+    //                            cache of "cache_size" entries (Tipsify,
+    //                            Sander et al. 2007), in linear time.
+    //   optimize_overdraw()      splits that order into clusters where the
+    //                            cache starts over and sorts the clusters so
+    //                            that outward-facing ones come first; kept
+    //                            only if ACMR grows by at most "threshold".
+    //   optimize_vertex_fetch()  renumbers the vertices in the order the
+    //                            indices first use them.
+    void optimize_vertex_cache( int cache_size = 16 );
+    void optimize_overdraw( int cache_size = 16, double threshold = 1.05 );
+    void optimize_vertex_fetch();
+
+    // Reorders the triangles into meshlets of at most "max_triangles"
+    // triangles that are close together and face about the same way, and
+    // computes their bounds.  Meant to come after optimize_overdraw(), whose
+    // order it roughly keeps, and before optimize_vertex_fetch(), which
+    // keeps the meshlets; the triangles of each meshlet are reordered for
+    // a cache of "cache_size" entries.
+    void build_meshlets( int max_triangles = 128, int cache_size = 16 );
+    const std::vector<Meshlet>& meshlets() const { return _meshlets; }
+
+    VertexCacheStats analyze_vertex_cache( int cache_size = 16 ) const;
+
+    // The bounding box that pack() quantizes positions within, as
+    // position = bias + scale * p for the stored integers p.  Meshes that
+    // are drawn with the same uniforms (e.g. a mesh and its shadow) can
+    // share one box; it must contain all of their positions.
+    void packed_bounds( vec3& scale, vec3& bias ) const;
+
+    // Writes the vertex_count() vertices in PackedVertex format to "out".
+    void pack( PackedVertex* out, const vec3& scale, const vec3& bias ) const;
+
+    // The same into "out", with the vertices allocated from arena() and the
+    // indices and meshlets as they are, so that they stay until release().
+    void pack( PackedMesh& out, const vec3& scale, const vec3& bias );
+
+    // Frees the CPU copies; the counts, index type and meshlets stay valid
+    // for drawing.
+    void release() {
+	_arena.release();
+	_points = NULL;
+	_normals = NULL;
+	_indices = NULL;
+    }
+
+    int vertex_count() const { return _vertex_count; }
+    int index_count() const { return _index_count; }
+    GLenum index_type() const { return _index_type; }
+    size_t index_size() const { return _index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint); }
+
+    const vec4* points() const { return _points; }
+    const vec3* normals() const { return _normals; }
+    const void* indices() const { return _indices; }
+    unsigned index( int i ) const {
+	return _index_type == GL_UNSIGNED_SHORT ? static_cast<const GLushort*>( _indices )[i]
+						: static_cast<const GLuint*>( _indices )[i];
+    }
+
+    Arena& arena() { return _arena; }
+};
+
+//----------------------------------------------------------------------------
+//
+//  Simplification
+//
+
+// Simplifies a triangle list of "count" vertices to at most about
+// "target_triangles" triangles by quadric-error edge collapse (Garland and
+// Heckbert 1997) on its welded positions, and writes the result to "out"
+// as a triangle list with flat normals, like a loaded polygon file.
+// Collapses that would flip a triangle or make the mesh non-manifold are
+// skipped, so the target may not be reached.  Runs on "pool" if one is
+// given (see mesh_simplify.cpp).  Returns the error bound: the square
+// root of the largest quadric error of a collapse, i.e. of the sum of the
+// squared distances to the original planes around it.
+//
+// SimplifyMeshVersion changes whenever the output for the same input
+// does, so that caches of it (see WriteMeshCache()) can be told apart.
+const unsigned SimplifyMeshVersion = 1;
+GLfloat SimplifyMesh( const vec4* points, int count, int target_triangles, Mesh& out, ThreadPool* pool = NULL );
+
+//----------------------------------------------------------------------------
+//
+//  Meshlet culling
+//
+
+// Fills "draws" with the meshlets of a mesh that may be visible: those
+// whose bounding sphere is not outside the frustum of "mvp" (projection *
+// model-view), and, if "cull_backfaces", that do not face away from
+// "eye", the eye position in the mesh's own coordinates.  Back-face
+// culling assumes a closed mesh drawn filled, with outward normals.
+// "index_size" is the size of one index, for the byte offsets.
+void CullMeshlets( const std::vector<Meshlet>& meshlets, size_t index_size, const mat4& mvp, const vec3& eye,
+		   bool cull_backfaces, MeshletDraws& draws );
+
+}  // namespace Angel
+
+#endif // __ANGEL_MESH_H__
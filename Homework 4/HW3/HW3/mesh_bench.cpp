@@ -0,0 +1,902 @@
+/************************************************************
+ * mesh_bench.cpp: benchmark for the polygon-file loader in "mesh_io.h".
+ *
+ * Needs no GL context or window. Not part of the HW4 project (it has its
+ * own main()). Build e.g. with
+ *
+ *   g++ -O2 -std=c++11 -pthread mesh_bench.cpp mesh_io.cpp mesh.cpp mesh_optimize.cpp mesh_normals.cpp \
+ *       mesh_sphere.cpp mesh_pack.cpp mesh_meshlets.cpp mesh_simplify.cpp -o mesh_bench
+ *
+ * Usage: mesh_bench [MB]   (size of the synthetic file, default 100;
+ *                           e.g. 4096 for the multi-GB case)
+ *
+ * Checks that the parser agrees with the original ifstream loop on the
+ * sphere.* files, and with strtof() on random numbers, then writes a synthetic polygon file of about MB
+ * megabytes to the temporary directory and times both loaders on it
+ * (the Mesh loader also on all cores, checked against the serial result),
+ * and the level built from it against the same level mapped from the
+ * binary mesh cache, and the OBJ/PLY/STL importers.  Also reports how far
+ * IndexedMesh::build() welds each mesh, and the post-transform cache
+ * statistics (ACMR/ATVR) before and after the IndexedMesh optimizations.
+ * Smooth normals must point away from the sphere's center, and meshlet
+ * culling must be conservative.  Finally times and checks the generated
+ * icosphere LOD chain, the simplified levels made from its finest level,
+ * and the error of the packed vertex format.
+ ************************************************************/
+
+#include "Angel-yjc.h"
+#include "mesh_io.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// Keeps the optimizer from discarding the benchmarked results.
+static volatile double sink;
+
+//----------------------------------------------------------------------------
+// The original readFile() loop, kept here as the reference.
+
+static bool reference_load( const char* path, std::vector<vec3>& positions, std::vector<vec3>& normals )
+{
+	std::ifstream ifs(path);
+	if (!ifs) return false;
+	int numPolygons;
+	int numVertices;
+	ifs >> numPolygons;
+	for (int i = 0; i < numPolygons; i++) {
+		ifs >> numVertices;
+		vec3 vertices[3];
+
+		for (int j = 0; j < numVertices; j++) {
+			ifs >> vertices[j][0] >> vertices[j][1] >> vertices[j][2];
+		}
+
+		vec4 u = vertices[1] - vertices[0];
+		vec4 v = vertices[2] - vertices[1];
+		vec3 normal = normalize(cross(u, v));
+
+		for (int j = 0; j < numVertices; j++) {
+			positions.push_back(vertices[j]);
+			normals.push_back(normal);
+		}
+	}
+	return (bool) ifs;
+}
+
+//----------------------------------------------------------------------------
+
+// "%f" of a number in (-10, 10), without the cost of printf.
+static char* format_coordinate( char* out, double v )
+{
+	if (v < 0) { *out++ = '-';  v = -v; }
+	long fixed = (long) (v * 1e6 + 0.5);
+	*out++ = (char) ('0' + fixed / 1000000);
+	*out++ = '.';
+	for (long div = 100000; div > 0; div /= 10)
+		*out++ = (char) ('0' + fixed / div % 10);
+	return out;
+}
+
+// Writes random triangles in the sphere.* format until about "bytes"
+// bytes, fast enough for multi-GB files (it is limited by the disk).
+static void write_synthetic( const char* path, size_t bytes )
+{
+	// one triangle is "3\n" + 3 lines of "%f %f %f\n", about 80 bytes
+	long numPolygons = (long) (bytes / 80);
+	FILE* f = fopen(path, "wb");
+	if (f == NULL) {
+		printf("Error! Cannot write %s\n", path);
+		exit(1);
+	}
+	fprintf(f, "%ld\n", numPolygons);
+	std::vector<char> buffer(1 << 20);
+	char* out = &buffer[0];
+	unsigned state = 12345;
+	for (long i = 0; i < numPolygons; i++) {
+		if (out - &buffer[0] > (long) buffer.size() - 256) {
+			fwrite(&buffer[0], 1, out - &buffer[0], f);
+			out = &buffer[0];
+		}
+		*out++ = '3';  *out++ = '\n';
+		for (int j = 0; j < 9; j++) {
+			state = state * 1664525u + 1013904223u;    // LCG, as rand() is slow on some systems
+			out = format_coordinate(out, (state >> 8) / 8388608.0 - 1.0);
+			*out++ = j % 3 == 2 ? '\n' : ' ';
+		}
+	}
+	fwrite(&buffer[0], 1, out - &buffer[0], f);
+	if (fclose(f) != 0) {
+		printf("Error! Cannot write %s (disk full?)\n", path);
+		exit(1);
+	}
+}
+
+// A random decimal number of 1 to 12 significant digits, sometimes with a
+// sign, a decimal point and an exponent, as text.  Every fourth one is
+// instead just above the midpoint of two floats in [1, 2): the nearest
+// double is the midpoint itself, so converting through a double rounds
+// it down (to even) half of the time, where strtof() rounds up.
+static std::string random_number()
+{
+	if (rand() % 4 == 0) {
+		double midpoint = 1.0 + (rand() % (1 << 23) + 0.5) / (1 << 23);
+		char m[64];
+		sprintf(m, "%.24f", midpoint);    // exact: 24 binary digits after the point
+		return std::string(m) + "000001";
+	}
+	std::string t;
+	if (rand() % 2) t += rand() % 4 ? '-' : '+';
+	int digits = 1 + rand() % 12;
+	int point = rand() % 3 ? rand() % (digits + 1) : -1;
+	for (int i = 0; i < digits; i++) {
+		if (i == point) t += '.';
+		t += (char) ('0' + rand() % 10);
+	}
+	if (rand() % 3 == 0) {
+		char e[16];
+		sprintf(e, "e%d", rand() % 61 - 30);
+		t += e;
+	}
+	return t;
+}
+
+// Parses "count" random numbers, as the coordinates of triangles, and
+// compares them with what strtof() makes of the same text.
+static bool parse_matches_strtof( int count )
+{
+	std::vector<std::string> numbers;
+	std::string text;
+	char line[32];
+	sprintf(line, "%d\n", count / 9);
+	text += line;
+	for (int i = 0; i < count / 9 * 9; i++) {
+		if (i % 9 == 0) text += "3\n";
+		numbers.push_back(random_number());
+		text += numbers.back();
+		text += i % 3 == 2 ? "\n" : " ";
+	}
+	std::vector<vec3> p, n;
+	MeshParseError err;
+	if (!ParsePolygonFile(text.data(), text.size(), p, n, err)) {
+		printf("Error! random numbers: %d:%d: %s\n", err.line, err.column, err.message);
+		return false;
+	}
+	for (size_t i = 0; i < numbers.size(); i++) {
+		float parsed = p[i / 3][(int) (i % 3)];
+		float expected = strtof(numbers[i].c_str(), NULL);
+		if (memcmp(&parsed, &expected, sizeof(float)) != 0) {
+			printf("Error! %s parses as %.9g, strtof() gives %.9g\n", numbers[i].c_str(), parsed, expected);
+			return false;
+		}
+	}
+	return true;
+}
+
+static double file_mb( const char* path )
+{
+	MappedFile file;
+	return file.open(path) ? file.size() / (1024.0 * 1024.0) : 0.0;
+}
+
+static bool same( const std::vector<vec3>& a, const std::vector<vec3>& b )
+{
+	if (a.size() != b.size()) return false;
+	for (size_t i = 0; i < a.size(); i++)
+		if (a[i].x != b[i].x || a[i].y != b[i].y || a[i].z != b[i].z)
+			return false;
+	return true;
+}
+
+template <class Index>
+static bool same_indexed( const Mesh& mesh, const IndexedMesh& indexed, bool normals )
+{
+	const Index* indices = static_cast<const Index*>(indexed.indices());
+	for (int i = 0; i < mesh.size(); i++) {
+		const vec4& p = indexed.points()[indices[i]];
+		const vec3& n = indexed.normals()[indices[i]];
+		if (p.x != mesh.points()[i].x || p.y != mesh.points()[i].y || p.z != mesh.points()[i].z)
+			return false;
+		if (normals && (n.x != mesh.normals()[i].x || n.y != mesh.normals()[i].y || n.z != mesh.normals()[i].z))
+			return false;
+	}
+	return true;
+}
+
+static bool same_triangles( const Mesh& mesh, const IndexedMesh& indexed, bool normals )
+{
+	if (indexed.index_count() != mesh.size()) return false;
+	return indexed.index_type() == GL_UNSIGNED_SHORT ? same_indexed<GLushort>(mesh, indexed, normals)
+							 : same_indexed<GLuint>(mesh, indexed, normals);
+}
+
+// Vertex memory before and after, counting the index buffer.
+static void print_weld( const char* what, const Mesh& mesh, const IndexedMesh& indexed )
+{
+	double before = mesh.size() * (sizeof(vec4) + sizeof(vec3));
+	double after = indexed.vertex_count() * (sizeof(vec4) + sizeof(vec3)) +
+		indexed.index_count() * indexed.index_size();
+	printf("%-22s %8d unique vertices (%d-bit indices), %.1fx fewer vertices, %.1fx less memory\n",
+		what, indexed.vertex_count(), (int) indexed.index_size() * 8,
+		(double) mesh.size() / indexed.vertex_count(), before / after);
+}
+
+// Writers for the importer checks.  Floats are written with 9 digits, so
+// that they read back exactly; binary data assumes a little-endian host.
+static void put( FILE* f, const void* v, size_t n, bool big_endian )
+{
+	const unsigned char* b = static_cast<const unsigned char*>(v);
+	for (size_t i = 0; i < n; i++)
+		fputc(b[big_endian ? n - 1 - i : i], f);
+}
+
+// Faces in all index forms: "v", "v/vt/vn", "v//vn" and negative.
+static void write_obj( const char* path, const IndexedMesh& mesh )
+{
+	FILE* f = fopen(path, "w");
+	fprintf(f, "# icosphere\no sphere\n");
+	for (int v = 0; v < mesh.vertex_count(); v++)
+		fprintf(f, "v %.9g %.9g %.9g\n", mesh.points()[v].x, mesh.points()[v].y, mesh.points()[v].z);
+	fprintf(f, "vn 0 0 1\nvt 0 0\n");
+	for (int t = 0; t < mesh.index_count() / 3; t++) {
+		unsigned a = mesh.index(3 * t) + 1, b = mesh.index(3 * t + 1) + 1, c = mesh.index(3 * t + 2) + 1;
+		if (t % 3 == 0)
+			fprintf(f, "f %u %u %u\n", a, b, c);
+		else if (t % 3 == 1)
+			fprintf(f, "f %u/1/1 %u//1 %u/1\n", a, b, c);
+		else
+			fprintf(f, "f %d %d %d\r\n", (int) (a - 1) - mesh.vertex_count(), (int) (b - 1) - mesh.vertex_count(),
+				(int) (c - 1) - mesh.vertex_count());
+	}
+	fclose(f);
+}
+
+// With properties and an element that the importer must skip.
+static void write_ply( const char* path, const IndexedMesh& mesh, bool big_endian )
+{
+	FILE* f = fopen(path, "wb");
+	fprintf(f, "ply\nformat %s 1.0\ncomment icosphere\n", big_endian ? "binary_big_endian" : "binary_little_endian");
+	fprintf(f, "element vertex %d\nproperty float x\nproperty float y\nproperty float z\n", mesh.vertex_count());
+	fprintf(f, "property float nx\nproperty uchar red\n");
+	fprintf(f, "element face %d\nproperty list uchar int vertex_indices\n", mesh.index_count() / 3);
+	fprintf(f, "element material 1\nproperty list ushort double weights\nend_header\n");
+	for (int v = 0; v < mesh.vertex_count(); v++) {
+		for (int k = 0; k < 3; k++) {
+			GLfloat x = mesh.points()[v][k];
+			put(f, &x, sizeof(GLfloat), big_endian);
+		}
+		put(f, &mesh.normals()[v].x, sizeof(GLfloat), big_endian);
+		fputc(255, f);
+	}
+	for (int t = 0; t < mesh.index_count() / 3; t++) {
+		fputc(3, f);
+		for (int k = 0; k < 3; k++) {
+			int i = (int) mesh.index(3 * t + k);
+			put(f, &i, sizeof(int), big_endian);
+		}
+	}
+	unsigned short n = 2;
+	double w[2] = { 0.5, 0.25 };
+	put(f, &n, 2, big_endian);
+	put(f, &w[0], 8, big_endian);
+	put(f, &w[1], 8, big_endian);
+	fclose(f);
+}
+
+static void write_stl( const char* path, const Mesh& mesh )
+{
+	FILE* f = fopen(path, "wb");
+	char header[80] = "binary icosphere";
+	fwrite(header, 1, 80, f);
+	unsigned count = mesh.size() / 3;
+	put(f, &count, 4, false);
+	for (int i = 0; i < mesh.size(); i += 3) {
+		put(f, &mesh.normals()[i], 12, false);
+		for (int k = 0; k < 3; k++)
+			put(f, &mesh.points()[i + k], 12, false);
+		fputc(0, f);  fputc(0, f);
+	}
+	fclose(f);
+}
+
+// Runs the three optimizations, checking that the set of triangles stays
+// the same (compared as sorted position triples).
+static void triangle_keys( const Mesh& mesh, std::vector<std::vector<GLfloat> >& keys )
+{
+	keys.clear();
+	for (int t = 0; t < mesh.size() / 3; t++) {
+		std::vector<vec4> tri(mesh.points() + 3 * t, mesh.points() + 3 * t + 3);
+		// rotate so that the smallest vertex comes first, keeping the winding
+		int m = 0;
+		for (int k = 1; k < 3; k++)
+			if (memcmp(&tri[k], &tri[m], sizeof(vec4)) < 0) m = k;
+		std::vector<GLfloat> key;
+		for (int k = 0; k < 3; k++) {
+			const vec4& p = tri[(m + k) % 3];
+			key.push_back(p.x);  key.push_back(p.y);  key.push_back(p.z);
+		}
+		keys.push_back(key);
+	}
+	std::sort(keys.begin(), keys.end());
+}
+
+static bool print_optimized( const Mesh& mesh, IndexedMesh& indexed )
+{
+	VertexCacheStats before = indexed.analyze_vertex_cache();
+	Clock::time_point t0 = Clock::now();
+	indexed.optimize_vertex_cache();
+	VertexCacheStats tipsify = indexed.analyze_vertex_cache();
+	indexed.optimize_overdraw();
+	VertexCacheStats overdraw = indexed.analyze_vertex_cache();
+	indexed.build_meshlets();
+	VertexCacheStats meshlets = indexed.analyze_vertex_cache();
+	indexed.optimize_vertex_fetch();
+	Clock::time_point t1 = Clock::now();
+	VertexCacheStats after = indexed.analyze_vertex_cache();
+	printf("  ACMR %.3f -> %.3f (cache) -> %.3f (overdraw) -> %.3f (%d meshlets) -> %.3f (fetch), "
+		"ATVR %.3f -> %.3f, %.2f ms\n", before.acmr, tipsify.acmr, overdraw.acmr, meshlets.acmr,
+		(int) indexed.meshlets().size(), after.acmr, before.atvr, after.atvr,
+		std::chrono::duration<double>(t1 - t0).count() * 1e3);
+
+	Mesh unrolled;
+	for (int i = 0; i < indexed.index_count(); i++) {
+		const vec4& p = indexed.points()[indexed.index(i)];
+		unrolled.push_back(vec3(p.x, p.y, p.z), indexed.normals()[indexed.index(i)]);
+	}
+	std::vector<std::vector<GLfloat> > a, b;
+	triangle_keys(mesh, a);
+	triangle_keys(unrolled, b);
+	return a == b;
+}
+
+// Culls the meshlets of "indexed" (a closed mesh around the origin) as
+// seen from "eye", and checks that every triangle of the culled ones is
+// back-facing or entirely outside one frustum plane.  Returns the
+// fraction of the triangles culled, or -1 on failure.
+static double check_culling( const IndexedMesh& indexed, const vec4& eye )
+{
+	mat4 mvp = Perspective(45.0, 1.0, 0.5, 18.0) * LookAt(eye, vec4(0.0, 0.0, 0.0, 1.0), vec4(0.0, 1.0, 0.0, 0.0));
+	MeshletDraws draws;
+	CullMeshlets(indexed.meshlets(), indexed.index_size(), mvp, vec3(eye.x, eye.y, eye.z), true, draws);
+
+	std::vector<char> drawn(indexed.index_count(), 0);
+	for (int d = 0; d < draws.size(); d++) {
+		int first = (int) ((size_t) draws.offsets[d] / indexed.index_size());
+		memset(&drawn[first], 1, draws.counts[d]);
+	}
+	for (int i = 0; i < indexed.index_count(); i += 3) {
+		if (drawn[i])
+			continue;
+		vec3 c[3];
+		for (int k = 0; k < 3; k++) {
+			const vec4& p = indexed.points()[indexed.index(i + k)];
+			c[k] = vec3(p.x, p.y, p.z);
+		}
+		vec3 n = cross(c[1] - c[0], c[2] - c[1]);
+		bool back = dot(c[0] - vec3(eye.x, eye.y, eye.z), n) >= 0.0;
+		bool outside = false;
+		for (int plane = 0; plane < 6 && !outside; plane++) {
+			vec4 row = plane % 2 == 0 ? mvp[3] + mvp[plane / 2] : mvp[3] - mvp[plane / 2];
+			outside = true;
+			for (int k = 0; k < 3; k++)
+				outside = outside && row.x * c[k].x + row.y * c[k].y + row.z * c[k].z + row.w < 0.0;
+		}
+		if (!back && !outside)
+			return -1.0;
+	}
+	return draws.culled_triangles / (double) (draws.triangles + draws.culled_triangles);
+}
+
+// Builds a level of detail the way rolling_sphere does: flat, smooth (at
+// 60 degrees) and shadow meshes, optimized, with meshlets, and packed.
+static void build_level( const Mesh& mesh, IndexedMesh built[3], PackedMesh packed[3], vec3& scale, vec3& bias,
+			 ThreadPool& pool )
+{
+	built[0].build(mesh.points(), mesh.normals(), mesh.size(), true);
+	built[2].build(mesh.points(), mesh.normals(), mesh.size(), false);
+	built[1].build_smooth(built[2], 60.0, NormalWeightAngle, &pool);
+	for (int m = 0; m < 3; m++) {
+		built[m].optimize_vertex_cache();
+		built[m].optimize_overdraw();
+		if (built[m].index_count() / 3 >= 2048)
+			built[m].build_meshlets();
+		built[m].optimize_vertex_fetch();
+	}
+	built[0].packed_bounds(scale, bias);
+	for (int m = 0; m < 3; m++)
+		built[m].pack(packed[m], scale, bias);
+}
+
+static bool same_packed( const PackedMesh& a, const PackedMesh& b )
+{
+	return a.vertex_count == b.vertex_count && a.index_count == b.index_count && a.index_type == b.index_type &&
+		a.meshlets.size() == b.meshlets.size() &&
+		memcmp(a.vertices, b.vertices, a.vertex_count * sizeof(PackedVertex)) == 0 &&
+		memcmp(a.indices, b.indices, a.index_count * a.index_size()) == 0 &&
+		(a.meshlets.empty() || memcmp(&a.meshlets[0], &b.meshlets[0], a.meshlets.size() * sizeof(Meshlet)) == 0);
+}
+
+int main( int argc, char** argv )
+{
+	int mb = argc > 1 ? atoi(argv[1]) : 100;
+
+	/*--- correctness on the course spheres and on error input ---*/
+	const char* spheres[] = { "sphere.8", "sphere.128", "sphere.256", "sphere.1024" };
+	for (int i = 0; i < 4; i++) {
+		std::vector<vec3> p0, n0, p1, n1;
+		MeshParseError err;
+		if (!reference_load(spheres[i], p0, n0)) {
+			printf("(skipping %s: not found)\n", spheres[i]);
+			continue;
+		}
+		if (!LoadPolygonFile(spheres[i], p1, n1, err)) {
+			printf("Error! %s:%d:%d: %s\n", spheres[i], err.line, err.column, err.message);
+			return 1;
+		}
+		if (!same(p0, p1) || !same(n0, n1)) {
+			printf("Error! %s parses differently from the ifstream loop\n", spheres[i]);
+			return 1;
+		}
+		Mesh mesh;
+		if (!LoadPolygonFile(spheres[i], mesh, err) || mesh.size() != (int) p1.size() ||
+		    memcmp(mesh.normals(), &n1[0], n1.size() * sizeof(vec3)) != 0) {
+			printf("Error! %s loads differently into a Mesh\n", spheres[i]);
+			return 1;
+		}
+		for (int j = 0; j < mesh.size(); j++)
+			if (mesh.points()[j].x != p1[j].x || mesh.points()[j].w != 1.0f) {
+				printf("Error! %s loads differently into a Mesh\n", spheres[i]);
+				return 1;
+			}
+		printf("%-12s %6d vertices, identical to the ifstream loop\n", spheres[i], (int) p1.size());
+
+		// Welding must reproduce every triangle exactly.
+		IndexedMesh indexed, by_position;
+		indexed.build(mesh.points(), mesh.normals(), mesh.size(), true);
+		by_position.build(mesh.points(), mesh.normals(), mesh.size(), false);
+		if (!same_triangles(mesh, indexed, true) || !same_triangles(mesh, by_position, false)) {
+			printf("Error! %s: the indexed mesh has different triangles\n", spheres[i]);
+			return 1;
+		}
+		print_weld("  welded", mesh, indexed);
+		print_weld("  welded on position", mesh, by_position);
+		IndexedMesh smooth;
+		smooth.build_smooth(mesh.points(), mesh.size());
+		double worst = 0.0;
+		for (int v = 0; v < smooth.vertex_count(); v++) {
+			const vec4& p = smooth.points()[v];
+			double c = dot(normalize(vec3(p.x, p.y, p.z)), smooth.normals()[v]);
+			worst = std::max(worst, acos(std::min(c, 1.0)) / DegreesToRadians);
+		}
+		printf("  smooth normals       %8d vertices, at most %.2f degrees from the radial direction\n",
+			smooth.vertex_count(), worst);
+		if (smooth.vertex_count() != by_position.vertex_count() || worst > 5.0) {
+			printf("Error! %s: smooth normals are not smooth\n", spheres[i]);
+			return 1;
+		}
+		if (!print_optimized(mesh, by_position)) {
+			printf("Error! %s: the optimized mesh has different triangles\n", spheres[i]);
+			return 1;
+		}
+		double far_culled = check_culling(by_position, vec4(7.0, 3.0, -10.0, 1.0));
+		double near_culled = check_culling(by_position, vec4(0.0, 0.5, 1.6, 1.0));
+		if (far_culled < 0.0 || near_culled < 0.0) {
+			printf("Error! %s: a visible meshlet is culled\n", spheres[i]);
+			return 1;
+		}
+		printf("  meshlet culling      %4.1f%% of the triangles skipped from afar, %4.1f%% up close\n",
+			far_culled * 100.0, near_culled * 100.0);
+	}
+
+	const char* bad = "2\n3\n0 0 0\n1 0 0\n0 1 0\n3\n0 0 0\n1 x 0\n";
+	std::vector<vec3> p, n;
+	MeshParseError err;
+	if (ParsePolygonFile(bad, strlen(bad), p, n, err) || err.line != 8 || err.column != 3) {
+		printf("Error! bad input not reported at line 8, column 3\n");
+		return 1;
+	}
+	printf("error report: line %d, column %d: %s\n", err.line, err.column, err.message);
+
+	if (!parse_matches_strtof(900000))
+		return 1;
+	printf("900000 random numbers parse as strtof() parses them\n\n");
+
+	/*--- throughput on a large synthetic file ---*/
+	const char* tmp = getenv("TMPDIR");
+	std::string path = std::string(tmp ? tmp : "/tmp") + "/mesh_bench_polygons.txt";
+	write_synthetic(path.c_str(), (size_t) mb * 1024 * 1024);
+	double size = file_mb(path.c_str());
+
+	std::vector<vec3> p0, n0, p1, n1;
+	Clock::time_point t0 = Clock::now();
+	reference_load(path.c_str(), p0, n0);
+	Clock::time_point t1 = Clock::now();
+	double ref = std::chrono::duration<double>(t1 - t0).count();
+
+	// best of 3: the first run also pays for page faults
+	double best = 1e30;
+	for (int r = 0; r < 3; r++) {
+		p1.clear();  n1.clear();
+		t0 = Clock::now();
+		if (!LoadPolygonFile(path.c_str(), p1, n1, err)) {
+			printf("Error! %s:%d:%d: %s\n", path.c_str(), err.line, err.column, err.message);
+			return 1;
+		}
+		t1 = Clock::now();
+		best = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+	}
+
+	Mesh mesh;
+	t0 = Clock::now();
+	LoadPolygonFile(path.c_str(), mesh, err);
+	t1 = Clock::now();
+	double into_mesh = std::chrono::duration<double>(t1 - t0).count();
+
+	// The chunked parser, with at least 4 threads so that it is also
+	// exercised on small machines.
+	ThreadPool pool(std::max(4, (int) std::thread::hardware_concurrency()));
+	double parallel = 1e30;
+	for (int r = 0; r < 3; r++) {
+		Mesh chunked;
+		t0 = Clock::now();
+		if (!LoadPolygonFile(path.c_str(), chunked, err, &pool)) {
+			printf("Error! %s:%d:%d: %s\n", path.c_str(), err.line, err.column, err.message);
+			return 1;
+		}
+		t1 = Clock::now();
+		parallel = std::min(parallel, std::chrono::duration<double>(t1 - t0).count());
+		if (r == 0 && (chunked.size() != mesh.size() ||
+			       memcmp(chunked.points(), mesh.points(), mesh.size() * sizeof(vec4)) != 0 ||
+			       memcmp(chunked.normals(), mesh.normals(), mesh.size() * sizeof(vec3)) != 0)) {
+			printf("Error! The chunked parser gives a different mesh\n");
+			return 1;
+		}
+	}
+
+	printf("%.0f MB, %d triangles\n", size, (int) (p1.size() / 3));
+	printf("ifstream >>        %7.3f s  %8.1f MB/s\n", ref, size / ref);
+	printf("LoadPolygonFile    %7.3f s  %8.1f MB/s   speedup %.1fx\n", best, size / best, ref / best);
+	printf("  ... into a Mesh  %7.3f s  %8.1f MB/s   (%d vertices, %.0f MB of arena)\n", into_mesh,
+		size / into_mesh, mesh.size(), mesh.arena().allocated() / (1024.0 * 1024.0));
+	printf("  ... %2d threads   %7.3f s  %8.1f MB/s   speedup %.1fx over one thread, identical result\n",
+		pool.size(), parallel, size / parallel, into_mesh / parallel);
+	IndexedMesh indexed;
+	t0 = Clock::now();
+	indexed.build(mesh.points(), mesh.normals(), mesh.size(), false);
+	t1 = Clock::now();
+	printf("IndexedMesh::build %7.3f s  %8.1f M vertices/s\n", std::chrono::duration<double>(t1 - t0).count(),
+		mesh.size() / 1e6 / std::chrono::duration<double>(t1 - t0).count());
+	for (int r = 0; r < 2; r++) {
+		IndexedMesh smooth;
+		t0 = Clock::now();
+		smooth.build_smooth(mesh.points(), mesh.size(), 60.0, NormalWeightAngle, r == 0 ? NULL : &pool);
+		t1 = Clock::now();
+		printf("  ... smooth (%2d threads) %5.3f s  %8.1f M vertices/s\n", r == 0 ? 1 : pool.size(),
+			std::chrono::duration<double>(t1 - t0).count(),
+			mesh.size() / 1e6 / std::chrono::duration<double>(t1 - t0).count());
+	}
+	t0 = Clock::now();
+	indexed.optimize_vertex_cache();
+	indexed.optimize_overdraw();
+	indexed.optimize_vertex_fetch();
+	t1 = Clock::now();
+	printf("  ... optimized    %7.3f s  %8.1f M triangles/s\n", std::chrono::duration<double>(t1 - t0).count(),
+		indexed.index_count() / 3e6 / std::chrono::duration<double>(t1 - t0).count());
+	if (!same(p0, p1))
+		printf("(note: results differ from ifstream in the last bit for some numbers)\n");
+
+	/*--- binary mesh cache ---*/
+	// A level built from the parsed file, against the same level mapped
+	// from its cache.
+	IndexedMesh level[3];
+	PackedMesh level_packed[3];
+	vec3 level_scale, level_bias;
+	t0 = Clock::now();
+	build_level(mesh, level, level_packed, level_scale, level_bias, pool);
+	t1 = Clock::now();
+	double build = std::chrono::duration<double>(t1 - t0).count();
+	printf("level build        %7.3f s  (weld, smooth, optimize, meshlets, pack)\n", build);
+
+	std::string cache_path = MeshCachePath(path.c_str());
+	GLfloat crease_angle = 60.0;
+	uint64_t key = MeshCacheKey(&PackedMeshVersion, sizeof(PackedMeshVersion));
+	key = MeshCacheKey(&crease_angle, sizeof(crease_angle), key);
+	t0 = Clock::now();
+	bool written = WriteMeshCache(cache_path.c_str(), path.c_str(), level_packed, 3, level_scale, level_bias, key);
+	t1 = Clock::now();
+	if (!written) {
+		printf("Error! Cannot write %s\n", cache_path.c_str());
+		return 1;
+	}
+	printf("WriteMeshCache     %7.3f s  %8.1f MB\n", std::chrono::duration<double>(t1 - t0).count(),
+		file_mb(cache_path.c_str()));
+
+	double parse = best;
+	best = 1e30;
+	double sum = 0.0;
+	for (int r = 0; r < 3; r++) {
+		MeshCache cache;
+		t0 = Clock::now();
+		if (!cache.open(cache_path.c_str(), path.c_str(), key) || cache.mesh_count() != 3) {
+			printf("Error! The mesh cache just written is not accepted\n");
+			return 1;
+		}
+		// touch every page of the vertices and indices, as glBufferSubData() would
+		for (int m = 0; m < 3; m++) {
+			const PackedMesh& cached = cache.mesh(m);
+			for (int i = 0; i < cached.vertex_count; i += 512)
+				sum += cached.vertices[i].position[0];
+			for (size_t i = 0; i < cached.index_count * cached.index_size(); i += 4096)
+				sum += static_cast<const char*>(cached.indices)[i];
+		}
+		t1 = Clock::now();
+		best = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+		if (r == 0) {
+			bool same_level = memcmp(&cache.position_scale(), &level_scale, sizeof(vec3)) == 0 &&
+				memcmp(&cache.position_bias(), &level_bias, sizeof(vec3)) == 0;
+			for (int m = 0; m < 3; m++)
+				same_level = same_level && same_packed(cache.mesh(m), level_packed[m]);
+			if (!same_level) {
+				printf("Error! The mesh cache does not read back what was written\n");
+				return 1;
+			}
+		}
+	}
+	sink = sum;
+	printf("MeshCache::open    %7.3f s  (with checksum)   %.0fx faster than LoadPolygonFile and the level build\n",
+		best, (parse + build) / best);
+
+	// So must one made with another crease angle (or version).
+	MeshCache other;
+	GLfloat other_angle = 45.0;
+	uint64_t other_key = MeshCacheKey(&PackedMeshVersion, sizeof(PackedMeshVersion));
+	other_key = MeshCacheKey(&other_angle, sizeof(other_angle), other_key);
+	if (other.open(cache_path.c_str(), path.c_str(), other_key)) {
+		printf("Error! A mesh cache with another producer key was accepted\n");
+		return 1;
+	}
+
+	// A damaged cache must be rejected.
+	FILE* f = fopen(cache_path.c_str(), "r+b");
+	fseek(f, 1000, SEEK_SET);
+	fputc(0x5a, f);
+	fclose(f);
+	MeshCache damaged;
+	if (damaged.open(cache_path.c_str(), path.c_str(), key)) {
+		printf("Error! A damaged mesh cache was accepted\n");
+		return 1;
+	}
+	printf("damaged cache and other producer key rejected\n");
+
+	remove(cache_path.c_str());
+	remove(path.c_str());
+
+	/*--- importers ---*/
+	// The same icosphere as OBJ, PLY in both byte orders and STL must
+	// import as the same triangles.
+	{
+		IndexedMesh ico;
+		ico.build_icosphere(7);
+		Mesh flat;
+		ico.unroll(flat);
+		std::vector<std::vector<GLfloat> > expected, got;
+		triangle_keys(flat, expected);
+		const char* names[] = { "obj", "ply", "big.ply", "stl" };
+		for (int i = 0; i < 4; i++) {
+			std::string file = std::string(tmp ? tmp : "/tmp") + "/mesh_bench_import." + names[i];
+			if (i == 0) write_obj(file.c_str(), ico);
+			else if (i < 3) write_ply(file.c_str(), ico, i == 2);
+			else write_stl(file.c_str(), flat);
+			ImportedMesh imported;
+			t0 = Clock::now();
+			bool ok = ImportMeshFile(file.c_str(), imported, err);
+			t1 = Clock::now();
+			if (!ok) {
+				printf("Error! %s:%d:%d: %s\n", file.c_str(), err.line, err.column, err.message);
+				return 1;
+			}
+			Mesh unrolled;
+			imported.unroll(unrolled);
+			triangle_keys(unrolled, got);
+			if (got != expected || (i < 3 && (int) imported.positions.size() != ico.vertex_count())) {
+				printf("Error! %s imports different triangles\n", file.c_str());
+				return 1;
+			}
+			// Built from the indices directly, it must weld as the
+			// unrolled triangles do, and give the same smooth mesh.
+			IndexedMesh direct, welded, smooth_direct, smooth_welded;
+			direct.build(&imported.positions[0], (int) imported.positions.size(), &imported.indices[0],
+				(int) imported.indices.size());
+			welded.build(unrolled.points(), unrolled.normals(), unrolled.size(), false);
+			smooth_direct.build_smooth(direct);
+			smooth_welded.build_smooth(unrolled.points(), unrolled.size());
+			Mesh direct_unrolled;
+			direct.unroll(direct_unrolled);
+			triangle_keys(direct_unrolled, got);
+			if (got != expected || direct.vertex_count() != welded.vertex_count() ||
+			    smooth_direct.vertex_count() != smooth_welded.vertex_count()) {
+				printf("Error! %s builds a different indexed mesh from its indices\n", file.c_str());
+				return 1;
+			}
+			double seconds = std::chrono::duration<double>(t1 - t0).count();
+			printf("Import %-8s %6.1f MB  %7.3f s  %8.1f MB/s   %d triangles, %d vertices\n", names[i],
+				file_mb(file.c_str()), seconds, file_mb(file.c_str()) / seconds, (int) imported.indices.size() / 3,
+				(int) imported.positions.size());
+			remove(file.c_str());
+		}
+
+		// fan triangulation, and errors with their position
+		std::string file = std::string(tmp ? tmp : "/tmp") + "/mesh_bench_import.obj";
+		const char* texts[] = {
+			"v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nv 0 2 0\nf 1 2 3 -2 -1\n",
+			"v 0 0 0\nv 1 0 0\n\nf 1 2 3\n",
+			"ply\nformat ascii 1.0\nend_header\n"
+		};
+		const unsigned fan[] = { 0, 1, 2, 0, 2, 3, 0, 3, 4 };
+		for (int i = 0; i < 3; i++) {
+			if (i == 2) file.replace(file.size() - 3, 3, "ply");
+			FILE* f = fopen(file.c_str(), "wb");
+			fputs(texts[i], f);
+			fclose(f);
+			ImportedMesh imported;
+			bool ok = ImportMeshFile(file.c_str(), imported, err);
+			remove(file.c_str());
+			if (i == 0 && (!ok || imported.indices.size() != 9 || !std::equal(fan, fan + 9, imported.indices.begin()))) {
+				printf("Error! A pentagon is not fanned into 3 triangles\n");
+				return 1;
+			}
+			if (i > 0 && (ok || err.line != (i == 1 ? 4 : 2) || err.column != (i == 1 ? 7 : 8))) {
+				printf("Error! Bad import not reported at the right place (%d:%d)\n", err.line, err.column);
+				return 1;
+			}
+			if (i > 0)
+				printf("import error report: line %d, column %d: %s\n", err.line, err.column, err.message);
+		}
+
+		// Counts from a hostile header must be rejected before anything
+		// is allocated for them: a face with 4 billion corners, and 2
+		// billion vertices in a file of a few bytes.
+		const char* headers[] = {
+			"ply\nformat binary_little_endian 1.0\nelement vertex 3\nproperty float x\n"
+			"element face 1\nproperty list uint uint vertex_indices\nend_header\n",
+			"ply\nformat binary_little_endian 1.0\nelement vertex 2000000000\nproperty float x\nend_header\n"
+		};
+		for (int i = 0; i < 2; i++) {
+			FILE* f = fopen(file.c_str(), "wb");
+			fputs(headers[i], f);
+			float x[3] = { 0.0f, 1.0f, 2.0f };
+			unsigned count = 0xfffffff0u;
+			fwrite(x, sizeof(x), 1, f);
+			fwrite(&count, sizeof(count), 1, f);
+			fclose(f);
+			ImportedMesh imported;
+			bool ok = ImportMeshFile(file.c_str(), imported, err);
+			remove(file.c_str());
+			if (ok || imported.positions.size() > 3) {
+				printf("Error! A PLY count beyond the file size was accepted\n");
+				return 1;
+			}
+			printf("import error report: %s\n", err.message);
+		}
+	}
+
+	/*--- generated icospheres ---*/
+	printf("\n");
+	for (int l = 0; l <= 6; l++) {
+		IndexedMesh ico;
+		t0 = Clock::now();
+		ico.build_icosphere(l);
+		t1 = Clock::now();
+		int triangles = ico.index_count() / 3;
+		bool ok = triangles == 20 << (2 * l);
+		for (int t = 0; t < triangles && ok; t++) {
+			const vec4& a = ico.points()[ico.index(3 * t)];
+			const vec4& b = ico.points()[ico.index(3 * t + 1)];
+			const vec4& c = ico.points()[ico.index(3 * t + 2)];
+			vec3 n = cross(vec3(b.x - a.x, b.y - a.y, b.z - a.z), vec3(c.x - b.x, c.y - b.y, c.z - b.z));
+			ok = dot(n, vec3(a.x + b.x + c.x, a.y + b.y + c.y, a.z + b.z + c.z)) > 0.0;  // outward
+		}
+		for (int v = 0; v < ico.vertex_count() && ok; v++) {
+			const vec4& p = ico.points()[v];
+			const vec3& n = ico.normals()[v];
+			ok = fabs(length(vec3(p.x, p.y, p.z)) - 1.0) < 1e-5 && p.x == n.x && p.y == n.y && p.z == n.z;
+		}
+		ok = ok && ico.vertex_count() == 10 * (1 << (2 * l)) + 2;    // V = F / 2 + 2
+		if (!ok) {
+			printf("Error! icosphere level %d is malformed\n", l);
+			return 1;
+		}
+		printf("icosphere level %d  %6d triangles  %6d vertices  %8.1f us\n", l, triangles, ico.vertex_count(),
+			std::chrono::duration<double>(t1 - t0).count() * 1e6);
+	}
+
+	/*--- meshlets on a dense mesh ---*/
+	IndexedMesh ico;
+	ico.build_icosphere(6);
+	ico.optimize_vertex_cache();
+	ico.optimize_overdraw();
+	ico.build_meshlets();
+	ico.optimize_vertex_fetch();
+	double far_culled = check_culling(ico, vec4(7.0, 3.0, -10.0, 1.0));
+	double near_culled = check_culling(ico, vec4(0.0, 0.5, 1.6, 1.0));
+	if (far_culled < 0.0 || near_culled < 0.0) {
+		printf("Error! icosphere: a visible meshlet is culled\n");
+		return 1;
+	}
+	printf("icosphere level 6  %d meshlets, ACMR %.3f, %4.1f%% of the triangles culled from afar, %4.1f%% up close\n",
+		(int) ico.meshlets().size(), ico.analyze_vertex_cache().acmr, far_culled * 100.0, near_culled * 100.0);
+
+	/*--- simplification ---*/
+	// The results must stay closed (Euler characteristic 2) and close to
+	// the unit sphere, with or without threads.
+	{
+		Mesh flat;
+		IndexedMesh full;
+		full.build_icosphere(6);
+		full.unroll(flat);
+		int triangles = flat.size() / 3;
+		const double fractions[] = { 0.5, 0.25, 0.1 };
+		for (int f = 0; f < 3; f++) {
+			for (int r = 0; r < 2; r++) {
+				Mesh lod;
+				int target = (int) (fractions[f] * triangles);
+				t0 = Clock::now();
+				GLfloat error = SimplifyMesh(flat.points(), flat.size(), target, lod, r == 0 ? NULL : &pool);
+				t1 = Clock::now();
+				IndexedMesh welded;
+				welded.build(lod.points(), NULL, lod.size(), false);
+				int faces = lod.size() / 3;
+				double deviation = 0.0;
+				for (int v = 0; v < lod.size(); v++) {
+					const vec4& p = lod.points()[v];
+					deviation = std::max(deviation, fabs(length(vec3(p.x, p.y, p.z)) - 1.0));
+				}
+				if (welded.vertex_count() - faces * 3 / 2 + faces != 2 || faces > target || faces < target * 0.9 ||
+				    deviation > 0.01) {
+					printf("Error! Simplifying to %d triangles gives %d, deviation %g\n", target, faces, deviation);
+					return 1;
+				}
+				printf("SimplifyMesh %3.0f%%  %6d triangles  error %.2g  deviation %.2g  %7.3f s (%d threads)\n",
+					fractions[f] * 100.0, faces, error, deviation, std::chrono::duration<double>(t1 - t0).count(),
+					r == 0 ? 1 : pool.size());
+			}
+		}
+	}
+
+	/*--- packed vertex format ---*/
+	// decoded as vshader42.glsl does
+	vec3 scale, bias;
+	ico.packed_bounds(scale, bias);
+	std::vector<PackedVertex> packed(ico.vertex_count());
+	ico.pack(&packed[0], scale, bias);
+	double position_error = 0.0, normal_error = 0.0;
+	for (int v = 0; v < ico.vertex_count(); v++) {
+		const PackedVertex& q = packed[v];
+		vec3 p = bias + vec3(scale.x * q.position[0], scale.y * q.position[1], scale.z * q.position[2]);
+		const vec4& e = ico.points()[v];
+		position_error = std::max(position_error, (double) length(p - vec3(e.x, e.y, e.z)));
+		GLfloat x = std::max(q.normal[0] / 32767.0f, -1.0f), y = std::max(q.normal[1] / 32767.0f, -1.0f);
+		vec3 n(x, y, 1.0f - fabsf(x) - fabsf(y));
+		if (n.z < 0.0f) {
+			n.x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			n.y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		}
+		n = normalize(n);
+		const vec3& m = ico.normals()[v];
+		normal_error = std::max(normal_error, atan2((double) length(cross(n, m)), (double) dot(n, m)) / DegreesToRadians);
+	}
+	if (position_error > 1e-4 || normal_error > 0.01) {
+		printf("Error! Packed vertices decode with position error %g, normal error %g degrees\n",
+			position_error, normal_error);
+		return 1;
+	}
+	printf("packed vertices    %d bytes instead of %d; position error %.2g, normal error %.2g degrees\n",
+		(int) sizeof(PackedVertex), (int) (sizeof(vec4) + sizeof(vec3)), position_error, normal_error);
+	return 0;
+}
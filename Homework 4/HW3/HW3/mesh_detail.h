@@ -0,0 +1,75 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- mesh_detail.h ---
+//
+//   Helpers shared by the mesh_*.cpp files, not part of the mesh API.
+//
+//   PositionKey - the exact bits of a position, for welding vertices (or
+//           finding the triangles that touch) with an unordered_map.
+//
+//   UnrollTriangles() - an indexed triangle list written out as a
+//           polygon file would give it, with flat normals.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ANGEL_MESH_DETAIL_H__
+#define __ANGEL_MESH_DETAIL_H__
+
+#include "mesh.h"
+
+namespace Angel {
+
+namespace detail {
+
+struct PositionKey {
+    unsigned  x, y, z;
+    bool operator == ( const PositionKey& k ) const { return x == k.x && y == k.y && z == k.z; }
+};
+
+struct PositionKeyHash {
+    size_t operator () ( const PositionKey& k ) const {
+	return ( k.x * 73856093u ) ^ ( k.y * 19349663u ) ^ ( k.z * 83492791u );
+    }
+};
+
+// -0.0 and +0.0 give the same key.
+inline PositionKey
+position_key( const vec4& p )
+{
+    GLfloat x = p.x + 0.0f, y = p.y + 0.0f, z = p.z + 0.0f;
+    PositionKey k;
+    memcpy( &k.x, &x, sizeof(unsigned) );
+    memcpy( &k.y, &y, sizeof(unsigned) );
+    memcpy( &k.z, &z, sizeof(unsigned) );
+    return k;
+}
+
+// Appends the "index_count" / 3 triangles to "mesh" with the flat normal
+// normalize((b - a) x (c - b)) at each corner, zero if degenerate.
+// "Index" is GLushort or GLuint (or unsigned).
+template <class Index>
+void
+UnrollTriangles( const vec4* points, const Index* indices, size_t index_count, Mesh& mesh )
+{
+    if ( index_count < (size_t) ( MaxMeshVertices - mesh.size() ) ) {
+	mesh.reserve( mesh.size() + (int) index_count );
+    }
+    for ( size_t i = 0; i + 2 < index_count; i += 3 ) {
+	const vec4& pa = points[indices[i]];
+	const vec4& pb = points[indices[i + 1]];
+	const vec4& pc = points[indices[i + 2]];
+	vec3 a( pa.x, pa.y, pa.z ), b( pb.x, pb.y, pb.z ), c( pc.x, pc.y, pc.z );
+	vec3 n = cross( b - a, c - b );
+	GLfloat len = length( n );
+	n = len > 0.0f ? n / len : vec3( 0.0, 0.0, 0.0 );
+	mesh.push_back( a, n );
+	mesh.push_back( b, n );
+	mesh.push_back( c, n );
+    }
+}
+
+}  // namespace detail
+
+}  // namespace Angel
+
+#endif // __ANGEL_MESH_DETAIL_H__
@@ -0,0 +1,1361 @@
+#define _CRT_SECURE_NO_DEPRECATE
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unordered_map>
+
+#include "mesh_detail.h"
+#include "mesh_io.h"
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  define NOMINMAX
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+
+namespace Angel {
+
+//----------------------------------------------------------------------------
+//
+//  MappedFile
+//
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() : _data(NULL), _size(0), _file(NULL), _mapping(NULL) {}
+
+bool
+MappedFile::open( const char* path )
+{
+    close();
+
+    HANDLE file = CreateFileA( path, GENERIC_READ, FILE_SHARE_READ, NULL,
+			       OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+    if ( file == INVALID_HANDLE_VALUE ) { return false; }
+
+    LARGE_INTEGER size;
+    if ( !GetFileSizeEx( file, &size ) ) { CloseHandle( file );  return false; }
+    _file = file;
+    _size = (size_t) size.QuadPart;
+    if ( _size == 0 ) { _data = "";  return true; }   // cannot map 0 bytes
+
+    _mapping = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+    if ( _mapping == NULL ) { close();  return false; }
+    _data = (const char*) MapViewOfFile( (HANDLE) _mapping, FILE_MAP_READ, 0, 0, 0 );
+    if ( _data == NULL ) { close();  return false; }
+    return true;
+}
+
+void
+MappedFile::close()
+{
+    if ( _data != NULL && _size > 0 ) { UnmapViewOfFile( _data ); }
+    if ( _mapping != NULL ) { CloseHandle( (HANDLE) _mapping ); }
+    if ( _file != NULL ) { CloseHandle( (HANDLE) _file ); }
+    _data = NULL;  _size = 0;  _file = NULL;  _mapping = NULL;
+}
+
+#else
+
+MappedFile::MappedFile() : _data(NULL), _size(0), _fd(-1) {}
+
+bool
+MappedFile::open( const char* path )
+{
+    close();
+
+    _fd = ::open( path, O_RDONLY );
+    if ( _fd < 0 ) { return false; }
+
+    struct stat st;
+    if ( fstat( _fd, &st ) != 0 ) { close();  return false; }
+    _size = (size_t) st.st_size;
+    if ( _size == 0 ) { _data = "";  return true; }   // cannot map 0 bytes
+
+    void* p = mmap( NULL, _size, PROT_READ, MAP_PRIVATE, _fd, 0 );
+    if ( p == MAP_FAILED ) { close();  return false; }
+    madvise( p, _size, MADV_SEQUENTIAL );
+    _data = (const char*) p;
+    return true;
+}
+
+void
+MappedFile::close()
+{
+    if ( _data != NULL && _size > 0 ) { munmap( (void*) _data, _size ); }
+    if ( _fd >= 0 ) { ::close( _fd ); }
+    _data = NULL;  _size = 0;  _fd = -1;
+}
+
+#endif // _WIN32
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+//----------------------------------------------------------------------------
+//
+//  Polygon file parser
+//
+
+namespace {
+
+// Position in the text, with what is needed to report line and column.
+struct Cursor {
+    const char*  p;
+    const char*  end;
+    const char*  line_start;
+    int          line;
+};
+
+bool
+fail( const Cursor& c, MeshParseError& err, const char* message )
+{
+    err.line = c.line;
+    err.column = (int) ( c.p - c.line_start ) + 1;
+    strncpy( err.message, message, sizeof(err.message) - 1 );
+    err.message[sizeof(err.message) - 1] = '\0';
+    return false;
+}
+
+inline bool
+is_digit( char ch )
+{
+    return (unsigned) ( ch - '0' ) < 10u;
+}
+
+inline void
+skip_space( Cursor& c )
+{
+    const char* p = c.p;
+    while ( p < c.end ) {
+	char ch = *p;
+	if ( ch == '\n' ) { c.line++;  c.line_start = p + 1; }
+	else if ( ch != ' ' && ch != '\t' && ch != '\r' && ch != '\f' && ch != '\v' ) { break; }
+	++p;
+    }
+    c.p = p;
+}
+
+// A non-negative decimal integer.
+bool
+parse_count( Cursor& c, long long& value, MeshParseError& err, const char* what )
+{
+    skip_space( c );
+    if ( c.p == c.end ) { return fail( c, err, "unexpected end of file" ); }
+    if ( !is_digit( *c.p ) ) { return fail( c, err, what ); }
+
+    long long v = 0;
+    const char* p = c.p;
+    while ( p < c.end && is_digit( *p ) ) {
+	v = v * 10 + ( *p++ - '0' );
+	if ( v > 0x7fffffffLL ) { return fail( c, err, "count is too large" ); }
+    }
+    c.p = p;
+    value = v;
+    return true;
+}
+
+// The powers of 10 that a float holds exactly.
+const float PowersOf10[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+// A decimal floating-point number: [+-] digits [. digits] [(e|E) [+-] digits].
+// A mantissa of at most 2^24 and |exponent| <= 10 (all the sphere files)
+// are both exact as floats, so one float multiply or divide rounds the
+// result once, as strtof() does; anything else falls back to strtof() on a
+// copy of the token.  (Going through a double would round twice.)
+bool
+parse_float( Cursor& c, GLfloat& value, MeshParseError& err )
+{
+    skip_space( c );
+    if ( c.p == c.end ) { return fail( c, err, "unexpected end of file" ); }
+
+    const char* start = c.p;
+    const char* p = start;
+    const char* end = c.end;
+
+    bool negative = false;
+    if ( *p == '-' || *p == '+' ) { negative = ( *p == '-' );  ++p; }
+
+    unsigned long long mantissa = 0;
+    int significant = 0;      // digits in mantissa, not counting leading zeros
+    int exponent = 0;
+    int digits = 0;           // all digits seen
+
+    for ( ; p < end && is_digit( *p ); ++p, ++digits ) {
+	if ( significant < 19 ) {
+	    mantissa = mantissa * 10 + ( *p - '0' );
+	    if ( mantissa != 0 ) { ++significant; }
+	} else {
+	    ++exponent;
+	}
+    }
+    if ( p < end && *p == '.' ) {
+	for ( ++p; p < end && is_digit( *p ); ++p, ++digits ) {
+	    if ( significant < 19 ) {
+		mantissa = mantissa * 10 + ( *p - '0' );
+		if ( mantissa != 0 ) { ++significant; }
+		--exponent;
+	    }
+	}
+    }
+    if ( digits == 0 ) { return fail( c, err, "expected a number" ); }
+
+    if ( p < end && ( *p == 'e' || *p == 'E' ) ) {
+	++p;
+	bool negative_exp = false;
+	if ( p < end && ( *p == '-' || *p == '+' ) ) { negative_exp = ( *p == '-' );  ++p; }
+	if ( p == end || !is_digit( *p ) ) {
+	    c.p = p;
+	    return fail( c, err, "expected exponent digits" );
+	}
+	int e = 0;
+	for ( ; p < end && is_digit( *p ); ++p ) {
+	    if ( e < 10000 ) { e = e * 10 + ( *p - '0' ); }
+	}
+	exponent += negative_exp ? -e : e;
+    }
+
+    // The number must end at whitespace or at the end of the file.
+    if ( p < end && !( *p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' ||
+		       *p == '\f' || *p == '\v' ) ) {
+	c.p = p;
+	return fail( c, err, "unexpected character in number" );
+    }
+
+    float v;
+    if ( mantissa == 0 ) {
+	v = 0.0f;
+    } else if ( exponent >= -10 && exponent <= 10 && mantissa <= ( 1ULL << 24 ) ) {
+	v = exponent < 0 ? (float) mantissa / PowersOf10[-exponent]
+			 : (float) mantissa * PowersOf10[exponent];
+    } else {
+	char buf[64];
+	size_t len = (size_t) ( p - start );
+	if ( len >= sizeof(buf) ) { return fail( c, err, "number is too long" ); }
+	memcpy( buf, start, len );
+	buf[len] = '\0';
+	v = fabsf( strtof( buf, NULL ) );
+    }
+
+    c.p = p;
+    value = negative ? -v : v;
+    return true;
+}
+
+// Where the parser puts its triangles: reserve() is called once with the
+// expected vertex count, add() once per vertex.
+
+struct VectorSink {
+    std::vector<vec3>&  positions;
+    std::vector<vec3>&  normals;
+
+    VectorSink( std::vector<vec3>& p, std::vector<vec3>& n ) : positions(p), normals(n) {}
+
+    void reserve( long long n ) {
+	positions.reserve( positions.size() + (size_t) n );
+	normals.reserve( normals.size() + (size_t) n );
+    }
+    void add( const vec3& position, const vec3& normal ) {
+	positions.push_back( position );
+	normals.push_back( normal );
+    }
+};
+
+struct MeshSink {
+    Mesh&  mesh;
+
+    explicit MeshSink( Mesh& m ) : mesh(m) {}
+
+    // n comes from the file, so it may be anything; it is only a hint.
+    void reserve( long long n ) {
+	long long room = (long long) MaxMeshVertices - mesh.size();
+	mesh.reserve( mesh.size() + (int) ( n < room ? n : room ) );
+    }
+    void add( const vec3& position, const vec3& normal ) { mesh.push_back( position, normal ); }
+};
+
+// One polygon, fanned into triangles.  "polygon" is scratch space that is
+// reused from call to call.
+template <class Sink>
+bool
+parse_polygon( Cursor& c, Sink& out, std::vector<vec3>& polygon, MeshParseError& err )
+{
+    long long numVertices;
+    if ( !parse_count( c, numVertices, err, "expected the number of vertices of a polygon" ) ) {
+	return false;
+    }
+    if ( numVertices < 3 ) { return fail( c, err, "a polygon needs at least 3 vertices" ); }
+
+    polygon.resize( (size_t) numVertices );
+    for ( long long j = 0; j < numVertices; j++ ) {
+	vec3& v = polygon[(size_t) j];
+	if ( !parse_float( c, v.x, err ) || !parse_float( c, v.y, err ) ||
+	     !parse_float( c, v.z, err ) ) {
+	    return false;
+	}
+    }
+
+    vec3 normal = normalize( cross( polygon[1] - polygon[0], polygon[2] - polygon[1] ) );
+    for ( size_t j = 1; j + 1 < polygon.size(); j++ ) {
+	out.add( polygon[0], normal );
+	out.add( polygon[j], normal );
+	out.add( polygon[j + 1], normal );
+    }
+    return true;
+}
+
+inline Cursor
+make_cursor( const char* text, size_t size )
+{
+    Cursor c;
+    c.p = text;
+    c.end = text + size;
+    c.line_start = text;
+    c.line = 1;
+    return c;
+}
+
+// Reserve for the common all-triangles case; each polygon also has at
+// least 3 * 3 numbers in the file, which bounds the count.
+inline long long
+expected_vertices( long long numPolygons, size_t size )
+{
+    long long reserve = numPolygons * 3;
+    return reserve > (long long) ( size / 6 ) ? (long long) ( size / 6 ) : reserve;
+}
+
+template <class Sink>
+bool
+parse_polygons( const char* text, size_t size, Sink& out, MeshParseError& err )
+{
+    Cursor c = make_cursor( text, size );
+
+    long long numPolygons;
+    if ( !parse_count( c, numPolygons, err, "expected the number of polygons" ) ) { return false; }
+    out.reserve( expected_vertices( numPolygons, size ) );
+
+    std::vector<vec3> polygon;
+    polygon.reserve( 8 );
+    for ( long long i = 0; i < numPolygons; i++ ) {
+	if ( !parse_polygon( c, out, polygon, err ) ) { return false; }
+    }
+
+    skip_space( c );
+    if ( c.p != c.end ) { return fail( c, err, "unexpected text after the last polygon" ); }
+    return true;
+}
+
+//  --- Parallel parsing ---
+//
+//  The text after the polygon count is cut into one chunk per piece of
+//  work.  Each cut is moved forward to the next line that holds a single
+//  token: in the files' one-item-per-line layout that is a vertex count,
+//  i.e. the start of a polygon.  The chunks are parsed into vectors of
+//  their own, and the vectors are copied into the mesh at prefix-summed
+//  offsets.  If the chunks do not add up to exactly the polygons of the
+//  file (another layout, or an error), the serial parser runs instead and
+//  reports errors with their exact line and column.
+
+const size_t ParallelChunkSize = size_t(4) << 20;   // minimum bytes per chunk
+
+inline bool
+is_space( char ch )
+{
+    return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\f' || ch == '\v';
+}
+
+// The start of the first line at or after "p" (which must be a line
+// start) that holds exactly one token; "end" if there is none.
+const char*
+next_polygon_start( const char* p, const char* end )
+{
+    while ( p < end ) {
+	const char* eol = (const char*) memchr( p, '\n', (size_t) ( end - p ) );
+	if ( eol == NULL ) { eol = end; }
+	int tokens = 0;
+	for ( const char* q = p; q < eol && tokens < 2; ) {
+	    while ( q < eol && is_space( *q ) ) { ++q; }
+	    if ( q == eol ) { break; }
+	    ++tokens;
+	    while ( q < eol && !is_space( *q ) ) { ++q; }
+	}
+	if ( tokens == 1 ) { return p; }
+	p = eol < end ? eol + 1 : end;
+    }
+    return end;
+}
+
+struct ChunkResult {
+    std::vector<vec3>  positions;
+    std::vector<vec3>  normals;
+    long long          polygons;
+    bool               ok;
+};
+
+bool
+parse_polygons_parallel( const char* text, size_t size, Mesh& mesh, ThreadPool& pool )
+{
+    MeshParseError err;
+    Cursor c = make_cursor( text, size );
+    long long numPolygons;
+    if ( !parse_count( c, numPolygons, err, "" ) ) { return false; }
+
+    // Cut points, each at a polygon start.
+    const char* body = c.p;
+    const char* end = text + size;
+    int chunks = (int) ( ( end - body ) / ParallelChunkSize );
+    if ( chunks > 4 * pool.size() ) { chunks = 4 * pool.size(); }
+    if ( chunks < 2 ) { return false; }
+    std::vector<const char*> cuts( (size_t) chunks + 1 );
+    cuts[0] = body;
+    cuts[chunks] = end;
+    pool.parallel_for( 1, chunks, 1, [&]( int begin, int stop ) {
+	for ( int i = begin; i < stop; ++i ) {
+	    const char* p = body + ( end - body ) * (long long) i / chunks;
+	    const char* eol = (const char*) memchr( p, '\n', (size_t) ( end - p ) );
+	    cuts[i] = eol ? next_polygon_start( eol + 1, end ) : end;
+	}
+    } );
+
+    std::vector<ChunkResult> results( (size_t) chunks );
+    pool.parallel_for( 0, chunks, 1, [&]( int begin, int stop ) {
+	std::vector<vec3> polygon;
+	polygon.reserve( 8 );
+	for ( int i = begin; i < stop; ++i ) {
+	    ChunkResult& r = results[i];
+	    VectorSink out( r.positions, r.normals );
+	    r.polygons = 0;
+	    r.ok = cuts[i] <= cuts[i + 1];
+	    if ( !r.ok ) { continue; }
+	    size_t bytes = (size_t) ( cuts[i + 1] - cuts[i] );
+	    out.reserve( (long long) ( bytes / 20 ) );   // ~ 3 vertices per 60 bytes
+	    Cursor cc = make_cursor( cuts[i], bytes );
+	    MeshParseError chunk_err;
+	    for ( ;; ) {
+		skip_space( cc );
+		if ( cc.p == cc.end ) { break; }
+		if ( !parse_polygon( cc, out, polygon, chunk_err ) ) {
+		    r.ok = false;
+		    break;
+		}
+		++r.polygons;
+	    }
+	}
+    } );
+
+    // Prefix sums give every chunk its place in the mesh.
+    std::vector<int> offsets( (size_t) chunks + 1, 0 );
+    long long polygons = 0;
+    long long total = 0;
+    for ( int i = 0; i < chunks; ++i ) {
+	if ( !results[i].ok ) { return false; }
+	polygons += results[i].polygons;
+	total += (long long) results[i].positions.size();
+	if ( total > (long long) MaxMeshVertices - mesh.size() ) { return false; }
+	offsets[i + 1] = (int) total;
+    }
+    if ( polygons != numPolygons ) { return false; }
+
+    int base = mesh.size();
+    mesh.resize( base + (int) total );   // fits, as checked above
+    vec4* points = mesh.points() + base;
+    vec3* normals = mesh.normals() + base;
+    pool.parallel_for( 0, chunks, 1, [&]( int begin, int stop ) {
+	for ( int i = begin; i < stop; ++i ) {
+	    const ChunkResult& r = results[i];
+	    for ( size_t j = 0; j < r.positions.size(); ++j ) {
+		points[offsets[i] + j] = vec4( r.positions[j], 1.0 );
+	    }
+	    if ( !r.normals.empty() ) {
+		memcpy( normals + offsets[i], &r.normals[0], r.normals.size() * sizeof(vec3) );
+	    }
+	}
+    } );
+    return true;
+}
+
+bool
+map_source( MappedFile& file, const char* path, MeshParseError& err )
+{
+    if ( file.open( path ) ) { return true; }
+    err.line = 0;
+    err.column = 0;
+    strncpy( err.message, "cannot open the file", sizeof(err.message) );
+    return false;
+}
+
+}  // namespace
+
+bool
+ParsePolygonFile( const char* text, size_t size,
+		  std::vector<vec3>& positions, std::vector<vec3>& normals,
+		  MeshParseError& err )
+{
+    VectorSink out( positions, normals );
+    return parse_polygons( text, size, out, err );
+}
+
+bool
+ParsePolygonFile( const char* text, size_t size, Mesh& mesh, MeshParseError& err,
+		  ThreadPool* pool )
+{
+    if ( pool && pool->size() > 1 && size >= 2 * ParallelChunkSize ) {
+	int base = mesh.size();
+	if ( parse_polygons_parallel( text, size, mesh, *pool ) ) { return true; }
+	mesh.resize( base );
+    }
+    MeshSink out( mesh );
+    return parse_polygons( text, size, out, err );
+}
+
+bool
+LoadPolygonFile( const char* path,
+		 std::vector<vec3>& positions, std::vector<vec3>& normals,
+		 MeshParseError& err )
+{
+    MappedFile file;
+    if ( !map_source( file, path, err ) ) { return false; }
+    return ParsePolygonFile( file.data(), file.size(), positions, normals, err );
+}
+
+bool
+LoadPolygonFile( const char* path, Mesh& mesh, MeshParseError& err, ThreadPool* pool )
+{
+    MappedFile file;
+    if ( !map_source( file, path, err ) ) { return false; }
+    return ParsePolygonFile( file.data(), file.size(), mesh, err, pool );
+}
+
+//----------------------------------------------------------------------------
+//
+//  Asset importers
+//
+
+namespace {
+
+const size_t ImportBufferSize = size_t(64) << 10;
+
+// A file read front to back through a buffer of fixed size.
+class StreamReader {
+
+    FILE*              _file;
+    std::vector<char>  _buffer;
+    size_t             _begin;        // unread bytes are [_begin, _end)
+    size_t             _end;
+    long long          _offset;       // file offset of _buffer[_begin]
+    long long          _size;         // -1 if unknown
+
+    StreamReader( const StreamReader& );             // not copyable
+    StreamReader& operator = ( const StreamReader& );
+
+    // Moves the unread bytes to the front and reads more after them;
+    // false if nothing could be added (end of file, or a full buffer).
+    bool refill() {
+	if ( _begin > 0 ) {
+	    memmove( &_buffer[0], &_buffer[_begin], _end - _begin );
+	    _end -= _begin;
+	    _begin = 0;
+	}
+	if ( _end == _buffer.size() ) { return false; }
+	size_t n = fread( &_buffer[_end], 1, _buffer.size() - _end, _file );
+	_end += n;
+	return n > 0;
+    }
+
+   public:
+    StreamReader() : _file(NULL), _buffer( ImportBufferSize ), _begin(0), _end(0), _offset(0), _size(-1) {}
+    ~StreamReader() { if ( _file ) { fclose( _file ); } }
+
+    bool open( const char* path ) {
+	_file = fopen( path, "rb" );
+	if ( !_file ) { return false; }
+	struct stat st;
+	if ( stat( path, &st ) == 0 ) { _size = (long long) st.st_size; }
+	return true;
+    }
+
+    long long offset() const { return _offset; }
+    long long size() const { return _size; }
+
+    // Copies the next "n" bytes to "out"; false if the file ends first.
+    bool read( void* out, size_t n ) {
+	char* dst = static_cast<char*>( out );
+	while ( n > 0 ) {
+	    if ( _begin == _end && !refill() ) { return false; }
+	    size_t k = _end - _begin < n ? _end - _begin : n;
+	    memcpy( dst, &_buffer[_begin], k );
+	    _begin += k;
+	    _offset += (long long) k;
+	    dst += k;
+	    n -= k;
+	}
+	return true;
+    }
+
+    // The next line, without its "\n" or "\r\n", valid until the next
+    // call.  False at the end of the file, or with "too_long" set if the
+    // line does not fit in the buffer.
+    bool next_line( const char*& begin, const char*& end, bool& too_long ) {
+	too_long = false;
+	size_t scanned = 0;             // bytes after _begin without a '\n'
+	while ( true ) {
+	    const char* p = &_buffer[0] + _begin;
+	    const char* nl = static_cast<const char*>( memchr( p + scanned, '\n', _end - _begin - scanned ) );
+	    if ( nl ) {
+		begin = p;
+		end = nl;
+		_begin += (size_t) ( nl - p ) + 1;
+		_offset += ( nl - p ) + 1;
+		break;
+	    }
+	    scanned = _end - _begin;
+	    if ( !refill() ) {
+		if ( _begin == _end ) { return false; }
+		if ( _end - _begin == _buffer.size() ) {
+		    too_long = true;
+		    return false;
+		}
+		begin = &_buffer[0] + _begin;      // the last line has no '\n'
+		end = begin + ( _end - _begin );
+		_offset += (long long) ( _end - _begin );
+		_begin = _end;
+		break;
+	    }
+	}
+	if ( end > begin && end[-1] == '\r' ) { --end; }
+	return true;
+    }
+};
+
+bool
+open_source( StreamReader& in, const char* path, MeshParseError& err )
+{
+    if ( in.open( path ) ) { return true; }
+    err.line = 0;
+    err.column = 0;
+    strncpy( err.message, "cannot open the file", sizeof(err.message) );
+    return false;
+}
+
+bool
+fail_binary( const StreamReader& in, MeshParseError& err, const char* message )
+{
+    err.line = 0;
+    err.column = 0;
+    snprintf( err.message, sizeof(err.message), "%s (at byte %lld)", message, in.offset() );
+    return false;
+}
+
+inline Cursor
+line_cursor( const char* begin, const char* end, int line )
+{
+    Cursor c = make_cursor( begin, (size_t) ( end - begin ) );
+    c.line = line;
+    return c;
+}
+
+// The next whitespace-separated word of a line; empty at its end.
+std::string
+next_word( Cursor& c )
+{
+    skip_space( c );
+    const char* start = c.p;
+    while ( c.p < c.end && !is_space( *c.p ) ) { ++c.p; }
+    return std::string( start, c.p );
+}
+
+// Fans the polygon "polygon" (indices into mesh.positions) into triangles.
+void
+add_polygon( ImportedMesh& mesh, const std::vector<unsigned>& polygon )
+{
+    for ( size_t j = 1; j + 1 < polygon.size(); j++ ) {
+	mesh.indices.push_back( polygon[0] );
+	mesh.indices.push_back( polygon[j] );
+	mesh.indices.push_back( polygon[j + 1] );
+    }
+}
+
+//  --- OBJ ---
+
+// One vertex of an "f" line: "v", "v/vt", "v//vn" or "v/vt/vn", where v
+// counts from 1, or back from the last vertex if negative.  Only v is used.
+bool
+parse_obj_vertex( Cursor& c, long long vertex_count, long long& index, MeshParseError& err )
+{
+    const char* start = c.p;
+    bool negative = ( *c.p == '-' );
+    if ( negative ) { ++c.p; }
+    if ( c.p == c.end || !is_digit( *c.p ) ) { return fail( c, err, "expected a vertex index" ); }
+    long long v = 0;
+    while ( c.p < c.end && is_digit( *c.p ) ) {
+	v = v * 10 + ( *c.p++ - '0' );
+	if ( v > 0xffffffffLL ) { return fail( c, err, "vertex index is too large" ); }
+    }
+    index = negative ? vertex_count - v : v - 1;
+    if ( v == 0 || index < 0 || index >= vertex_count ) {
+	c.p = start;
+	return fail( c, err, "vertex index out of range" );
+    }
+    while ( c.p < c.end && !is_space( *c.p ) ) { ++c.p; }     // "/vt/vn"
+    return true;
+}
+
+//  --- PLY ---
+
+enum PlyType { PlyInt8, PlyUint8, PlyInt16, PlyUint16, PlyInt32, PlyUint32, PlyFloat32, PlyFloat64 };
+
+const char* const PlyTypeNames[][2] = {
+    { "char", "int8" },   { "uchar", "uint8" },   { "short", "int16" },  { "ushort", "uint16" },
+    { "int", "int32" },   { "uint", "uint32" },   { "float", "float32" }, { "double", "float64" }
+};
+const size_t PlyTypeSize[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+
+// List sizes come from the file, so they are bounded before anything is
+// allocated for them: by this, and by the bytes left in the file.
+const double MaxPlyListSize = 1 << 16;
+
+bool
+ply_type( const std::string& name, PlyType& type )
+{
+    for ( int t = 0; t < 8; t++ ) {
+	if ( name == PlyTypeNames[t][0] || name == PlyTypeNames[t][1] ) {
+	    type = (PlyType) t;
+	    return true;
+	}
+    }
+    return false;
+}
+
+// A value of type "type" in the file's byte order.
+double
+ply_value( const unsigned char* b, PlyType type, bool big_endian )
+{
+    size_t n = PlyTypeSize[type];
+    uint64_t bits = 0;
+    for ( size_t i = 0; i < n; i++ ) {
+	bits |= (uint64_t) b[big_endian ? n - 1 - i : i] << ( 8 * i );
+    }
+    switch ( type ) {
+	case PlyInt8:    return (double) (int8_t) bits;
+	case PlyUint8:   return (double) (uint8_t) bits;
+	case PlyInt16:   return (double) (int16_t) bits;
+	case PlyUint16:  return (double) (uint16_t) bits;
+	case PlyInt32:   return (double) (int32_t) bits;
+	case PlyUint32:  return (double) (uint32_t) bits;
+	case PlyFloat32: { uint32_t u = (uint32_t) bits;  float f;  memcpy( &f, &u, 4 );  return f; }
+	default:         { double d;  memcpy( &d, &bits, 8 );  return d; }
+    }
+}
+
+struct PlyProperty {
+    std::string  name;
+    PlyType      type;        // of the value, or of the items of a list
+    bool         list;
+    PlyType      count_type;  // of the item count of a list
+};
+
+struct PlyElement {
+    std::string               name;
+    long long                 count;
+    std::vector<PlyProperty>  properties;
+};
+
+// The header, up to and including "end_header".
+bool
+parse_ply_header( StreamReader& in, std::vector<PlyElement>& elements, bool& big_endian, MeshParseError& err )
+{
+    const char* begin;
+    const char* end;
+    bool too_long;
+    bool format = false;
+    for ( int line = 1; ; line++ ) {
+	if ( !in.next_line( begin, end, too_long ) ) {
+	    Cursor c = line_cursor( "", "", line );
+	    return fail( c, err, too_long ? "line is too long" : "unexpected end of file in the header" );
+	}
+	Cursor c = line_cursor( begin, end, line );
+	const char* start = c.p;
+	std::string keyword = next_word( c );
+	if ( line == 1 ) {
+	    if ( keyword != "ply" ) {
+		c.p = start;
+		return fail( c, err, "not a PLY file" );
+	    }
+	} else if ( keyword == "format" ) {
+	    skip_space( c );
+	    start = c.p;
+	    std::string kind = next_word( c );
+	    if ( kind == "binary_little_endian" || kind == "binary_big_endian" ) {
+		big_endian = ( kind == "binary_big_endian" );
+		format = true;
+	    } else {
+		c.p = start;
+		return fail( c, err, kind == "ascii" ? "ASCII PLY files are not supported" : "unknown PLY format" );
+	    }
+	} else if ( keyword == "element" ) {
+	    PlyElement e;
+	    e.name = next_word( c );
+	    long long count;
+	    if ( !parse_count( c, count, err, "expected the element count" ) ) { return false; }
+	    e.count = count;
+	    elements.push_back( e );
+	} else if ( keyword == "property" ) {
+	    if ( elements.empty() ) { return fail( c, err, "property before the first element" ); }
+	    PlyProperty p;
+	    std::string type = next_word( c );
+	    p.list = ( type == "list" );
+	    p.count_type = PlyUint8;
+	    if ( p.list ) {
+		if ( !ply_type( next_word( c ), p.count_type ) || !ply_type( next_word( c ), p.type ) ) {
+		    return fail( c, err, "unknown property type" );
+		}
+		if ( p.count_type == PlyFloat32 || p.count_type == PlyFloat64 ) {
+		    return fail( c, err, "list counts must be integers" );
+		}
+	    } else if ( !ply_type( type, p.type ) ) {
+		return fail( c, err, "unknown property type" );
+	    }
+	    p.name = next_word( c );
+	    elements.back().properties.push_back( p );
+	} else if ( keyword == "end_header" ) {
+	    if ( !format ) { return fail( c, err, "no format line in the header" ); }
+	    return true;
+	} else if ( keyword != "comment" && keyword != "obj_info" && !keyword.empty() ) {
+	    c.p = start;
+	    return fail( c, err, "unknown header line" );
+	}
+    }
+}
+
+//  --- STL ---
+
+inline uint32_t
+load_le32( const unsigned char* b )
+{
+    return (uint32_t) b[0] | (uint32_t) b[1] << 8 | (uint32_t) b[2] << 16 | (uint32_t) b[3] << 24;
+}
+
+inline GLfloat
+load_float( const unsigned char* b )
+{
+    uint32_t u = load_le32( b );
+    float f;
+    memcpy( &f, &u, 4 );
+    return f + 0.0f;          // -0 welds with +0
+}
+
+}  // namespace
+
+MeshFileFormat
+MeshFormatOf( const char* path )
+{
+    const char* dot = strrchr( path, '.' );
+    if ( !dot || strlen( dot ) != 4 ) { return MeshFormatPolygons; }
+    char ext[4];
+    for ( int i = 0; i < 4; i++ ) { ext[i] = (char) tolower( (unsigned char) dot[i] ); }
+    if ( memcmp( ext, ".obj", 4 ) == 0 ) { return MeshFormatOBJ; }
+    if ( memcmp( ext, ".ply", 4 ) == 0 ) { return MeshFormatPLY; }
+    if ( memcmp( ext, ".stl", 4 ) == 0 ) { return MeshFormatSTL; }
+    return MeshFormatPolygons;
+}
+
+void
+ImportedMesh::unroll( Mesh& mesh ) const
+{
+    if ( !indices.empty() ) {
+	detail::UnrollTriangles( &positions[0], &indices[0], indices.size(), mesh );
+    }
+}
+
+bool
+ImportOBJ( const char* path, ImportedMesh& mesh, MeshParseError& err )
+{
+    StreamReader in;
+    if ( !open_source( in, path, err ) ) { return false; }
+
+    size_t base = mesh.positions.size();
+    std::vector<unsigned> polygon;
+    const char* begin;
+    const char* end;
+    bool too_long;
+    int line = 1;
+    for ( ; in.next_line( begin, end, too_long ); line++ ) {
+	Cursor c = line_cursor( begin, end, line );
+	skip_space( c );
+	if ( c.p == c.end || *c.p == '#' ) { continue; }
+	std::string keyword = next_word( c );
+
+	if ( keyword == "v" ) {
+	    vec4 p( 0.0, 0.0, 0.0, 1.0 );
+	    if ( !parse_float( c, p.x, err ) || !parse_float( c, p.y, err ) || !parse_float( c, p.z, err ) ) {
+		return false;
+	    }
+	    mesh.positions.push_back( p );      // "w" and vertex colors are ignored
+	} else if ( keyword == "f" ) {
+	    long long vertex_count = (long long) ( mesh.positions.size() - base );
+	    polygon.clear();
+	    while ( true ) {
+		skip_space( c );
+		if ( c.p == c.end || *c.p == '#' ) { break; }
+		long long index;
+		if ( !parse_obj_vertex( c, vertex_count, index, err ) ) { return false; }
+		polygon.push_back( (unsigned) ( base + (size_t) index ) );
+	    }
+	    if ( polygon.size() < 3 ) { return fail( c, err, "a face needs at least 3 vertices" ); }
+	    add_polygon( mesh, polygon );
+	}
+	// vt, vn, groups, materials, lines, ...: not needed
+    }
+    if ( too_long ) {
+	Cursor c = line_cursor( "", "", line );
+	return fail( c, err, "line is too long" );
+    }
+    return true;
+}
+
+bool
+ImportPLY( const char* path, ImportedMesh& mesh, MeshParseError& err )
+{
+    StreamReader in;
+    if ( !open_source( in, path, err ) ) { return false; }
+
+    std::vector<PlyElement> elements;
+    bool big_endian = false;
+    if ( !parse_ply_header( in, elements, big_endian, err ) ) { return false; }
+
+    // Indices are checked against the vertex count of the header, so the
+    // elements may come in any order.  An item takes at least the bytes of
+    // its values and list sizes, so the counts cannot exceed what is left
+    // of the file (an item without properties is counted as one byte).
+    size_t base = mesh.positions.size();
+    long long vertex_count = 0;
+    long long min_bytes = 0;
+    for ( size_t e = 0; e < elements.size(); e++ ) {
+	if ( elements[e].name == "vertex" ) { vertex_count = elements[e].count; }
+	long long item_bytes = 0;
+	for ( size_t k = 0; k < elements[e].properties.size(); k++ ) {
+	    const PlyProperty& p = elements[e].properties[k];
+	    item_bytes += (long long) PlyTypeSize[p.list ? p.count_type : p.type];
+	}
+	if ( in.size() >= 0 &&
+	     elements[e].count > ( in.size() - in.offset() - min_bytes ) / ( item_bytes > 0 ? item_bytes : 1 ) ) {
+	    return fail_binary( in, err, "the file is shorter than its element counts" );
+	}
+	min_bytes += elements[e].count * item_bytes;
+    }
+    if ( (unsigned long long) ( base + vertex_count ) > 0xffffffffULL ) {
+	return fail_binary( in, err, "too many vertices" );
+    }
+    mesh.positions.resize( base + (size_t) vertex_count, vec4( 0.0, 0.0, 0.0, 1.0 ) );
+
+    unsigned char value[8];
+    std::vector<unsigned char> items;
+    std::vector<unsigned> polygon;
+    for ( size_t e = 0; e < elements.size(); e++ ) {
+	const PlyElement& element = elements[e];
+	bool vertices = ( element.name == "vertex" );
+	bool faces = ( element.name == "face" );
+	for ( long long i = 0; i < element.count; i++ ) {
+	    for ( size_t k = 0; k < element.properties.size(); k++ ) {
+		const PlyProperty& p = element.properties[k];
+		if ( !p.list ) {
+		    if ( !in.read( value, PlyTypeSize[p.type] ) ) {
+			return fail_binary( in, err, "unexpected end of file" );
+		    }
+		    if ( vertices && p.name.size() == 1 && p.name[0] >= 'x' && p.name[0] <= 'z' ) {
+			mesh.positions[base + (size_t) i][p.name[0] - 'x'] = (GLfloat) ply_value( value, p.type, big_endian );
+		    }
+		    continue;
+		}
+		if ( !in.read( value, PlyTypeSize[p.count_type] ) ) {
+		    return fail_binary( in, err, "unexpected end of file" );
+		}
+		double n = ply_value( value, p.count_type, big_endian );
+		if ( n < 0 ) { return fail_binary( in, err, "negative list size" ); }
+		if ( n > MaxPlyListSize ) { return fail_binary( in, err, "list is too long" ); }
+		size_t item_size = PlyTypeSize[p.type];
+		if ( in.size() >= 0 && (long long) ( (size_t) n * item_size ) > in.size() - in.offset() ) {
+		    return fail_binary( in, err, "unexpected end of file" );
+		}
+		items.resize( (size_t) n * item_size );
+		if ( n > 0 && !in.read( &items[0], items.size() ) ) {
+		    return fail_binary( in, err, "unexpected end of file" );
+		}
+		if ( !faces || ( p.name != "vertex_indices" && p.name != "vertex_index" ) ) { continue; }
+		if ( n < 3 ) { return fail_binary( in, err, "a face needs at least 3 vertices" ); }
+		polygon.clear();
+		for ( size_t j = 0; j < (size_t) n; j++ ) {
+		    double index = ply_value( &items[j * item_size], p.type, big_endian );
+		    if ( index < 0 || index >= (double) vertex_count || index != floor( index ) ) {
+			return fail_binary( in, err, "vertex index out of range" );
+		    }
+		    polygon.push_back( (unsigned) ( base + (size_t) index ) );
+		}
+		add_polygon( mesh, polygon );
+	    }
+	}
+    }
+    return true;
+}
+
+bool
+ImportSTL( const char* path, ImportedMesh& mesh, MeshParseError& err )
+{
+    StreamReader in;
+    if ( !open_source( in, path, err ) ) { return false; }
+
+    unsigned char header[84];
+    if ( !in.read( header, sizeof(header) ) ) { return fail_binary( in, err, "too short for an STL file" ); }
+    uint32_t count = load_le32( header + 80 );
+    if ( in.size() >= 0 && in.size() < 84 + 50 * (long long) count ) {
+	return fail_binary( in, err, memcmp( header, "solid", 5 ) == 0 ? "ASCII STL files are not supported"
+					: "the file is shorter than its triangle count" );
+    }
+
+    // Corners are welded on exact position, so the result shares vertices
+    // as the other formats do.
+    std::unordered_map<detail::PositionKey, unsigned, detail::PositionKeyHash> welded;
+    welded.reserve( (size_t) count / 2 + 16 );
+    mesh.indices.reserve( mesh.indices.size() + 3 * (size_t) count );
+    unsigned char triangle[50];       // normal, 3 corners, attribute bytes
+    for ( uint32_t t = 0; t < count; t++ ) {
+	if ( !in.read( triangle, sizeof(triangle) ) ) { return fail_binary( in, err, "unexpected end of file" ); }
+	for ( int k = 0; k < 3; k++ ) {
+	    const unsigned char* b = triangle + 12 + 12 * k;
+	    vec4 p( load_float( b ), load_float( b + 4 ), load_float( b + 8 ), 1.0 );
+	    std::pair<std::unordered_map<detail::PositionKey, unsigned, detail::PositionKeyHash>::iterator, bool> r =
+		welded.insert( std::make_pair( detail::position_key( p ), (unsigned) mesh.positions.size() ) );
+	    if ( r.second ) { mesh.positions.push_back( p ); }
+	    mesh.indices.push_back( r.first->second );
+	}
+    }
+    return true;
+}
+
+bool
+ImportMeshFile( const char* path, ImportedMesh& mesh, MeshParseError& err )
+{
+    switch ( MeshFormatOf( path ) ) {
+	case MeshFormatOBJ: return ImportOBJ( path, mesh, err );
+	case MeshFormatPLY: return ImportPLY( path, mesh, err );
+	case MeshFormatSTL: return ImportSTL( path, mesh, err );
+	default:
+	    err.line = 0;
+	    err.column = 0;
+	    strncpy( err.message, "not an OBJ, PLY or STL file", sizeof(err.message) );
+	    return false;
+    }
+}
+
+//----------------------------------------------------------------------------
+//
+//  Binary mesh cache
+//
+
+namespace {
+
+const char      MeshCacheMagic[8] = { 'A', 'N', 'G', 'L', 'M', 'E', 'S', 'H' };
+const uint32_t  MeshCacheVersion = 3;
+const uint32_t  MeshCacheByteOrder = 0x01020304;
+const int       MaxCacheMeshes = 8;
+
+enum {
+    StreamBounds = 1,             // scale and bias, 6 floats
+    StreamVertices = 2,           // PackedVertex's
+    StreamIndices16 = 3,          // GLushort's
+    StreamIndices32 = 4,          // GLuint's
+    StreamMeshlets = 5            // Meshlet's
+};
+
+struct MeshCacheHeader {          // 64 bytes
+    char      magic[8];
+    uint32_t  version;
+    uint32_t  byte_order;
+    uint64_t  source_size;
+    int64_t   source_mtime;       // seconds since the epoch
+    uint64_t  source_hash;
+    uint64_t  producer_key;       // see MeshCacheKey()
+    uint64_t  checksum;           // stream table + streams
+    uint32_t  stream_count;
+    uint32_t  reserved;
+};
+
+struct MeshCacheStream {          // 24 bytes
+    uint32_t  attribute;          // StreamBounds, ...
+    uint32_t  mesh;               // 0 for StreamBounds
+    uint64_t  offset;             // from the start of the file
+    uint64_t  bytes;
+};
+
+static_assert( sizeof(MeshCacheHeader) == 64 && sizeof(MeshCacheStream) == 24 &&
+	       sizeof(PackedVertex) == 12 && sizeof(Meshlet) == 40,
+	       "the mesh cache layout must not depend on the compiler" );
+
+// 64-bit hash, 8 bytes per step.  "seed" chains several ranges.
+uint64_t
+hash_bytes( const void* data, size_t size, uint64_t seed )
+{
+    const uint64_t k = 0x9E3779B97F4A7C15ULL;
+    const unsigned char* p = (const unsigned char*) data;
+    uint64_t h = seed ^ ( size * k );
+
+    for ( ; size >= 8; size -= 8, p += 8 ) {
+	uint64_t w;
+	memcpy( &w, p, 8 );
+	h = ( h ^ ( w * k ) ) * 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 32;
+    }
+    uint64_t tail = 0;
+    memcpy( &tail, p, size );
+    h = ( h ^ ( tail * k ) ) * 0xC4CEB9FE1A85EC53ULL;
+    return h ^ ( h >> 29 );
+}
+
+bool
+file_stamp( const char* path, uint64_t& size, int64_t& mtime )
+{
+#ifdef _WIN32
+    struct _stat64 st;
+    if ( _stat64( path, &st ) != 0 ) { return false; }
+#else
+    struct stat st;
+    if ( stat( path, &st ) != 0 ) { return false; }
+#endif
+    size = (uint64_t) st.st_size;
+    mtime = (int64_t) st.st_mtime;
+    return true;
+}
+
+bool
+source_hash( const char* path, uint64_t& hash )
+{
+    MappedFile file;
+    if ( !file.open( path ) ) { return false; }
+    hash = hash_bytes( file.data(), file.size(), 0 );
+    return true;
+}
+
+size_t
+align16( size_t n )
+{
+    return ( n + 15 ) & ~(size_t) 15;
+}
+
+}  // namespace
+
+std::string
+MeshCachePath( const char* source_path )
+{
+    return std::string( source_path ) + ".meshcache";
+}
+
+uint64_t
+MeshCacheKey( const void* data, size_t size, uint64_t key )
+{
+    return hash_bytes( data, size, key );
+}
+
+bool
+WriteMeshCache( const char* cache_path, const char* source_path,
+		const PackedMesh* meshes, int mesh_count,
+		const vec3& position_scale, const vec3& position_bias,
+		uint64_t producer_key )
+{
+    if ( mesh_count < 0 || mesh_count > MaxCacheMeshes ) { return false; }
+
+    MeshCacheHeader header;
+    memset( &header, 0, sizeof(header) );
+    memcpy( header.magic, MeshCacheMagic, sizeof(header.magic) );
+    header.version = MeshCacheVersion;
+    header.byte_order = MeshCacheByteOrder;
+    header.producer_key = producer_key;
+    if ( !file_stamp( source_path, header.source_size, header.source_mtime ) ||
+	 !source_hash( source_path, header.source_hash ) ) {
+	return false;
+    }
+
+    // The box, then the vertices, indices and meshlets of every mesh.
+    GLfloat bounds[6] = { position_scale.x, position_scale.y, position_scale.z,
+			  position_bias.x, position_bias.y, position_bias.z };
+    MeshCacheStream streams[1 + 3 * MaxCacheMeshes];
+    const void* data[1 + 3 * MaxCacheMeshes];
+    int n = 0;
+    streams[n].attribute = StreamBounds;
+    streams[n].mesh = 0;
+    streams[n].bytes = sizeof(bounds);
+    data[n++] = bounds;
+    for ( int m = 0; m < mesh_count; m++ ) {
+	const PackedMesh& mesh = meshes[m];
+	streams[n].attribute = StreamVertices;
+	streams[n].bytes = (uint64_t) mesh.vertex_count * sizeof(PackedVertex);
+	data[n++] = mesh.vertices;
+	streams[n].attribute = mesh.index_type == GL_UNSIGNED_SHORT ? StreamIndices16 : StreamIndices32;
+	streams[n].bytes = (uint64_t) mesh.index_count * mesh.index_size();
+	data[n++] = mesh.indices;
+	streams[n].attribute = StreamMeshlets;
+	streams[n].bytes = (uint64_t) mesh.meshlets.size() * sizeof(Meshlet);
+	data[n++] = mesh.meshlets.empty() ? NULL : &mesh.meshlets[0];
+	for ( int k = n - 3; k < n; k++ ) { streams[k].mesh = (uint32_t) m; }
+    }
+    header.stream_count = (uint32_t) n;
+    static const char zeros[16] = { 0 };
+    for ( int i = 0; i < n; i++ ) {
+	data[i] = streams[i].bytes > 0 ? data[i] : zeros;     // never NULL
+    }
+
+    size_t at = sizeof(header) + n * sizeof(MeshCacheStream);
+    for ( int i = 0; i < n; i++ ) {
+	streams[i].offset = align16( at );
+	at = (size_t) ( streams[i].offset + streams[i].bytes );
+    }
+    uint64_t h = hash_bytes( streams, n * sizeof(MeshCacheStream), 0 );
+    for ( int i = 0; i < n; i++ ) {
+	h = hash_bytes( data[i], (size_t) streams[i].bytes, h );
+    }
+    header.checksum = h;
+
+    // Write a temporary file and rename it, so that a reader never sees a
+    // half-written cache.
+    std::string tmp = std::string( cache_path ) + ".tmp";
+    FILE* fp = fopen( tmp.c_str(), "wb" );
+    if ( fp == NULL ) { return false; }
+
+    at = sizeof(header) + n * sizeof(MeshCacheStream);
+    bool ok = fwrite( &header, sizeof(header), 1, fp ) == 1 &&
+	      fwrite( streams, sizeof(MeshCacheStream), n, fp ) == (size_t) n;
+    for ( int i = 0; i < n && ok; i++ ) {
+	ok = fwrite( zeros, 1, (size_t) streams[i].offset - at, fp ) == (size_t) streams[i].offset - at &&
+	     fwrite( data[i], 1, (size_t) streams[i].bytes, fp ) == (size_t) streams[i].bytes;
+	at = (size_t) ( streams[i].offset + streams[i].bytes );
+    }
+    ok = ( fclose( fp ) == 0 ) && ok;
+
+#ifdef _WIN32
+    ok = ok && MoveFileExA( tmp.c_str(), cache_path, MOVEFILE_REPLACE_EXISTING );
+#else
+    ok = ok && rename( tmp.c_str(), cache_path ) == 0;
+#endif
+    if ( !ok ) { remove( tmp.c_str() ); }
+    return ok;
+}
+
+bool
+MeshCache::open( const char* cache_path, const char* source_path, uint64_t producer_key )
+{
+    close();
+
+    uint64_t size;
+    int64_t mtime;
+    if ( !file_stamp( source_path, size, mtime ) || !_file.open( cache_path ) ) {
+	return false;
+    }
+
+    const char* data = _file.data();
+    size_t file_size = _file.size();
+    MeshCacheHeader header;
+    if ( file_size < sizeof(header) ) { close();  return false; }
+    memcpy( &header, data, sizeof(header) );
+
+    if ( memcmp( header.magic, MeshCacheMagic, sizeof(header.magic) ) != 0 ||
+	 header.version != MeshCacheVersion ||
+	 header.byte_order != MeshCacheByteOrder ||
+	 header.producer_key != producer_key ||
+	 header.source_size != size ||
+	 header.stream_count == 0 || header.stream_count > 1 + 3 * MaxCacheMeshes ||
+	 sizeof(header) + header.stream_count * sizeof(MeshCacheStream) > file_size ) {
+	close();
+	return false;
+    }
+
+    // Touched or copied but not changed: compare the content.
+    uint64_t hash;
+    if ( header.source_mtime != mtime &&
+	 ( !source_hash( source_path, hash ) || hash != header.source_hash ) ) {
+	close();
+	return false;
+    }
+
+    // Every mesh needs its vertices and its indices; meshlets are optional.
+    const MeshCacheStream* streams = (const MeshCacheStream*) ( data + sizeof(header) );
+    uint64_t h = hash_bytes( streams, header.stream_count * sizeof(MeshCacheStream), 0 );
+    const GLfloat* bounds = NULL;
+    PackedMesh meshes[MaxCacheMeshes];
+    int mesh_count = 0;
+    bool valid = true;
+    for ( uint32_t i = 0; i < header.stream_count && valid; i++ ) {
+	const MeshCacheStream& s = streams[i];
+	if ( s.offset % 16 != 0 || s.offset > file_size || s.bytes > file_size - s.offset ||
+	     s.mesh >= (uint32_t) MaxCacheMeshes ) {
+	    valid = false;
+	    break;
+	}
+	h = hash_bytes( data + s.offset, (size_t) s.bytes, h );
+	const char* p = data + s.offset;
+	PackedMesh& mesh = meshes[s.mesh];
+	mesh_count = (int) s.mesh + 1 > mesh_count ? (int) s.mesh + 1 : mesh_count;
+	switch ( s.attribute ) {
+	case StreamBounds:
+	    valid = s.bytes == 6 * sizeof(GLfloat);
+	    bounds = (const GLfloat*) p;
+	    break;
+	case StreamVertices:
+	    valid = s.bytes % sizeof(PackedVertex) == 0 &&
+		    s.bytes / sizeof(PackedVertex) <= (uint64_t) MaxMeshVertices;
+	    mesh.vertices = (const PackedVertex*) p;
+	    mesh.vertex_count = (int) ( s.bytes / sizeof(PackedVertex) );
+	    break;
+	case StreamIndices16:
+	case StreamIndices32:
+	    mesh.index_type = s.attribute == StreamIndices16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	    valid = s.bytes % ( 3 * mesh.index_size() ) == 0 &&
+		    s.bytes / mesh.index_size() <= (uint64_t) MaxMeshVertices;
+	    mesh.indices = p;
+	    mesh.index_count = (int) ( s.bytes / mesh.index_size() );
+	    break;
+	case StreamMeshlets:
+	    valid = s.bytes % sizeof(Meshlet) == 0;
+	    mesh.meshlets.assign( (const Meshlet*) p, (const Meshlet*) ( p + s.bytes ) );
+	    break;
+	default:                            // from a later version: skipped
+	    break;
+	}
+    }
+    for ( int m = 0; m < mesh_count && valid; m++ ) {
+	const PackedMesh& mesh = meshes[m];
+	valid = mesh.vertices != NULL && mesh.indices != NULL;
+	for ( size_t k = 0; k < mesh.meshlets.size() && valid; k++ ) {
+	    const Meshlet& ml = mesh.meshlets[k];
+	    valid = ml.first_index >= 0 && ml.index_count >= 0 && ml.first_index <= mesh.index_count - ml.index_count;
+	}
+    }
+    if ( !valid || h != header.checksum || bounds == NULL ) {
+	close();
+	return false;
+    }
+
+    _meshes.assign( meshes, meshes + mesh_count );
+    _position_scale = vec3( bounds[0], bounds[1], bounds[2] );
+    _position_bias = vec3( bounds[3], bounds[4], bounds[5] );
+    return true;
+}
+
+void
+MeshCache::close()
+{
+    _file.close();
+    _meshes.clear();
+}
+
+}  // namespace Angel
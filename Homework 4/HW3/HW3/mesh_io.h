@@ -0,0 +1,218 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- mesh_io.h ---
+//
+//   Loading of the polygon files used for the sphere (sphere.8 ...
+//   sphere.1024), which have the form
+//
+//       numPolygons
+//       n                  <- number of vertices of polygon 1
+//       x y z              <- n lines of vertex coordinates
+//       ...
+//       n                  <- polygon 2, and so on
+//       ...
+//
+//   The file is memory-mapped and parsed in place: no stream extraction,
+//   no locale and no allocation per number.  Errors are reported with the
+//   line and column where parsing stopped.
+//
+//   OBJ, PLY and STL files are imported with streaming readers instead
+//   (see "Asset importers" below).
+//
+//   What the mesh pipeline makes of a file (its PackedMesh's, see mesh.h)
+//   can be saved in a binary cache file next to the source
+//   (MeshCachePath()); later runs map the cache and hand its vertices and
+//   indices straight to glBufferSubData() instead of parsing, welding,
+//   optimizing and packing again.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ANGEL_MESH_IO_H__
+#define __ANGEL_MESH_IO_H__
+
+#include "Angel-yjc.h"
+#include "mesh.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace Angel {
+
+//----------------------------------------------------------------------------
+//
+//  MappedFile - a whole file, mapped read-only into memory
+//
+
+class MappedFile {
+
+    const char*  _data;
+    size_t       _size;
+#ifdef _WIN32
+    void*        _file;       // HANDLE's, kept as void* to keep <windows.h>
+    void*        _mapping;    // out of this header
+#else
+    int          _fd;
+#endif
+
+    MappedFile( const MappedFile& );             // not copyable
+    MappedFile& operator = ( const MappedFile& );
+
+   public:
+    MappedFile();
+    ~MappedFile();
+
+    // Returns false (and leaves the object empty) if the file cannot be
+    // opened or mapped.
+    bool open( const char* path );
+    void close();
+
+    const char* data() const { return _data; }   // not NUL-terminated
+    size_t size() const { return _size; }
+};
+
+//----------------------------------------------------------------------------
+//
+//  Polygon files
+//
+
+struct MeshParseError {
+    int   line;               // 1-based; 0 if the file could not be read
+                              // or the error is in binary data
+    int   column;             // 1-based
+    char  message[128];
+};
+
+// Parses "size" bytes of polygon-file text.  Every polygon is fanned into
+// triangles, which are appended to "positions" (3 vertices per triangle);
+// "normals" gets the polygon's flat normal, normalize((b - a) x (c - b)) of
+// its first 3 vertices, once per appended vertex.
+// Returns false and fills in "err" on malformed input.
+bool ParsePolygonFile( const char* text, size_t size,
+		       std::vector<vec3>& positions, std::vector<vec3>& normals,
+		       MeshParseError& err );
+
+// The same, appending to "mesh", which is sized from the polygon count in
+// the file's first line (so any number of vertices fits).  With a pool of
+// more than one thread, files of 8 MB and up are cut into chunks at
+// polygon boundaries that are parsed in parallel, with the same result.
+bool ParsePolygonFile( const char* text, size_t size, Mesh& mesh, MeshParseError& err,
+		       ThreadPool* pool = NULL );
+
+// Maps the file at "path" and parses it with ParsePolygonFile().
+bool LoadPolygonFile( const char* path,
+		      std::vector<vec3>& positions, std::vector<vec3>& normals,
+		      MeshParseError& err );
+bool LoadPolygonFile( const char* path, Mesh& mesh, MeshParseError& err,
+		      ThreadPool* pool = NULL );
+
+//----------------------------------------------------------------------------
+//
+//  Asset importers
+//
+//  Wavefront OBJ, binary PLY (either byte order) and binary STL files are
+//  read through a fixed 64 KB buffer, so parsing memory does not grow with
+//  the file; only the output does.  Polygons are fanned into triangles,
+//  and the result is indexed: OBJ and PLY keep the file's vertices, STL
+//  triangles are welded on exact position.  Normals, texture coordinates
+//  and other attributes in the file are skipped; the mesh pipeline derives
+//  its own normals.  Errors in text (OBJ lines, the PLY header) have a
+//  line and column, errors in binary data line 0 and the byte offset in
+//  the message.
+//
+
+enum MeshFileFormat {
+    MeshFormatPolygons,       // the course's format, see above
+    MeshFormatOBJ,
+    MeshFormatPLY,
+    MeshFormatSTL
+};
+
+// From the extension (.obj, .ply, .stl, in any case); anything else is
+// taken to be a polygon file.
+MeshFileFormat MeshFormatOf( const char* path );
+
+struct ImportedMesh {
+    std::vector<vec4>      positions;      // w = 1
+    std::vector<unsigned>  indices;        // 3 per triangle
+
+    // Appends the triangles to "mesh" as a polygon file would give them,
+    // with flat normals normalize((b - a) x (c - b)); zero if degenerate.
+    void unroll( Mesh& mesh ) const;
+};
+
+// Each appends to "mesh"; false and "err" filled in on malformed input.
+bool ImportOBJ( const char* path, ImportedMesh& mesh, MeshParseError& err );
+bool ImportPLY( const char* path, ImportedMesh& mesh, MeshParseError& err );
+bool ImportSTL( const char* path, ImportedMesh& mesh, MeshParseError& err );
+
+// The importer for MeshFormatOf( path ); polygon files are not imported.
+bool ImportMeshFile( const char* path, ImportedMesh& mesh, MeshParseError& err );
+
+//----------------------------------------------------------------------------
+//
+//  Binary mesh cache
+//
+//  The final GPU data of one level of detail: the PackedMesh's drawn for
+//  it (e.g. flat, smooth and shadow) and the box that their positions are
+//  packed in, which they share.
+//
+//  Layout (native byte order, which is recorded and checked):
+//      64-byte header: magic "ANGLMESH", version, byte-order mark,
+//                      size, mtime and hash of the source file,
+//                      producer key, checksum, number of streams
+//      stream table:   (attribute, mesh, offset, bytes) per stream
+//      streams:        16-byte aligned: the box (scale and bias), and per
+//                      mesh its PackedVertex's, its 16- or 32-bit indices
+//                      and its Meshlets
+//  The checksum covers the stream table and the streams.  A cache is used
+//  only if its source still has the recorded size and either the same
+//  mtime or the same content hash, and if it has the same producer key:
+//  everything besides the source that the meshes were made with, i.e. the
+//  versions of the code (PackedMeshVersion, SimplifyMeshVersion for a
+//  simplified level, ...) and its parameters (the crease angle, ...),
+//  chained with MeshCacheKey().
+//
+
+// "sphere.1024" -> "sphere.1024.meshcache"
+std::string MeshCachePath( const char* source_path );
+
+// Chains "size" bytes of a version or parameter onto a producer key:
+//     uint64_t key = MeshCacheKey( &PackedMeshVersion, sizeof(unsigned) );
+//     key = MeshCacheKey( &crease_angle, sizeof(GLfloat), key );
+uint64_t MeshCacheKey( const void* data, size_t size, uint64_t key = 0 );
+
+// Writes the cache of the "mesh_count" meshes made from "source_path"
+// (via a temporary file that is renamed into place).  Returns false if it
+// cannot be written.
+bool WriteMeshCache( const char* cache_path, const char* source_path,
+		     const PackedMesh* meshes, int mesh_count,
+		     const vec3& position_scale, const vec3& position_bias,
+		     uint64_t producer_key );
+
+class MeshCache {
+
+    MappedFile               _file;
+    std::vector<PackedMesh>  _meshes;
+    vec3                     _position_scale;
+    vec3                     _position_bias;
+
+   public:
+    // Maps the cache and validates it against "source_path" and the
+    // producer key.  Returns false if it is missing, stale or damaged; the
+    // caller then makes the meshes from the source.
+    bool open( const char* cache_path, const char* source_path, uint64_t producer_key );
+
+    // Unmaps the cache (once its meshes are uploaded).
+    void close();
+
+    int mesh_count() const { return (int) _meshes.size(); }
+    // Its vertices and indices point into the mapping.
+    const PackedMesh& mesh( int i ) const { return _meshes[i]; }
+    const vec3& position_scale() const { return _position_scale; }
+    const vec3& position_bias() const { return _position_bias; }
+};
+
+}  // namespace Angel
+
+#endif // __ANGEL_MESH_IO_H__
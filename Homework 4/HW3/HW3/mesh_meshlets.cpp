@@ -0,0 +1,254 @@
+#include <math.h>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+#include "mesh_detail.h"
+
+namespace Angel {
+
+//----------------------------------------------------------------------------
+//
+//  IndexedMesh - meshlets and their culling
+//
+
+namespace {
+
+using detail::PositionKey;
+using detail::PositionKeyHash;
+using detail::position_key;
+
+inline vec3
+xyz( const vec4& p )
+{
+    return vec3( p.x, p.y, p.z );
+}
+
+}  // namespace
+
+//  --- Building ---
+//
+//  Meshlets are grown greedily: a seed (the first triangle left, in the
+//  current order, so that the order of optimize_overdraw() is roughly
+//  kept) and then, among the triangles touching the meshlet, the one that
+//  shares the most positions with it, ties going to the one whose normal
+//  is closest to the meshlet's mean.  This keeps meshlets compact and
+//  their normal cones narrow.
+
+void
+IndexedMesh::build_meshlets( int max_triangles, int cache_size )
+{
+    _meshlets.clear();
+    int triangle_count = _index_count / 3;
+    if ( triangle_count == 0 ) { return; }
+
+    std::vector<unsigned> in( (size_t) _index_count );
+    for ( int i = 0; i < _index_count; ++i ) { in[i] = index( i ); }
+
+    // Position of each corner, and the triangles around each position.
+    std::vector<int> corner_position( (size_t) _index_count );
+    int position_count = 0;
+    {
+	std::unordered_map<PositionKey, int, PositionKeyHash> positions;
+	positions.reserve( (size_t) _vertex_count );
+	std::vector<int> vertex_position( (size_t) _vertex_count );
+	for ( int v = 0; v < _vertex_count; ++v ) {
+	    std::pair<std::unordered_map<PositionKey, int, PositionKeyHash>::iterator, bool> r =
+		positions.insert( std::make_pair( position_key( _points[v] ), position_count ) );
+	    if ( r.second ) { ++position_count; }
+	    vertex_position[v] = r.first->second;
+	}
+	for ( int i = 0; i < _index_count; ++i ) { corner_position[i] = vertex_position[in[i]]; }
+    }
+    std::vector<int> offsets( (size_t) position_count + 1, 0 ), around( (size_t) _index_count );
+    for ( int i = 0; i < _index_count; ++i ) { ++offsets[corner_position[i] + 1]; }
+    for ( int p = 0; p < position_count; ++p ) { offsets[p + 1] += offsets[p]; }
+    {
+	std::vector<int> fill( offsets.begin(), offsets.end() - 1 );
+	for ( int i = 0; i < _index_count; ++i ) { around[fill[corner_position[i]]++] = i / 3; }
+    }
+
+    std::vector<vec3> face_normal( (size_t) triangle_count );
+    for ( int t = 0; t < triangle_count; ++t ) {
+	vec3 a = xyz( _points[in[3 * t]] ), b = xyz( _points[in[3 * t + 1]] ), c = xyz( _points[in[3 * t + 2]] );
+	vec3 n = cross( b - a, c - b );
+	GLfloat len = length( n );
+	face_normal[t] = len > 0.0f ? n / len : vec3( 0.0, 0.0, 0.0 );
+    }
+
+    std::vector<char> emitted( (size_t) triangle_count, 0 );
+    std::vector<int> queued( (size_t) triangle_count, -1 );       // meshlet it is a candidate of
+    std::vector<int> member( (size_t) position_count, -1 );       // meshlet it is in
+    std::vector<int> candidates, members;
+    std::vector<int> local_index( (size_t) _vertex_count, -1 );
+    std::vector<unsigned> vertices, local, local_out( 3 * (size_t) max_triangles );
+    std::vector<unsigned> out;
+    out.reserve( (size_t) _index_count );
+
+    int cursor = 0;
+    while ( true ) {
+	while ( cursor < triangle_count && emitted[cursor] ) { ++cursor; }
+	if ( cursor == triangle_count ) { break; }
+
+	int m = (int) _meshlets.size();
+	Meshlet meshlet;
+	meshlet.first_index = (int) out.size();
+	vec3 normal_sum( 0.0, 0.0, 0.0 );
+	candidates.clear();
+	members.clear();
+
+	int t = cursor;
+	int size = 0;
+	while ( t >= 0 ) {
+	    emitted[t] = 1;
+	    ++size;
+	    normal_sum += face_normal[t];
+	    members.push_back( t );
+	    for ( int k = 0; k < 3; ++k ) {
+		int p = corner_position[3 * t + k];
+		member[p] = m;
+		for ( int a = offsets[p]; a < offsets[p + 1]; ++a ) {
+		    int c = around[a];
+		    if ( emitted[c] || queued[c] == m ) { continue; }
+		    queued[c] = m;
+		    candidates.push_back( c );
+		}
+	    }
+	    if ( size == max_triangles ) { break; }
+
+	    // the best candidate; emitted ones are dropped on the way
+	    GLfloat len = length( normal_sum );
+	    vec3 mean = len > 0.0f ? normal_sum / len : vec3( 0.0, 0.0, 0.0 );
+	    t = -1;
+	    GLfloat best = -1e30f;
+	    size_t kept = 0;
+	    for ( size_t i = 0; i < candidates.size(); ++i ) {
+		int c = candidates[i];
+		if ( emitted[c] ) { continue; }
+		candidates[kept++] = c;
+		int shared = ( member[corner_position[3 * c]] == m ) + ( member[corner_position[3 * c + 1]] == m )
+			   + ( member[corner_position[3 * c + 2]] == m );
+		GLfloat score = 4.0f * shared + dot( face_normal[c], mean );
+		if ( score > best ) {
+		    best = score;
+		    t = c;
+		}
+	    }
+	    candidates.resize( kept );
+	}
+	// Growing ignores the vertex cache, so each meshlet is run through
+	// Tipsify again, with its vertices numbered locally.
+	local.clear();
+	for ( size_t i = 0; i < members.size(); ++i ) {
+	    for ( int k = 0; k < 3; ++k ) {
+		unsigned v = in[3 * members[i] + k];
+		if ( local_index[v] < 0 ) {
+		    local_index[v] = (int) vertices.size();
+		    vertices.push_back( v );
+		}
+		local.push_back( (unsigned) local_index[v] );
+	    }
+	}
+	tipsify( &local[0], (int) local.size(), (int) vertices.size(), cache_size, &local_out[0] );
+	for ( size_t i = 0; i < local.size(); ++i ) { out.push_back( vertices[local_out[i]] ); }
+	for ( size_t i = 0; i < vertices.size(); ++i ) { local_index[vertices[i]] = -1; }
+	vertices.clear();
+	meshlet.index_count = (int) out.size() - meshlet.first_index;
+
+	// Bounding sphere around the center of the bounding box, and the
+	// normal cone around the mean normal.
+	const unsigned* indices = &out[meshlet.first_index];
+	vec3 lo = xyz( _points[indices[0]] ), hi = lo;
+	for ( int i = 1; i < meshlet.index_count; ++i ) {
+	    const vec4& p = _points[indices[i]];
+	    lo.x = p.x < lo.x ? p.x : lo.x;  hi.x = p.x > hi.x ? p.x : hi.x;
+	    lo.y = p.y < lo.y ? p.y : lo.y;  hi.y = p.y > hi.y ? p.y : hi.y;
+	    lo.z = p.z < lo.z ? p.z : lo.z;  hi.z = p.z > hi.z ? p.z : hi.z;
+	}
+	meshlet.center = 0.5 * ( lo + hi );
+	meshlet.radius = 0.0;
+	for ( int i = 0; i < meshlet.index_count; ++i ) {
+	    GLfloat d = length( xyz( _points[indices[i]] ) - meshlet.center );
+	    meshlet.radius = d > meshlet.radius ? d : meshlet.radius;
+	}
+
+	GLfloat len = length( normal_sum );
+	meshlet.cone_axis = len > 0.0f ? normal_sum / len : vec3( 0.0, 0.0, 1.0 );
+	GLfloat min_dot = len > 1e-3f ? 1.0f : -1.0f;
+	for ( int i = 0; i < meshlet.index_count; i += 3 ) {
+	    vec3 a = xyz( _points[indices[i]] ), b = xyz( _points[indices[i + 1]] ), c = xyz( _points[indices[i + 2]] );
+	    vec3 n = cross( b - a, c - b );
+	    GLfloat n_len = length( n );
+	    if ( n_len == 0.0f ) { continue; }      // degenerate, never drawn
+	    GLfloat d = dot( n / n_len, meshlet.cone_axis );
+	    min_dot = d < min_dot ? d : min_dot;
+	}
+	meshlet.cone_angle = acosf( min_dot < -1.0f ? -1.0f : min_dot );
+	_meshlets.push_back( meshlet );
+    }
+
+    set_indices( &out[0] );
+}
+
+//  --- Culling ---
+//
+//  A meshlet is outside the frustum if its bounding sphere is entirely
+//  behind one of the six planes of "mvp" (Gribb and Hartmann's
+//  extraction; the planes are in object space).  It is back-facing if
+//  every view direction from "eye" to its bounding sphere makes an angle
+//  below 90 degrees with every normal in its cone: the angle between the
+//  direction to the center and the axis, plus the cone's half-angle, plus
+//  the sphere's half-angle seen from the eye, must stay below 90 degrees.
+
+void
+CullMeshlets( const std::vector<Meshlet>& meshlets, size_t index_size, const mat4& mvp, const vec3& eye,
+	      bool cull_backfaces, MeshletDraws& draws )
+{
+    draws.counts.clear();
+    draws.offsets.clear();
+    draws.triangles = 0;
+    draws.culled_triangles = 0;
+
+    vec4 planes[6];
+    for ( int i = 0; i < 3; ++i ) {
+	planes[2 * i]     = mvp[3] + mvp[i];
+	planes[2 * i + 1] = mvp[3] - mvp[i];
+    }
+    for ( int i = 0; i < 6; ++i ) {
+	GLfloat len = length( vec3( planes[i].x, planes[i].y, planes[i].z ) );
+	if ( len > 0.0f ) { planes[i] /= len; }
+    }
+
+    int next_index = -1;     // where the last draw ends, to merge with it
+    for ( size_t m = 0; m < meshlets.size(); ++m ) {
+	const Meshlet& meshlet = meshlets[m];
+	const vec3& c = meshlet.center;
+	bool visible = true;
+	for ( int i = 0; i < 6 && visible; ++i ) {
+	    visible = planes[i].x * c.x + planes[i].y * c.y + planes[i].z * c.z + planes[i].w >= -meshlet.radius;
+	}
+	if ( visible && cull_backfaces && meshlet.cone_angle < 0.5 * M_PI ) {
+	    vec3 d = c - eye;
+	    GLfloat distance = length( d );
+	    if ( distance > meshlet.radius ) {
+		GLfloat spread = meshlet.cone_angle + asinf( meshlet.radius / distance );
+		visible = spread >= 0.5 * M_PI || dot( d, meshlet.cone_axis ) <= distance * sinf( spread );
+	    }
+	}
+
+	if ( !visible ) {
+	    draws.culled_triangles += meshlet.index_count / 3;
+	    continue;
+	}
+	draws.triangles += meshlet.index_count / 3;
+	if ( meshlet.first_index == next_index ) {
+	    draws.counts.back() += meshlet.index_count;
+	} else {
+	    draws.counts.push_back( meshlet.index_count );
+	    draws.offsets.push_back( (const GLvoid*) ( meshlet.first_index * index_size ) );
+	}
+	next_index = meshlet.first_index + meshlet.index_count;
+    }
+}
+
+}  // namespace Angel
@@ -0,0 +1,137 @@
+#include <math.h>
+#include <vector>
+
+#include "mesh.h"
+
+namespace Angel {
+
+//----------------------------------------------------------------------------
+//
+//  IndexedMesh - smooth normals
+//
+
+namespace {
+
+// Runs body(begin, end) over [0, n), on the pool if there is one.
+template <class Body>
+void
+for_ranges( ThreadPool* pool, int n, int grain, const Body& body )
+{
+    if ( pool ) {
+	pool->parallel_for( 0, n, grain, body );
+    } else {
+	body( 0, n );
+    }
+}
+
+inline GLfloat
+corner_angle( GLfloat ux, GLfloat uy, GLfloat uz, GLfloat vx, GLfloat vy, GLfloat vz )
+{
+    GLfloat uu = ux * ux + uy * uy + uz * uz;
+    GLfloat vv = vx * vx + vy * vy + vz * vz;
+    if ( uu == 0.0f || vv == 0.0f ) { return 0.0f; }
+    GLfloat c = ( ux * vx + uy * vy + uz * vz ) / sqrtf( uu * vv );
+    c = c < -1.0f ? -1.0f : ( c > 1.0f ? 1.0f : c );
+    return acosf( c );
+}
+
+}  // namespace
+
+void
+IndexedMesh::build_smooth( const vec4* points, int count, GLfloat crease_angle,
+			   NormalWeight weight, ThreadPool* pool )
+{
+    // Shared positions first, so that faces meeting at a vertex are found
+    // through its index even if the input repeats the vertex per face.
+    IndexedMesh welded;
+    welded.build( points, NULL, count - count % 3, false );
+    build_smooth( welded, crease_angle, weight, pool );
+}
+
+void
+IndexedMesh::build_smooth( const IndexedMesh& welded, GLfloat crease_angle, NormalWeight weight,
+			   ThreadPool* pool )
+{
+    int triangle_count = welded.index_count() / 3;
+    int count = 3 * triangle_count;
+    if ( count == 0 ) {
+	build( welded.points(), NULL, 0, false );
+	return;
+    }
+
+    int vertex_count = welded.vertex_count();
+    std::vector<int> corner_vertex( (size_t) count );
+    for ( int c = 0; c < count; ++c ) { corner_vertex[c] = (int) welded.index( c ); }
+    const vec4* p = welded.points();
+
+    // Unit face normals (separate x/y/z arrays, for vectorized loops) and
+    // the weight of each corner.
+    std::vector<GLfloat> fx( (size_t) triangle_count ), fy( (size_t) triangle_count ),
+			 fz( (size_t) triangle_count ), w( (size_t) count );
+    for_ranges( pool, triangle_count, 4096, [&]( int begin, int end ) {
+	for ( int t = begin; t < end; ++t ) {
+	    const vec4& a = p[corner_vertex[3 * t]];
+	    const vec4& b = p[corner_vertex[3 * t + 1]];
+	    const vec4& c = p[corner_vertex[3 * t + 2]];
+	    GLfloat abx = b.x - a.x, aby = b.y - a.y, abz = b.z - a.z;
+	    GLfloat bcx = c.x - b.x, bcy = c.y - b.y, bcz = c.z - b.z;
+	    GLfloat cax = a.x - c.x, cay = a.y - c.y, caz = a.z - c.z;
+
+	    // (b - a) x (c - b), as the polygon files' face normals are
+	    GLfloat nx = aby * bcz - abz * bcy;
+	    GLfloat ny = abz * bcx - abx * bcz;
+	    GLfloat nz = abx * bcy - aby * bcx;
+	    GLfloat area = sqrtf( nx * nx + ny * ny + nz * nz );
+	    GLfloat inv = area > 0.0f ? 1.0f / area : 0.0f;
+	    fx[t] = nx * inv;
+	    fy[t] = ny * inv;
+	    fz[t] = nz * inv;
+
+	    if ( weight == NormalWeightArea ) {
+		w[3 * t] = w[3 * t + 1] = w[3 * t + 2] = area;
+	    } else {
+		w[3 * t]     = corner_angle( abx, aby, abz, -cax, -cay, -caz );
+		w[3 * t + 1] = corner_angle( bcx, bcy, bcz, -abx, -aby, -abz );
+		w[3 * t + 2] = corner_angle( cax, cay, caz, -bcx, -bcy, -bcz );
+	    }
+	}
+    } );
+
+    // The corners around each vertex (compressed rows).
+    std::vector<int> offsets( (size_t) vertex_count + 1, 0 ), corners( (size_t) count );
+    for ( int c = 0; c < count; ++c ) { ++offsets[corner_vertex[c] + 1]; }
+    for ( int v = 0; v < vertex_count; ++v ) { offsets[v + 1] += offsets[v]; }
+    {
+	std::vector<int> fill( offsets.begin(), offsets.end() - 1 );
+	for ( int c = 0; c < count; ++c ) { corners[fill[corner_vertex[c]]++] = c; }
+    }
+
+    // Each corner averages the faces around its vertex within the crease
+    // angle.  They are always summed in the same order, so corners with
+    // the same set of faces get bit-identical normals and weld below.
+    GLfloat cos_crease = crease_angle >= 180.0 ? -2.0f : (GLfloat) cos( crease_angle * DegreesToRadians );
+    std::vector<vec3> normals( (size_t) count );
+    for_ranges( pool, count, 8192, [&]( int begin, int end ) {
+	for ( int c = begin; c < end; ++c ) {
+	    int t = c / 3;
+	    int v = corner_vertex[c];
+	    GLfloat sx = 0.0f, sy = 0.0f, sz = 0.0f;
+	    for ( int k = offsets[v]; k < offsets[v + 1]; ++k ) {
+		int o = corners[k];
+		int f = o / 3;
+		if ( fx[t] * fx[f] + fy[t] * fy[f] + fz[t] * fz[f] < cos_crease ) { continue; }
+		sx += w[o] * fx[f];
+		sy += w[o] * fy[f];
+		sz += w[o] * fz[f];
+	    }
+	    GLfloat len = sqrtf( sx * sx + sy * sy + sz * sz );
+	    normals[c] = len > 0.0f ? vec3( sx / len, sy / len, sz / len ) : vec3( fx[t], fy[t], fz[t] );
+	}
+    } );
+
+    std::vector<vec4> corner_points( (size_t) count );
+    for ( int c = 0; c < count; ++c ) { corner_points[c] = p[corner_vertex[c]]; }
+    build( &corner_points[0], &normals[0], count, true );
+}
+
+}  // namespace Angel
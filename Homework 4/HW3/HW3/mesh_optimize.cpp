@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+#include "mesh.h"
+
+namespace Angel {
+
+//----------------------------------------------------------------------------
+//
+//  IndexedMesh - vertex cache, overdraw and vertex fetch optimization
+//
+
+namespace {
+
+// Cache misses of "indices" with a FIFO cache of "cache_size" entries.
+// A vertex is in the cache if it was loaded at most cache_size loads ago.
+int
+count_misses( const unsigned* indices, int count, int vertex_count, int cache_size )
+{
+    std::vector<int> loaded( (size_t) vertex_count, -cache_size - 1 );  // time of last load
+    int misses = 0;
+    for ( int i = 0; i < count; ++i ) {
+	unsigned v = indices[i];
+	if ( misses - loaded[v] > cache_size ) {
+	    loaded[v] = misses;
+	    ++misses;
+	}
+    }
+    return misses;
+}
+
+// For each vertex, the triangles that use it (compressed rows).
+void
+build_adjacency( const unsigned* indices, int count, int vertex_count,
+		 std::vector<int>& offsets, std::vector<int>& triangles )
+{
+    offsets.assign( (size_t) vertex_count + 1, 0 );
+    for ( int i = 0; i < count; ++i ) { ++offsets[indices[i] + 1]; }
+    for ( int v = 0; v < vertex_count; ++v ) { offsets[v + 1] += offsets[v]; }
+
+    triangles.resize( (size_t) count );
+    std::vector<int> fill( offsets.begin(), offsets.end() - 1 );
+    for ( int i = 0; i < count; ++i ) { triangles[fill[indices[i]]++] = i / 3; }
+}
+
+}  // namespace
+
+void
+IndexedMesh::set_indices( const unsigned* indices )
+{
+    if ( _index_type == GL_UNSIGNED_SHORT ) {
+	GLushort* out = static_cast<GLushort*>( _indices );
+	for ( int i = 0; i < _index_count; ++i ) { out[i] = (GLushort) indices[i]; }
+    } else {
+	memcpy( _indices, indices, _index_count * sizeof(GLuint) );
+    }
+}
+
+VertexCacheStats
+IndexedMesh::analyze_vertex_cache( int cache_size ) const
+{
+    std::vector<unsigned> indices( (size_t) _index_count );
+    for ( int i = 0; i < _index_count; ++i ) { indices[i] = index( i ); }
+
+    int misses = _index_count > 0 ? count_misses( &indices[0], _index_count, _vertex_count, cache_size ) : 0;
+    VertexCacheStats stats;
+    stats.acmr = _index_count > 0 ? misses / ( _index_count / 3.0 ) : 0.0;
+    stats.atvr = _vertex_count > 0 ? misses / (double) _vertex_count : 0.0;
+    return stats;
+}
+
+//  --- Tipsify ---
+//
+//  Fans around a current vertex f, emitting all of its remaining triangles,
+//  then moves to the vertex among those just emitted that is still in the
+//  cache and has the fewest triangles left; dead ends go back through the
+//  stack of recently emitted vertices, then to the lowest vertex with any
+//  triangles left.
+
+void
+IndexedMesh::optimize_vertex_cache( int cache_size )
+{
+    if ( _index_count < 3 ) { return; }
+
+    std::vector<unsigned> in( (size_t) _index_count ), out( (size_t) _index_count );
+    for ( int i = 0; i < _index_count; ++i ) { in[i] = index( i ); }
+    tipsify( &in[0], _index_count, _vertex_count, cache_size, &out[0] );
+    set_indices( &out[0] );
+}
+
+void
+IndexedMesh::tipsify( const unsigned* in, int index_count, int vertex_count, int cache_size, unsigned* result )
+{
+    int triangle_count = index_count / 3;
+
+    std::vector<int> offsets, adjacency;
+    build_adjacency( in, index_count, vertex_count, offsets, adjacency );
+
+    std::vector<int> live( (size_t) vertex_count );            // triangles left per vertex
+    for ( int v = 0; v < vertex_count; ++v ) { live[v] = offsets[v + 1] - offsets[v]; }
+    std::vector<int> stamp( (size_t) vertex_count, 0 );        // time it entered the cache
+    std::vector<char> emitted( (size_t) triangle_count, 0 );
+    std::vector<int> dead_end;                                  // recently used vertices
+    dead_end.reserve( (size_t) index_count );
+
+    std::vector<unsigned> out;
+    out.reserve( (size_t) index_count );
+    std::vector<int> candidates;
+    candidates.reserve( 64 );
+
+    int time = cache_size + 1;
+    int cursor = 0;                 // for the linear scan after dead ends
+    int f = 0;
+    while ( f >= 0 ) {
+	candidates.clear();
+	for ( int a = offsets[f]; a < offsets[f + 1]; ++a ) {
+	    int t = adjacency[a];
+	    if ( emitted[t] ) { continue; }
+	    for ( int k = 0; k < 3; ++k ) {
+		unsigned v = in[3 * t + k];
+		out.push_back( v );
+		dead_end.push_back( (int) v );
+		candidates.push_back( (int) v );
+		--live[v];
+		if ( time - stamp[v] > cache_size ) {
+		    stamp[v] = time;
+		    ++time;
+		}
+	    }
+	    emitted[t] = 1;
+	}
+
+	// The candidate that will still be in the cache after its remaining
+	// triangles are emitted, and has been in it the longest.
+	int next = -1;
+	int best = -1;
+	for ( size_t c = 0; c < candidates.size(); ++c ) {
+	    int v = candidates[c];
+	    if ( live[v] == 0 ) { continue; }
+	    int priority = 0;
+	    if ( time - stamp[v] + 2 * live[v] <= cache_size ) { priority = time - stamp[v]; }
+	    if ( priority > best ) {
+		best = priority;
+		next = v;
+	    }
+	}
+	if ( next < 0 ) {
+	    while ( !dead_end.empty() ) {
+		int d = dead_end.back();
+		dead_end.pop_back();
+		if ( live[d] > 0 ) {
+		    next = d;
+		    break;
+		}
+	    }
+	}
+	if ( next < 0 ) {
+	    while ( cursor < vertex_count && live[cursor] == 0 ) { ++cursor; }
+	    if ( cursor < vertex_count ) { next = cursor; }
+	}
+	f = next;
+    }
+
+    std::copy( out.begin(), out.end(), result );
+}
+
+//  --- Overdraw ---
+//
+//  Sander et al.'s linear-speed ordering: a cluster is a run of triangles
+//  that starts where all three vertices miss the cache (Tipsify produces
+//  such a run after every dead end), so clusters can be reordered without
+//  hurting the cache much.  Clusters facing away from the mesh's center,
+//  dot(centroid - center, normal), are drawn first: they tend to occlude
+//  the others on convex-ish models.
+
+void
+IndexedMesh::optimize_overdraw( int cache_size, double threshold )
+{
+    int triangle_count = _index_count / 3;
+    if ( triangle_count == 0 ) { return; }
+
+    std::vector<unsigned> in( (size_t) _index_count );
+    for ( int i = 0; i < _index_count; ++i ) { in[i] = index( i ); }
+
+    // Cluster starts, with the same FIFO model as count_misses().
+    std::vector<int> starts;
+    {
+	std::vector<int> loaded( (size_t) _vertex_count, -cache_size - 1 );
+	int misses = 0;
+	for ( int t = 0; t < triangle_count; ++t ) {
+	    int m = 0;
+	    for ( int k = 0; k < 3; ++k ) {
+		unsigned v = in[3 * t + k];
+		if ( misses - loaded[v] > cache_size ) {
+		    loaded[v] = misses;
+		    ++misses;
+		    ++m;
+		}
+	    }
+	    if ( t == 0 || m == 3 ) { starts.push_back( t ); }
+	}
+	starts.push_back( triangle_count );
+    }
+    int cluster_count = (int) starts.size() - 1;
+    if ( cluster_count < 2 ) { return; }
+
+    // Area-weighted centroid and normal of each cluster and of the mesh.
+    std::vector<vec3> centroid( (size_t) cluster_count ), normal( (size_t) cluster_count );
+    vec3 center( 0.0, 0.0, 0.0 );
+    GLfloat total_area = 0.0;
+    for ( int c = 0; c < cluster_count; ++c ) {
+	vec3 sum( 0.0, 0.0, 0.0 ), n( 0.0, 0.0, 0.0 );
+	GLfloat area = 0.0;
+	for ( int t = starts[c]; t < starts[c + 1]; ++t ) {
+	    const vec4& a = _points[in[3 * t]];
+	    const vec4& b = _points[in[3 * t + 1]];
+	    const vec4& d = _points[in[3 * t + 2]];
+	    vec3 ab( b.x - a.x, b.y - a.y, b.z - a.z ), ad( d.x - a.x, d.y - a.y, d.z - a.z );
+	    vec3 cr = cross( ab, ad );
+	    GLfloat w = length( cr );
+	    sum += w * vec3( a.x + b.x + d.x, a.y + b.y + d.y, a.z + b.z + d.z ) / 3.0;
+	    n += cr;
+	    area += w;
+	}
+	centroid[c] = area > 0.0 ? sum / area : vec3( _points[in[3 * starts[c]]].x,
+						       _points[in[3 * starts[c]]].y,
+						       _points[in[3 * starts[c]]].z );
+	normal[c] = n;
+	center += sum;
+	total_area += area;
+    }
+    if ( total_area > 0.0 ) { center /= total_area; }
+
+    std::vector<std::pair<GLfloat, int> > order( (size_t) cluster_count );
+    for ( int c = 0; c < cluster_count; ++c ) {
+	order[c] = std::make_pair( -dot( centroid[c] - center, normal[c] ), c );
+    }
+    std::stable_sort( order.begin(), order.end() );
+
+    std::vector<unsigned> out;
+    out.reserve( (size_t) _index_count );
+    for ( int i = 0; i < cluster_count; ++i ) {
+	int c = order[i].second;
+	out.insert( out.end(), in.begin() + 3 * starts[c], in.begin() + 3 * starts[c + 1] );
+    }
+
+    int before = count_misses( &in[0], _index_count, _vertex_count, cache_size );
+    int after = count_misses( &out[0], _index_count, _vertex_count, cache_size );
+    if ( after <= before * threshold ) { set_indices( &out[0] ); }
+}
+
+//  --- Vertex fetch ---
+
+void
+IndexedMesh::optimize_vertex_fetch()
+{
+    std::vector<int> remap( (size_t) _vertex_count, -1 );
+    std::vector<unsigned> out( (size_t) _index_count );
+    int next = 0;
+    for ( int i = 0; i < _index_count; ++i ) {
+	unsigned v = index( i );
+	if ( remap[v] < 0 ) { remap[v] = next++; }
+	out[i] = (unsigned) remap[v];
+    }
+
+    // Unused vertices (there are none after build()) go to the end.
+    for ( int v = 0; v < _vertex_count; ++v ) {
+	if ( remap[v] < 0 ) { remap[v] = next++; }
+    }
+
+    vec4* points = _arena.allocate<vec4>( (size_t) _vertex_count );
+    vec3* normals = _arena.allocate<vec3>( (size_t) _vertex_count );
+    for ( int v = 0; v < _vertex_count; ++v ) {
+	points[remap[v]] = _points[v];
+	normals[remap[v]] = _normals[v];
+    }
+    _points = points;
+    _normals = normals;
+    set_indices( &out[0] );
+}
+
+}  // namespace Angel
@@ -0,0 +1,101 @@
+#include <math.h>
+
+#include "mesh.h"
+
+namespace Angel {
+
+//----------------------------------------------------------------------------
+//
+//  IndexedMesh - compact vertex format
+//
+
+namespace {
+
+const GLfloat PackedMax = 32767.0f;
+
+inline GLshort
+pack_snorm( GLfloat x )
+{
+    x = x < -1.0f ? -1.0f : ( x > 1.0f ? 1.0f : x );
+    return (GLshort) floorf( x * PackedMax + 0.5f );
+}
+
+inline GLfloat
+sign_not_zero( GLfloat x )
+{
+    return x < 0.0f ? -1.0f : 1.0f;
+}
+
+// Projects the unit normal onto the octahedron |x| + |y| + |z| = 1 and
+// unfolds its lower half over the diagonals of the upper half's square.
+inline void
+pack_octahedral( const vec3& n, GLshort out[2] )
+{
+    GLfloat l1 = fabsf( n.x ) + fabsf( n.y ) + fabsf( n.z );
+    if ( l1 == 0.0f ) {
+	out[0] = out[1] = 0;            // decodes to +z
+	return;
+    }
+    GLfloat u = n.x / l1, v = n.y / l1;
+    if ( n.z < 0.0f ) {
+	GLfloat fu = ( 1.0f - fabsf( v ) ) * sign_not_zero( u );
+	GLfloat fv = ( 1.0f - fabsf( u ) ) * sign_not_zero( v );
+	u = fu;
+	v = fv;
+    }
+    out[0] = pack_snorm( u );
+    out[1] = pack_snorm( v );
+}
+
+}  // namespace
+
+void
+IndexedMesh::packed_bounds( vec3& scale, vec3& bias ) const
+{
+    if ( _vertex_count == 0 ) {
+	scale = vec3( 0.0, 0.0, 0.0 );
+	bias = vec3( 0.0, 0.0, 0.0 );
+	return;
+    }
+    vec3 lo( _points[0].x, _points[0].y, _points[0].z ), hi = lo;
+    for ( int v = 1; v < _vertex_count; ++v ) {
+	const vec4& p = _points[v];
+	lo.x = p.x < lo.x ? p.x : lo.x;  hi.x = p.x > hi.x ? p.x : hi.x;
+	lo.y = p.y < lo.y ? p.y : lo.y;  hi.y = p.y > hi.y ? p.y : hi.y;
+	lo.z = p.z < lo.z ? p.z : lo.z;  hi.z = p.z > hi.z ? p.z : hi.z;
+    }
+    bias = 0.5 * ( lo + hi );
+    scale = ( 0.5 / PackedMax ) * ( hi - lo );
+}
+
+void
+IndexedMesh::pack( PackedVertex* out, const vec3& scale, const vec3& bias ) const
+{
+    // A flat axis (scale 0) stores 0; bias alone gives its coordinate.
+    vec3 inv( scale.x > 0.0f ? 1.0f / ( scale.x * PackedMax ) : 0.0f,
+	      scale.y > 0.0f ? 1.0f / ( scale.y * PackedMax ) : 0.0f,
+	      scale.z > 0.0f ? 1.0f / ( scale.z * PackedMax ) : 0.0f );
+    for ( int v = 0; v < _vertex_count; ++v ) {
+	const vec4& p = _points[v];
+	out[v].position[0] = pack_snorm( ( p.x - bias.x ) * inv.x );
+	out[v].position[1] = pack_snorm( ( p.y - bias.y ) * inv.y );
+	out[v].position[2] = pack_snorm( ( p.z - bias.z ) * inv.z );
+	out[v].position[3] = 0;
+	pack_octahedral( _normals[v], out[v].normal );
+    }
+}
+
+void
+IndexedMesh::pack( PackedMesh& out, const vec3& scale, const vec3& bias )
+{
+    PackedVertex* vertices = _arena.allocate<PackedVertex>( (size_t) _vertex_count );
+    pack( vertices, scale, bias );
+    out.vertices = vertices;
+    out.indices = _indices;
+    out.vertex_count = _vertex_count;
+    out.index_count = _index_count;
+    out.index_type = _index_type;
+    out.meshlets = _meshlets;
+}
+
+}  // namespace Angel
@@ -0,0 +1,372 @@
+#include <math.h>
+#include <algorithm>
+#include <queue>
+#include <vector>
+
+#include "mesh.h"
+
+namespace Angel {
+
+//----------------------------------------------------------------------------
+//
+//  Mesh simplification
+//
+
+namespace {
+
+// The symmetric 4x4 matrix of a sum of squared plane distances,
+// (p, 1)^T Q (p, 1) (Garland and Heckbert 1997).
+struct Quadric {
+    double  a, b, c, d,       // row 0
+		e, f, g,      // row 1, from the diagonal
+		   h, i,      // row 2
+		      j;      // row 3
+
+    Quadric() : a(0), b(0), c(0), d(0), e(0), f(0), g(0), h(0), i(0), j(0) {}
+
+    // the plane n . p + w = 0, with unit n, times "weight"
+    Quadric( double nx, double ny, double nz, double w, double weight ) :
+	a(weight * nx * nx), b(weight * nx * ny), c(weight * nx * nz), d(weight * nx * w),
+	e(weight * ny * ny), f(weight * ny * nz), g(weight * ny * w),
+	h(weight * nz * nz), i(weight * nz * w),
+	j(weight * w * w) {}
+
+    Quadric& operator += ( const Quadric& q ) {
+	a += q.a; b += q.b; c += q.c; d += q.d; e += q.e;
+	f += q.f; g += q.g; h += q.h; i += q.i; j += q.j;
+	return *this;
+    }
+
+    double error( double x, double y, double z ) const {
+	return a * x * x + 2 * b * x * y + 2 * c * x * z + 2 * d * x
+	     + e * y * y + 2 * f * y * z + 2 * g * y
+	     + h * z * z + 2 * i * z
+	     + j;
+    }
+
+    // The point of least error, if the 3x3 part is well conditioned.
+    bool minimum( double& x, double& y, double& z ) const {
+	double det = a * ( e * h - f * f ) - b * ( b * h - f * c ) + c * ( b * f - e * c );
+	double scale = a * a + e * e + h * h;
+	if ( fabs( det ) <= 1e-12 * scale * sqrt( scale ) ) { return false; }
+	x = ( -d * ( e * h - f * f ) + b * ( g * h - f * i ) - c * ( g * f - e * i ) ) / det;
+	y = ( -a * ( g * h - f * i ) + d * ( b * h - f * c ) - c * ( b * i - g * c ) ) / det;
+	z = ( -a * ( e * i - g * f ) + b * ( b * i - g * c ) - d * ( b * f - e * c ) ) / det;
+	return true;
+    }
+};
+
+struct Collapse {
+    double    cost;
+    int       u, v;            // u is removed, v moves to (x, y, z)
+    unsigned  u_version, v_version;
+    GLfloat   x, y, z;
+
+    bool operator < ( const Collapse& o ) const { return cost > o.cost; }   // min-heap
+};
+
+struct Simplifier {
+    std::vector<vec3>               position;
+    std::vector<Quadric>            quadric;
+    std::vector<unsigned>           version;       // bumped whenever a vertex changes
+    std::vector<char>               locked;        // shared with another region
+    std::vector<int>                corners;       // 3 per triangle
+    std::vector<char>               dead;          // per triangle
+    std::vector<std::vector<int> >  around;        // triangles per vertex, may list dead ones
+
+    // The best way to collapse the edge (u, v): to the quadric's minimum,
+    // or else to the better of the two ends and the midpoint.
+    Collapse plan( int u, int v ) const {
+	Quadric q = quadric[u];
+	q += quadric[v];
+	Collapse c;
+	c.u = u;
+	c.v = v;
+	c.u_version = version[u];
+	c.v_version = version[v];
+	double x, y, z;
+	if ( q.minimum( x, y, z ) ) {
+	    c.cost = q.error( x, y, z );
+	} else {
+	    const vec3& p = position[u];
+	    const vec3& r = position[v];
+	    vec3 m = 0.5 * ( p + r );
+	    double ep = q.error( p.x, p.y, p.z ), er = q.error( r.x, r.y, r.z ), em = q.error( m.x, m.y, m.z );
+	    if ( ep <= er && ep <= em )  { x = p.x; y = p.y; z = p.z; c.cost = ep; }
+	    else if ( er <= em )         { x = r.x; y = r.y; z = r.z; c.cost = er; }
+	    else                         { x = m.x; y = m.y; z = m.z; c.cost = em; }
+	}
+	c.cost = c.cost < 0.0 ? 0.0 : c.cost;
+	c.x = (GLfloat) x;
+	c.y = (GLfloat) y;
+	c.z = (GLfloat) z;
+	return c;
+    }
+
+    void push_edges( int v, std::priority_queue<Collapse>& heap ) const {
+	for ( size_t k = 0; k < around[v].size(); ++k ) {
+	    int t = around[v][k];
+	    if ( dead[t] ) { continue; }
+	    for ( int s = 0; s < 3; ++s ) {
+		int w = corners[3 * t + s];
+		if ( w != v && !locked[w] && w < v ) { heap.push( plan( w, v ) ); }
+		if ( w != v && !locked[w] && w > v ) { heap.push( plan( v, w ) ); }
+	    }
+	}
+    }
+
+    // Moving "moved" (whose triangles are around[moved]) to p must not
+    // flip or squash any triangle that does not also contain "other".
+    bool keeps_orientation( int moved, int other, const vec3& p ) const {
+	for ( size_t k = 0; k < around[moved].size(); ++k ) {
+	    int t = around[moved][k];
+	    if ( dead[t] ) { continue; }
+	    const int* c = &corners[3 * t];
+	    if ( c[0] == other || c[1] == other || c[2] == other ) { continue; }
+	    vec3 q[3];
+	    for ( int s = 0; s < 3; ++s ) { q[s] = c[s] == moved ? p : position[c[s]]; }
+	    vec3 before = cross( position[c[1]] - position[c[0]], position[c[2]] - position[c[0]] );
+	    vec3 after = cross( q[1] - q[0], q[2] - q[0] );
+	    double lb = length( before ), la = length( after );
+	    if ( la <= 1e-12 * ( lb + 1e-30 ) || dot( before, after ) < 0.2 * lb * la ) { return false; }
+	}
+	return true;
+    }
+
+    // The link condition: the vertices next to both u and v must be
+    // exactly the third corners of the triangles on the edge, or the
+    // collapse would make the mesh non-manifold.
+    bool keeps_manifold( int u, int v, std::vector<int>& link_u, std::vector<int>& link_v ) const {
+	int edge_triangles = 0;
+	link_u.clear();
+	for ( size_t k = 0; k < around[u].size(); ++k ) {
+	    int t = around[u][k];
+	    if ( dead[t] ) { continue; }
+	    const int* c = &corners[3 * t];
+	    edge_triangles += c[0] == v || c[1] == v || c[2] == v;
+	    for ( int s = 0; s < 3; ++s ) {
+		if ( c[s] != u && c[s] != v ) { link_u.push_back( c[s] ); }
+	    }
+	}
+	link_v.clear();
+	for ( size_t k = 0; k < around[v].size(); ++k ) {
+	    int t = around[v][k];
+	    if ( dead[t] ) { continue; }
+	    const int* c = &corners[3 * t];
+	    for ( int s = 0; s < 3; ++s ) {
+		if ( c[s] != u && c[s] != v ) { link_v.push_back( c[s] ); }
+	    }
+	}
+	std::sort( link_u.begin(), link_u.end() );
+	link_u.erase( std::unique( link_u.begin(), link_u.end() ), link_u.end() );
+	std::sort( link_v.begin(), link_v.end() );
+	link_v.erase( std::unique( link_v.begin(), link_v.end() ), link_v.end() );
+	int shared = 0;
+	for ( size_t i = 0, j = 0; i < link_u.size() && j < link_v.size(); ) {
+	    if ( link_u[i] < link_v[j] )       { ++i; }
+	    else if ( link_v[j] < link_u[i] )  { ++j; }
+	    else                               { ++shared; ++i; ++j; }
+	}
+	return shared == edge_triangles;
+    }
+
+    // Collapses edges of the live triangles in "triangles" by increasing
+    // cost until "target" of them are left.  Returns the largest cost.
+    double run( const std::vector<int>& triangles, int target ) {
+	int live = 0;
+	std::priority_queue<Collapse> heap;
+	for ( size_t k = 0; k < triangles.size(); ++k ) {
+	    int t = triangles[k];
+	    if ( dead[t] ) { continue; }
+	    ++live;
+	    for ( int s = 0; s < 3; ++s ) {
+		int u = corners[3 * t + s], v = corners[3 * t + ( s + 1 ) % 3];
+		if ( locked[u] || locked[v] ) { continue; }
+		heap.push( u < v ? plan( u, v ) : plan( v, u ) );
+	    }
+	}
+
+	double worst = 0.0;
+	std::vector<int> link_u, link_v;
+	while ( live > target && !heap.empty() ) {
+	    Collapse c = heap.top();
+	    heap.pop();
+	    if ( version[c.u] != c.u_version || version[c.v] != c.v_version ) { continue; }
+
+	    vec3 p( c.x, c.y, c.z );
+	    if ( !keeps_manifold( c.u, c.v, link_u, link_v ) || !keeps_orientation( c.u, c.v, p ) ||
+		 !keeps_orientation( c.v, c.u, p ) ) {
+		continue;
+	    }
+
+	    int u = c.u, v = c.v;
+	    for ( size_t k = 0; k < around[u].size(); ++k ) {
+		int t = around[u][k];
+		if ( dead[t] ) { continue; }
+		int* corner = &corners[3 * t];
+		if ( corner[0] == v || corner[1] == v || corner[2] == v ) {
+		    dead[t] = 1;
+		    --live;
+		    continue;
+		}
+		for ( int s = 0; s < 3; ++s ) { corner[s] = corner[s] == u ? v : corner[s]; }
+		around[v].push_back( t );
+	    }
+	    around[u].clear();
+	    position[v] = p;
+	    quadric[v] += quadric[u];
+	    ++version[u];
+	    ++version[v];
+	    worst = c.cost > worst ? c.cost : worst;
+
+	    // drop the dead triangles from v's list now and then
+	    if ( around[v].size() > 64 ) {
+		std::vector<int>& list = around[v];
+		size_t kept = 0;
+		for ( size_t k = 0; k < list.size(); ++k ) {
+		    if ( !dead[list[k]] ) { list[kept++] = list[k]; }
+		}
+		list.resize( kept );
+	    }
+	    push_edges( v, heap );
+	}
+	return worst;
+    }
+};
+
+}  // namespace
+
+//  --- SimplifyMesh ---
+//
+//  With a pool, the triangles are first split into slabs along the longest
+//  axis of the bounding box, one or more per thread.  Vertices used by
+//  more than one slab are locked, so the slabs share no state that is
+//  written, and each is simplified on its own.  A last serial pass over
+//  the whole mesh, with nothing locked, reaches the target.  The slabs
+//  stop short of it (at 1.5 times the target ratio, and at a quarter of
+//  their triangles at most), since their seams stay dense until that last
+//  pass, and simplifying their insides too far around the seams leaves
+//  slivers that cost accuracy later.  Open edges get a steep quadric of their
+//  own, so that borders keep their shape.
+
+GLfloat
+SimplifyMesh( const vec4* points, int count, int target_triangles, Mesh& out, ThreadPool* pool )
+{
+    IndexedMesh welded;
+    welded.build( points, NULL, count - count % 3, false );
+    int vertex_count = welded.vertex_count();
+    int triangle_count = welded.index_count() / 3;
+
+    Simplifier s;
+    s.position.resize( (size_t) vertex_count );
+    for ( int v = 0; v < vertex_count; ++v ) {
+	const vec4& p = welded.points()[v];
+	s.position[v] = vec3( p.x, p.y, p.z );
+    }
+    s.quadric.resize( (size_t) vertex_count );
+    s.version.assign( (size_t) vertex_count, 0 );
+    s.locked.assign( (size_t) vertex_count, 0 );
+    s.corners.resize( 3 * (size_t) triangle_count );
+    s.dead.assign( (size_t) triangle_count, 0 );
+    s.around.resize( (size_t) vertex_count );
+    for ( int i = 0; i < 3 * triangle_count; ++i ) {
+	s.corners[i] = (int) welded.index( i );
+	s.around[s.corners[i]].push_back( i / 3 );
+    }
+    welded.release();
+
+    // Face planes, and a plane through every open edge, perpendicular to
+    // its face.
+    for ( int t = 0; t < triangle_count; ++t ) {
+	const int* c = &s.corners[3 * t];
+	vec3 n = cross( s.position[c[1]] - s.position[c[0]], s.position[c[2]] - s.position[c[0]] );
+	double len = length( n );
+	if ( len == 0.0 ) { continue; }
+	double nx = n.x / len, ny = n.y / len, nz = n.z / len;
+	Quadric q( nx, ny, nz, -( nx * s.position[c[0]].x + ny * s.position[c[0]].y + nz * s.position[c[0]].z ), 1.0 );
+	for ( int k = 0; k < 3; ++k ) {
+	    s.quadric[c[k]] += q;
+
+	    int u = c[k], v = c[( k + 1 ) % 3];
+	    int uses = 0;
+	    for ( size_t a = 0; a < s.around[u].size(); ++a ) {
+		const int* o = &s.corners[3 * s.around[u][a]];
+		uses += ( o[0] == v || o[1] == v || o[2] == v );
+	    }
+	    if ( uses != 1 ) { continue; }
+	    vec3 e = s.position[v] - s.position[u];
+	    vec3 m = cross( e, vec3( (GLfloat) nx, (GLfloat) ny, (GLfloat) nz ) );
+	    double ml = length( m );
+	    if ( ml == 0.0 ) { continue; }
+	    double mx = m.x / ml, my = m.y / ml, mz = m.z / ml;
+	    Quadric border( mx, my, mz, -( mx * s.position[u].x + my * s.position[u].y + mz * s.position[u].z ), 1000.0 );
+	    s.quadric[u] += border;
+	    s.quadric[v] += border;
+	}
+    }
+
+    double worst = 0.0;
+    int regions = pool ? 2 * pool->size() : 1;
+    if ( regions > 1 && triangle_count > 64 * regions && target_triangles < triangle_count ) {
+	// slabs by the centroid along the longest axis
+	vec3 lo = s.position[0], hi = lo;
+	for ( int v = 1; v < vertex_count; ++v ) {
+	    const vec3& p = s.position[v];
+	    lo.x = std::min( lo.x, p.x );  hi.x = std::max( hi.x, p.x );
+	    lo.y = std::min( lo.y, p.y );  hi.y = std::max( hi.y, p.y );
+	    lo.z = std::min( lo.z, p.z );  hi.z = std::max( hi.z, p.z );
+	}
+	vec3 extent = hi - lo;
+	int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : ( extent.y >= extent.z ? 1 : 2 );
+	std::vector<std::vector<int> > slab( (size_t) regions );
+	std::vector<int> region_of( (size_t) triangle_count );
+	std::vector<int> vertex_region( (size_t) vertex_count, -1 );
+	for ( int t = 0; t < triangle_count; ++t ) {
+	    const int* c = &s.corners[3 * t];
+	    GLfloat centroid = ( s.position[c[0]][axis] + s.position[c[1]][axis] + s.position[c[2]][axis] ) / 3.0f;
+	    int r = extent[axis] > 0.0f ? (int) ( ( centroid - lo[axis] ) / extent[axis] * regions ) : 0;
+	    r = r < 0 ? 0 : ( r >= regions ? regions - 1 : r );
+	    slab[r].push_back( t );
+	    for ( int k = 0; k < 3; ++k ) {
+		int& owner = vertex_region[c[k]];
+		if ( owner == -1 ) { owner = r; }
+		else if ( owner != r ) { s.locked[c[k]] = 1; }
+	    }
+	}
+
+	double ratio = std::min( 1.0, std::max( 1.5 * target_triangles / (double) triangle_count, 0.25 ) );
+	std::vector<double> slab_worst( (size_t) regions, 0.0 );
+	pool->parallel_for( 0, regions, 1, [&]( int begin, int end ) {
+	    for ( int r = begin; r < end; ++r ) {
+		slab_worst[r] = s.run( slab[r], (int) ( slab[r].size() * ratio + 0.5 ) );
+	    }
+	} );
+	for ( int r = 0; r < regions; ++r ) { worst = std::max( worst, slab_worst[r] ); }
+	s.locked.assign( (size_t) vertex_count, 0 );
+    }
+
+    std::vector<int> all( (size_t) triangle_count );
+    for ( int t = 0; t < triangle_count; ++t ) { all[t] = t; }
+    worst = std::max( worst, s.run( all, target_triangles ) );
+
+    // the live triangles, with flat normals
+    int live = 0;
+    for ( int t = 0; t < triangle_count; ++t ) { live += !s.dead[t]; }
+    out.resize( 0 );
+    out.reserve( 3 * live );
+    for ( int t = 0; t < triangle_count; ++t ) {
+	if ( s.dead[t] ) { continue; }
+	const vec3& a = s.position[s.corners[3 * t]];
+	const vec3& b = s.position[s.corners[3 * t + 1]];
+	const vec3& c = s.position[s.corners[3 * t + 2]];
+	vec3 n = cross( b - a, c - b );
+	GLfloat len = length( n );
+	n = len > 0.0f ? n / len : n;
+	out.push_back( a, n );
+	out.push_back( b, n );
+	out.push_back( c, n );
+    }
+    return (GLfloat) sqrt( worst );
+}
+
+}  // namespace Angel
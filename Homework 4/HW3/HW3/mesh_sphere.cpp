@@ -0,0 +1,73 @@
+#include <math.h>
+#include <unordered_map>
+#include <vector>
+
+#include "mesh.h"
+
+namespace Angel {
+
+//----------------------------------------------------------------------------
+//
+//  IndexedMesh - generated spheres
+//
+
+void
+IndexedMesh::build_icosphere( int subdivisions )
+{
+    const GLfloat t = (GLfloat) ( ( 1.0 + sqrt( 5.0 ) ) / 2.0 );
+    const GLfloat corners[12][3] = {
+	{ -1,  t,  0 }, {  1,  t,  0 }, { -1, -t,  0 }, {  1, -t,  0 },
+	{  0, -1,  t }, {  0,  1,  t }, {  0, -1, -t }, {  0,  1, -t },
+	{  t,  0, -1 }, {  t,  0,  1 }, { -t,  0, -1 }, { -t,  0,  1 }
+    };
+    // counterclockwise seen from outside
+    const int faces[20][3] = {
+	{ 0, 11,  5 }, { 0,  5,  1 }, {  0,  1,  7 }, {  0,  7, 10 }, { 0, 10, 11 },
+	{ 1,  5,  9 }, { 5, 11,  4 }, { 11, 10,  2 }, { 10,  7,  6 }, { 7,  1,  8 },
+	{ 3,  9,  4 }, { 3,  4,  2 }, {  3,  2,  6 }, {  3,  6,  8 }, { 3,  8,  9 },
+	{ 4,  9,  5 }, { 2,  4, 11 }, {  6,  2, 10 }, {  8,  6,  7 }, { 9,  8,  1 }
+    };
+
+    std::vector<vec3> positions;
+    for ( int i = 0; i < 12; ++i ) {
+	positions.push_back( normalize( vec3( corners[i][0], corners[i][1], corners[i][2] ) ) );
+    }
+    std::vector<int> triangles( &faces[0][0], &faces[0][0] + 60 );
+
+    // Split every triangle into 4 at its edge midpoints, pushed out onto the
+    // sphere; midpoints are shared through a map keyed by the edge.
+    for ( int level = 0; level < subdivisions; ++level ) {
+	std::unordered_map<unsigned long long, int> midpoints;
+	midpoints.reserve( triangles.size() );
+	std::vector<int> split;
+	split.reserve( 4 * triangles.size() );
+	for ( size_t i = 0; i < triangles.size(); i += 3 ) {
+	    int m[3];
+	    for ( int k = 0; k < 3; ++k ) {
+		int a = triangles[i + k], b = triangles[i + ( k + 1 ) % 3];
+		unsigned long long key = a < b ? ( (unsigned long long) a << 32 ) | (unsigned) b
+					       : ( (unsigned long long) b << 32 ) | (unsigned) a;
+		std::unordered_map<unsigned long long, int>::iterator it = midpoints.find( key );
+		if ( it == midpoints.end() ) {
+		    positions.push_back( normalize( positions[a] + positions[b] ) );
+		    it = midpoints.insert( std::make_pair( key, (int) positions.size() - 1 ) ).first;
+		}
+		m[k] = it->second;
+	    }
+	    int a = triangles[i], b = triangles[i + 1], c = triangles[i + 2];
+	    int quads[12] = { a, m[0], m[2],  b, m[1], m[0],  c, m[2], m[1],  m[0], m[1], m[2] };
+	    split.insert( split.end(), quads, quads + 12 );
+	}
+	triangles.swap( split );
+    }
+
+    allocate( (int) positions.size(), (int) triangles.size() );
+    for ( size_t v = 0; v < positions.size(); ++v ) {
+	_points[v] = vec4( positions[v], 1.0 );
+	_normals[v] = positions[v];
+    }
+    std::vector<unsigned> indices( triangles.begin(), triangles.end() );
+    set_indices( &indices[0] );
+}
+
+}  // namespace Angel
@@ -0,0 +1,79 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- mesh_upload.h ---
+//
+//   Progressive upload of buffer contents to the GPU.
+//
+//   BufferUploader up;
+//   up.add(GL_ARRAY_BUFFER, buffer, offset, data, size);   // after glBufferData(..., NULL, ...)
+//   ...
+//   up.step(4 << 20);            // once per frame: at most 4 MB
+//   if (up.done()) ...           // the data may be freed now
+//
+//   The buffers must already have their full size; add() only records
+//   where "data" goes, and step() copies it with glBufferSubData() in
+//   slices of bounded size, so that no single frame stalls on a large
+//   mesh.  Only the thread that owns the GL context may call step().
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ANGEL_MESH_UPLOAD_H__
+#define __ANGEL_MESH_UPLOAD_H__
+
+#include "Angel-yjc.h"
+#include <deque>
+
+namespace Angel {
+
+class BufferUploader {
+
+    struct Piece {
+	GLenum       target;
+	GLuint       buffer;
+	GLintptr     offset;
+	const char*  data;
+	GLsizeiptr   size;
+    };
+
+    std::deque<Piece>  _pieces;
+    size_t             _uploaded;     // bytes, for statistics
+
+   public:
+    BufferUploader() : _uploaded(0) {}
+
+    void add( GLenum target, GLuint buffer, GLintptr offset, const void* data, GLsizeiptr size ) {
+	if ( size <= 0 ) { return; }
+	Piece p = { target, buffer, offset, static_cast<const char*>( data ), size };
+	_pieces.push_back( p );
+    }
+
+    // Uploads at most "budget" bytes; returns true once everything is done.
+    bool step( GLsizeiptr budget ) {
+	while ( budget > 0 && !_pieces.empty() ) {
+	    Piece& p = _pieces.front();
+	    GLsizeiptr n = p.size < budget ? p.size : budget;
+	    glBindBuffer( p.target, p.buffer );
+	    glBufferSubData( p.target, p.offset, n, p.data );
+	    glBindBuffer( p.target, 0 );
+	    p.offset += n;
+	    p.data += n;
+	    p.size -= n;
+	    budget -= n;
+	    _uploaded += (size_t) n;
+	    if ( p.size == 0 ) { _pieces.pop_front(); }
+	}
+	return _pieces.empty();
+    }
+
+    // Uploads everything that is left.
+    void finish() {
+	while ( !step( GLsizeiptr(64) << 20 ) ) {}
+    }
+
+    bool done() const { return _pieces.empty(); }
+    size_t uploaded() const { return _uploaded; }
+};
+
+}  // namespace Angel
+
+#endif // __ANGEL_MESH_UPLOAD_H__
@@ -0,0 +1,170 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- program_uniforms.h ---
+//
+//   The active uniforms of a linked program, looked up once by name and
+//   then set through typed handles, with no string work per frame.
+//
+//   UniformMat4 model_view;
+//   UniformFloat fog_flag;
+//
+//   ProgramUniforms uniforms(program);          // after InitShader()
+//   uniforms.bind("model_view", model_view);
+//   uniforms.bind("fog_flag", fog_flag);
+//   ...
+//   model_view.set(mv);                         // per frame
+//
+//   bind() reports names that are not active uniforms of the program
+//   (misspelled, or optimized away by the compiler) and uniforms of
+//   another type than the handle's; such handles stay unresolved
+//   (location -1), and setting them does nothing, as in GL.  Uniform
+//   blocks are attached to buffer binding points with bind_block() (see
+//   uniform_buffer.h); their members have no locations of their own.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ANGEL_PROGRAM_UNIFORMS_H__
+#define __ANGEL_PROGRAM_UNIFORMS_H__
+
+#include "Angel-yjc.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace Angel {
+
+//  --- Typed handles ---
+
+template <GLenum Type>
+struct UniformHandle {
+    static const GLenum  type = Type;     // as glGetActiveUniform() gives it
+    GLint                location;        // -1 until bound
+
+    UniformHandle() : location(-1) {}
+    bool resolved() const { return location >= 0; }
+};
+
+struct UniformFloat : UniformHandle<GL_FLOAT> {
+    void set( GLfloat v ) const { glUniform1f( location, v ); }
+};
+
+struct UniformVec3 : UniformHandle<GL_FLOAT_VEC3> {
+    void set( const vec3& v ) const { glUniform3fv( location, 1, v ); }
+};
+
+struct UniformVec4 : UniformHandle<GL_FLOAT_VEC4> {
+    void set( const vec4& v ) const { glUniform4fv( location, 1, v ); }
+};
+
+// Matrices are row-major here, so they are uploaded transposed.
+struct UniformMat3 : UniformHandle<GL_FLOAT_MAT3> {
+    void set( const mat3& m ) const { glUniformMatrix3fv( location, 1, GL_TRUE, m ); }
+};
+
+struct UniformMat4 : UniformHandle<GL_FLOAT_MAT4> {
+    void set( const mat4& m ) const { glUniformMatrix4fv( location, 1, GL_TRUE, m ); }
+};
+
+struct UniformSampler2D : UniformHandle<GL_SAMPLER_2D> {
+    void set( GLint unit ) const { glUniform1i( location, unit ); }
+};
+
+//  --- Reflection ---
+
+class ProgramUniforms {
+
+    struct Active {
+	std::string  name;        // without a trailing "[0]" for arrays
+	GLenum       type;
+	GLint        size;        // array length, 1 otherwise
+	GLint        location;
+	bool         bound;
+    };
+
+    GLuint               _program;
+    std::vector<Active>  _active;
+    int                  _failed;         // bind() calls that did not resolve
+
+   public:
+    // Enumerates the active uniforms of the linked "program".
+    explicit ProgramUniforms( GLuint program ) : _program(program), _failed(0) {
+	GLint count = 0, max_length = 0;
+	glGetProgramiv( program, GL_ACTIVE_UNIFORMS, &count );
+	glGetProgramiv( program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length );
+	std::vector<char> name( (size_t) max_length + 1 );
+	for ( GLint i = 0; i < count; ++i ) {
+	    Active a;
+	    GLsizei length = 0;
+	    glGetActiveUniform( program, (GLuint) i, (GLsizei) name.size(), &length, &a.size, &a.type, &name[0] );
+	    a.location = glGetUniformLocation( program, &name[0] );
+	    if ( length > 3 && strcmp( &name[length - 3], "[0]" ) == 0 ) { length -= 3; }
+	    a.name.assign( &name[0], (size_t) length );
+	    a.bound = false;
+	    _active.push_back( a );      // includes block members (location -1)
+	}
+    }
+
+    // Resolves "handle" to the uniform "name"; false (with a warning) if
+    // the program has no such uniform of the handle's type.
+    template <class Handle>
+    bool bind( const char* name, Handle& handle ) {
+	handle.location = -1;
+	for ( size_t i = 0; i < _active.size(); ++i ) {
+	    Active& a = _active[i];
+	    if ( a.name != name ) { continue; }
+	    if ( a.type != Handle::type || a.location < 0 ) {
+		printf( "Warning: uniform %s has another type than the code expects\n", name );
+		++_failed;
+		return false;
+	    }
+	    a.bound = true;
+	    handle.location = a.location;
+	    return true;
+	}
+	printf( "Warning: uniform %s is not an active uniform of the program\n", name );
+	++_failed;
+	return false;
+    }
+
+    // Attaches the uniform block "name" to the binding point "binding";
+    // false (with a warning) if the program has no such block, or if the
+    // block needs more than the "size" bytes of its C++ struct (which then
+    // does not follow the std140 layout).
+    bool bind_block( const char* name, GLuint binding, GLsizeiptr size ) {
+	GLuint index = glGetUniformBlockIndex( _program, name );
+	if ( index == GL_INVALID_INDEX ) {
+	    printf( "Warning: uniform block %s is not an active block of the program\n", name );
+	    ++_failed;
+	    return false;
+	}
+	GLint data_size = 0;
+	glGetActiveUniformBlockiv( _program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &data_size );
+	if ( data_size > size ) {
+	    printf( "Warning: uniform block %s has %d bytes, but the code has %d\n", name, data_size, (int) size );
+	    ++_failed;
+	    return false;
+	}
+	glUniformBlockBinding( _program, index, binding );
+	return true;
+    }
+
+    // Active uniforms that no handle was bound to, e.g. ones the code
+    // forgot to set.  Returns their number.
+    int report_unbound() const {
+	int n = 0;
+	for ( size_t i = 0; i < _active.size(); ++i ) {
+	    if ( _active[i].bound || _active[i].location < 0 ) { continue; }
+	    printf( "Warning: uniform %s is never set\n", _active[i].name.c_str() );
+	    ++n;
+	}
+	return n;
+    }
+
+    int active() const { return (int) _active.size(); }
+    int failed() const { return _failed; }
+};
+
+}  // namespace Angel
+
+#endif // __ANGEL_PROGRAM_UNIFORMS_H__
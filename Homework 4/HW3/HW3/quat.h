@@ -0,0 +1,241 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- quat.h ---
+//
+//   Unit quaternions for rotations, stored as (x, y, z, w) = (sin(a/2)*axis,
+//   cos(a/2)).  They follow the same conventions as Rotate() in
+//   "mat-yjc-new.h":
+//
+//     QuatRotate(angle, x, y, z)  is the rotation Rotate(angle, x, y, z)
+//                                 (angle in degrees, axis of any length),
+//     q1 * q2                     rotates by q2 first, then by q1
+//                                 (like Rotate(..) * Rotate(..)),
+//     Rotate(q), AffineRotate(q), RotationMat3(q)
+//                                 give the matching row-order matrices.
+//
+//   A product of unit quaternions slowly drifts away from unit length;
+//   call renormalize() on a long-lived accumulated rotation after
+//   updating it (it only rescales when the drift is noticeable).
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ANGEL_QUAT_H__
+#define __ANGEL_QUAT_H__
+
+#include "mat-yjc-new.h"
+
+namespace Angel {
+
+struct ANGEL_ALIGN(16) quat {
+
+    GLfloat  x;
+    GLfloat  y;
+    GLfloat  z;
+    GLfloat  w;
+
+    //
+    //  --- Constructors and Destructors ---
+    //
+
+    ANGEL_CONSTEXPR quat() :                   // the identity rotation
+	x(0.0), y(0.0), z(0.0), w(1.0) {}
+
+    ANGEL_CONSTEXPR quat( GLfloat x, GLfloat y, GLfloat z, GLfloat w ) :
+	x(x), y(y), z(z), w(w) {}
+
+    ANGEL_CONSTEXPR quat( const vec3& v, GLfloat w ) :  // vector part, scalar part
+	x(v.x), y(v.y), z(v.z), w(w) {}
+
+    //
+    //  --- (non-modifying) Arithematic Operators ---
+    //
+
+    quat operator - () const
+	{ return quat( -x, -y, -z, -w ); }
+
+    quat operator + ( const quat& q ) const
+	{ return quat( x + q.x, y + q.y, z + q.z, w + q.w ); }
+
+    quat operator - ( const quat& q ) const
+	{ return quat( x - q.x, y - q.y, z - q.z, w - q.w ); }
+
+    quat operator * ( const GLfloat s ) const
+	{ return quat( s*x, s*y, s*z, s*w ); }
+
+    friend quat operator * ( const GLfloat s, const quat& q )
+	{ return q * s; }
+
+    // Hamilton product: (w1 v2 + w2 v1 + v1 x v2,  w1 w2 - v1 . v2)
+    quat operator * ( const quat& q ) const {
+	quat r;
+#if defined(ANGEL_SSE2)
+	// r = w1*(x2,y2,z2,w2) + x1*(w2,-z2,y2,-x2)
+	//   + y1*(z2,w2,-x2,-y2) + z1*(-y2,x2,w2,-z2)
+	const __m128 s1 = _mm_castsi128_ps( _mm_set_epi32( (int) 0x80000000, 0, (int) 0x80000000, 0 ) );
+	const __m128 s2 = _mm_castsi128_ps( _mm_set_epi32( (int) 0x80000000, (int) 0x80000000, 0, 0 ) );
+	const __m128 s3 = _mm_castsi128_ps( _mm_set_epi32( (int) 0x80000000, 0, 0, (int) 0x80000000 ) );
+	__m128 a = _mm_loadu_ps( &x );
+	__m128 b = _mm_loadu_ps( &q.x );
+	__m128 t = _mm_mul_ps( _mm_shuffle_ps( a, a, 0xFF ), b );
+	t = _mm_add_ps( t, _mm_mul_ps( _mm_shuffle_ps( a, a, 0x00 ),
+	    _mm_xor_ps( _mm_shuffle_ps( b, b, _MM_SHUFFLE( 0, 1, 2, 3 ) ), s1 ) ) );
+	t = _mm_add_ps( t, _mm_mul_ps( _mm_shuffle_ps( a, a, 0x55 ),
+	    _mm_xor_ps( _mm_shuffle_ps( b, b, _MM_SHUFFLE( 1, 0, 3, 2 ) ), s2 ) ) );
+	t = _mm_add_ps( t, _mm_mul_ps( _mm_shuffle_ps( a, a, 0xAA ),
+	    _mm_xor_ps( _mm_shuffle_ps( b, b, _MM_SHUFFLE( 2, 3, 0, 1 ) ), s3 ) ) );
+	_mm_storeu_ps( &r.x, t );
+#else
+	r.x = w*q.x + x*q.w + y*q.z - z*q.y;
+	r.y = w*q.y - x*q.z + y*q.w + z*q.x;
+	r.z = w*q.z + x*q.y - y*q.x + z*q.w;
+	r.w = w*q.w - x*q.x - y*q.y - z*q.z;
+#endif
+	return r;
+    }
+
+    //
+    //  --- (modifying) Arithematic Operators ---
+    //
+
+    quat& operator *= ( const quat& q )
+	{ return *this = *this * q; }
+
+    // Bring |q| back to 1 if it has drifted by more than "tolerance".
+    // Uses one Newton step for 1/sqrt, which is exact to first order.
+    quat& renormalize( const GLfloat tolerance = GLfloat(1.0e-5) ) {
+	GLfloat n = x*x + y*y + z*z + w*w;
+	if ( std::fabs( n - GLfloat(1.0) ) > tolerance ) {
+	    GLfloat r = ( n > GLfloat(0.5) && n < GLfloat(1.5) )
+		      ? GLfloat(1.5) - GLfloat(0.5) * n
+		      : GLfloat(1.0) / std::sqrt( n );
+	    x *= r;  y *= r;  z *= r;  w *= r;
+	}
+	return *this;
+    }
+
+    //
+    //  --- Insertion and Extraction Operators ---
+    //
+
+    friend std::ostream& operator << ( std::ostream& os, const quat& q ) {
+	return os << "( " << q.x << ", " << q.y
+		  << ", " << q.z << ", " << q.w << " )";
+    }
+
+    //
+    //  --- Conversion Operators ---
+    //
+
+    operator const GLfloat* () const
+	{ return static_cast<const GLfloat*>( &x ); }
+
+    operator GLfloat* ()
+	{ return static_cast<GLfloat*>( &x ); }
+};
+
+//----------------------------------------------------------------------------
+//
+//  Non-class quat Methods
+//
+
+inline
+GLfloat dot( const quat& a, const quat& b ) {
+    return a.x*b.x + a.y*b.y + a.z*b.z + a.w*b.w;
+}
+
+inline
+GLfloat length( const quat& q ) {
+    return std::sqrt( dot(q,q) );
+}
+
+inline
+quat normalize( const quat& q ) {
+    return q * ( GLfloat(1.0) / length(q) );
+}
+
+// The inverse rotation (for a unit quaternion)
+inline
+quat conjugate( const quat& q ) {
+    return quat( -q.x, -q.y, -q.z, q.w );
+}
+
+// Same rotation as Rotate(angle, x, y, z): angle in degrees, the axis
+// (x, y, z) can have length != 1.0.
+inline
+quat QuatRotate( const GLfloat angle, const GLfloat x, const GLfloat y, const GLfloat z )
+{
+    float len = sqrt(x * x + y * y + z * z);
+    if (len < 0.00001)
+      { printf("Error! Rotation axis vector is too close to (0,0,0)\n");
+	exit(-1);
+      }
+
+    float half = float(angle) * 0.0174532925f * 0.5f;
+    float s = sinf(half) / len;
+    return quat( x * s, y * s, z * s, cosf(half) );
+}
+
+// Rotate vector v by q (v' = q v q*), without building a matrix.
+inline
+vec3 rotate( const quat& q, const vec3& v ) {
+    vec3 u( q.x, q.y, q.z );
+    vec3 t = 2.0f * cross( u, v );
+    return v + q.w * t + cross( u, t );
+}
+
+// Normalized linear interpolation: cheap, constant-speed only approximately.
+// Takes the shorter way around (q and -q are the same rotation).
+inline
+quat nlerp( const quat& a, const quat& b, const GLfloat t ) {
+    quat e = dot( a, b ) < 0.0f ? -b : b;
+    return normalize( a * ( GLfloat(1.0) - t ) + e * t );
+}
+
+// Spherical linear interpolation: constant angular speed from a (t = 0)
+// to b (t = 1), the shorter way around.
+inline
+quat slerp( const quat& a, const quat& b, const GLfloat t ) {
+    GLfloat d = dot( a, b );
+    quat e = b;
+    if ( d < 0.0f ) { d = -d;  e = -b; }
+
+    if ( d > GLfloat(0.9995) )          // nearly parallel: nlerp is exact enough
+	return nlerp( a, e, t );
+
+    GLfloat theta = std::acos( d );
+    GLfloat s = GLfloat(1.0) / std::sin( theta );
+    return a * ( std::sin( ( GLfloat(1.0) - t ) * theta ) * s ) +
+	   e * ( std::sin( t * theta ) * s );
+}
+
+// The rotation matrices of a unit quaternion, in *row order*.
+inline
+mat3 RotationMat3( const quat& q ) {
+    GLfloat x2 = q.x + q.x, y2 = q.y + q.y, z2 = q.z + q.z;
+    GLfloat xx = q.x * x2, yy = q.y * y2, zz = q.z * z2;
+    GLfloat xy = q.x * y2, xz = q.x * z2, yz = q.y * z2;
+    GLfloat wx = q.w * x2, wy = q.w * y2, wz = q.w * z2;
+
+    return mat3( vec3( 1.0f - (yy + zz), xy - wz,           xz + wy ),
+		 vec3( xy + wz,           1.0f - (xx + zz), yz - wx ),
+		 vec3( xz - wy,           yz + wx,           1.0f - (xx + yy) ) );
+}
+
+inline
+affine3x4 AffineRotate( const quat& q ) {
+    mat3 r = RotationMat3( q );
+    return affine3x4( vec4( r[0], 0.0 ), vec4( r[1], 0.0 ), vec4( r[2], 0.0 ) );
+}
+
+inline
+mat4 Rotate( const quat& q ) {
+    return mat4WithUpperLeftMat3( RotationMat3( q ) );
+}
+
+static_assert( sizeof(quat) == 4 * sizeof(GLfloat) &&
+	       std::alignment_of<quat>::value == 16 &&
+	       std::is_trivially_copyable<quat>::value, "quat must be 4 aligned, packed floats" );
+
+}  // namespace Angel
+
+#endif // __ANGEL_QUAT_H__
@@ -0,0 +1,91 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- render_state.h ---
+//
+//   A shadow of the fixed-function state that the draws switch between
+//   (polygon mode, depth and color writes, blending), so that each draw
+//   can state what it needs and only actual changes reach GL.
+//
+//   RenderState state;
+//   ...
+//   state.polygon_mode(GL_LINE);      // glPolygonMode(), if not GL_LINE
+//   state.depth_mask(GL_FALSE);
+//   state.blend(true, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+//   glDrawArrays(...);
+//
+//   The shadow starts out unknown, so the first call of each kind always
+//   reaches GL; invalidate() forgets it again after other code has changed
+//   the state directly.  issued() and filtered() count the calls made and
+//   the ones dropped as redundant.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ANGEL_RENDER_STATE_H__
+#define __ANGEL_RENDER_STATE_H__
+
+#include "Angel-yjc.h"
+
+namespace Angel {
+
+class RenderState {
+
+    enum { Unknown = -1 };
+
+    GLint     _polygon_mode;          // for GL_FRONT_AND_BACK
+    GLint     _depth_mask;
+    GLint     _color_mask;            // the four channels as bits 0 to 3
+    GLint     _blend;
+    GLint     _blend_src, _blend_dst;
+    unsigned  _issued;
+    unsigned  _filtered;
+
+    // Whether "value" differs from the shadow "current", which it becomes.
+    bool change( GLint& current, GLint value ) {
+	if ( current == value ) { ++_filtered; return false; }
+	current = value;
+	++_issued;
+	return true;
+    }
+
+   public:
+    RenderState() : _issued(0), _filtered(0) { invalidate(); }
+
+    void invalidate() {
+	_polygon_mode = _depth_mask = _color_mask = _blend = Unknown;
+	_blend_src = _blend_dst = Unknown;
+    }
+
+    void polygon_mode( GLenum mode ) {
+	if ( change( _polygon_mode, (GLint) mode ) ) { glPolygonMode( GL_FRONT_AND_BACK, mode ); }
+    }
+
+    void depth_mask( GLboolean write ) {
+	if ( change( _depth_mask, write ? 1 : 0 ) ) { glDepthMask( write ); }
+    }
+
+    void color_mask( GLboolean r, GLboolean g, GLboolean b, GLboolean a ) {
+	GLint bits = ( r ? 1 : 0 ) | ( g ? 2 : 0 ) | ( b ? 4 : 0 ) | ( a ? 8 : 0 );
+	if ( change( _color_mask, bits ) ) { glColorMask( r, g, b, a ); }
+    }
+    void color_mask( GLboolean write ) { color_mask( write, write, write, write ); }
+
+    // Blending on or off; the factors only matter (and are only set) when on.
+    void blend( bool enable, GLenum src = GL_SRC_ALPHA, GLenum dst = GL_ONE_MINUS_SRC_ALPHA ) {
+	if ( change( _blend, enable ? 1 : 0 ) ) {
+	    if ( enable ) { glEnable( GL_BLEND ); } else { glDisable( GL_BLEND ); }
+	}
+	if ( !enable ) { return; }
+	if ( _blend_src == (GLint) src && _blend_dst == (GLint) dst ) { ++_filtered; return; }
+	_blend_src = (GLint) src;
+	_blend_dst = (GLint) dst;
+	++_issued;
+	glBlendFunc( src, dst );
+    }
+
+    unsigned issued() const { return _issued; }
+    unsigned filtered() const { return _filtered; }
+};
+
+}  // namespace Angel
+
+#endif // __ANGEL_RENDER_STATE_H__
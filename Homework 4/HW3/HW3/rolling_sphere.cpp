@@ -26,9 +26,22 @@
 **************************************************************/
 
 #include "Angel-yjc.h"
+#include "mesh_io.h"
+#include "mesh_upload.h"
+#include "program_uniforms.h"
+#include "render_state.h"
+#include "uniform_buffer.h"
+#include "vertex_format.h"
+#include <atomic>
+#include <deque>
 #include <iostream>
-#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 #include <string>
+#include <thread>
 using namespace std;
 
 typedef Angel::vec3  color3;
@@ -51,10 +64,15 @@ GLubyte stripeImage[4 * stripeImageWidth];
 
 GLuint program;       /* shader program object id */
 GLuint floor_buffer;  /* vertex buffer object id for floor */
-GLuint sphere_buffer;
+GLuint sphere_buffer;               /* the sphere's buffers at the level of */
+GLuint sphere_smooth_buffer;        /* detail being drawn (see SphereLevel) */
 GLuint sphere_shadow_buffer;
+vec3 sphere_position_scale;         /* and how to decode their positions */
+vec3 sphere_position_bias;
+MeshletDraws sphere_draws;          /* its meshlets that survive culling */
 GLuint axes_buffer;
 GLuint fireworks_buffer;
+GLuint floor_vao, axes_vao, fireworks_vao;  /* their vertex array objects */
 
 // Projection transformation parameters
 GLfloat  fovy = 45.0;  // Field-of-view in Y direction angle (in degrees)
@@ -84,26 +102,182 @@ int uprightTiltedFlag = 0;
 int latticeFlag = 0;
 int fireworksFlag = 1;
 
+// Every object's vertices are interleaved in one struct, described once by
+// a VertexFormat (see vertex_format.h) that init() uploads with and
+// drawObj() sets the attribute pointers from.
+struct FloorVertex {
+	point4 position;
+	color4 color;
+	vec3 normal;
+	vec2 tex_coord;
+};
+const VertexFormat FloorFormat = { sizeof(FloorVertex), 4, {
+	{ "vPosition", 4, GL_FLOAT, GL_FALSE, offsetof(FloorVertex, position) },
+	{ "vColor", 4, GL_FLOAT, GL_FALSE, offsetof(FloorVertex, color) },
+	{ "vNormal", 3, GL_FLOAT, GL_FALSE, offsetof(FloorVertex, normal) },
+	{ "vTexCoord", 2, GL_FLOAT, GL_FALSE, offsetof(FloorVertex, tex_coord) } } };
+
+struct LineVertex {    // unlit
+	point4 position;
+	color4 color;
+};
+const VertexFormat LineFormat = { sizeof(LineVertex), 2, {
+	{ "vPosition", 4, GL_FLOAT, GL_FALSE, offsetof(LineVertex, position) },
+	{ "vColor", 4, GL_FLOAT, GL_FALSE, offsetof(LineVertex, color) } } };
+
+struct ParticleVertex {
+	point4 position;
+	color4 color;
+	vec4 velocity;
+};
+const VertexFormat ParticleFormat = { sizeof(ParticleVertex), 3, {
+	{ "vPosition", 4, GL_FLOAT, GL_FALSE, offsetof(ParticleVertex, position) },
+	{ "vColor", 4, GL_FLOAT, GL_FALSE, offsetof(ParticleVertex, color) },
+	{ "vVelocity", 4, GL_FLOAT, GL_FALSE, offsetof(ParticleVertex, velocity) } } };
+
+// PackedVertex (see mesh.h): unnormalized shorts, decoded in the vertex shader
+const VertexFormat PackedFormat = { sizeof(PackedVertex), 2, {
+	{ "vPosition", 3, GL_SHORT, GL_FALSE, offsetof(PackedVertex, position) },
+	{ "vNormal", 2, GL_SHORT, GL_FALSE, offsetof(PackedVertex, normal) } } };
+
+// The formats' attribute locations in the program, resolved once after
+// InitShader(); every mesh gets a vertex array object made from them.
+VertexLocations floor_locations, line_locations, particle_locations, packed_locations;
+GLint vColor_location;   // for the sphere's constant color
+
+// The program's uniforms, resolved by name once by resolveUniforms();
+// display() and drawObj() set them through these handles.
+struct ShaderUniforms {
+	UniformMat4 model_view, projection;
+	UniformSampler2D texture_2D;
+	UniformFloat lighting_flag, light_source_flag, vertical_slanted_flag, object_eye_frame_flag;
+	UniformFloat upright_tilted_flag, lattice_flag;
+	UniformFloat is_sphere_flag, is_sphere_shadow_flag, is_floor_flag, is_fireworks_flag;
+	UniformFloat texture_ground_flag, texture_sphere_flag;
+	UniformFloat elapsed_time;
+	UniformFloat packed_flag;
+	UniformVec3 position_scale, position_bias;
+};
+ShaderUniforms uniforms;
+
+// The lights, the materials and the fog are in std140 uniform blocks
+// instead (see vshader42.glsl), laid out by these structs; they are
+// uploaded only when a value changes, and each object binds its material
+// by its offset in material_blocks.
+struct LightBlock {          // "LightSet"
+	color4 global_light_ambient;
+	color4 directional_light_ambient, directional_light_diffuse, directional_light_specular;
+	vec4 directional_light_direction;
+	color4 point_light_ambient, point_light_diffuse, point_light_specular;
+	GLfloat point_const_att, point_linear_att, point_quad_att;
+	GLfloat spotlight_exponent, spotlight_cutoff_angle;
+};
+struct MaterialBlock {       // "Material"
+	color4 ambient, diffuse, specular;
+	GLfloat shininess;
+};
+struct FrameBlock {          // "Frame"
+	vec4 point_light_position_eyeFrame;
+	vec4 spotlight_destination_position_eyeFrame;
+	color4 fog_color;
+	GLfloat fog_linear_start, fog_linear_end, fog_exponential_density, fog_flag;
+};
+enum { LightBinding, MaterialBinding, FrameBinding };  // uniform buffer binding points
+enum { GroundMaterial, SphereMaterial, NumMaterials };
+UniformBuffer<LightBlock> light_block;
+UniformBuffer<MaterialBlock> material_blocks;
+UniformBuffer<FrameBlock> frame_block;
+
+// The polygon mode, depth and color writes and blending, set through this
+// so that display() can state them for every draw at no cost.
+RenderState render_state;
+
+// The floor and the axes are constant data: with constexpr constructors
+// they are laid out by the compiler and need no work at startup.
+
+// floor: 2 triangles, (5, 0, 8) (5, 0, -4) (-5, 0, -4) and (-5, 0, -4) (-5, 0, 8) (5, 0, 8)
 const int floor_NumVertices = 6; //(1 face)*(2 triangles/face)*(3 vertices/triangle)
-point4 floor_points[floor_NumVertices]; // positions for all vertices
-vec3 floor_normals[floor_NumVertices];
-color4 floor_colors[floor_NumVertices]; // colors for all vertices
-vec2 floor_texCoord[floor_NumVertices];
-
-int sphere_NumVertices;
-point4 sphere_points[3200];
-vec3 sphere_normals[3200];
-color4 sphere_colors[3200];
-color4 sphere_shadow_colors[3200];
-
+const FloorVertex floor_vertices[floor_NumVertices] = {
+	{ point4(5.0, 0.0, 8.0, 1.0), color4(0.0, 1.0, 0.0, 1.0), vec3(0.0, 1.0, 0.0), vec2(0.0, 0.0) },
+	{ point4(5.0, 0.0, -4.0, 1.0), color4(0.0, 1.0, 0.0, 1.0), vec3(0.0, 1.0, 0.0), vec2(0.0, 1.5) },
+	{ point4(-5.0, 0.0, -4.0, 1.0), color4(0.0, 1.0, 0.0, 1.0), vec3(0.0, 1.0, 0.0), vec2(1.25, 1.5) },
+	{ point4(-5.0, 0.0, -4.0, 1.0), color4(0.0, 1.0, 0.0, 1.0), vec3(0.0, 1.0, 0.0), vec2(1.25, 1.5) },
+	{ point4(-5.0, 0.0, 8.0, 1.0), color4(0.0, 1.0, 0.0, 1.0), vec3(0.0, 1.0, 0.0), vec2(1.25, 0.0) },
+	{ point4(5.0, 0.0, 8.0, 1.0), color4(0.0, 1.0, 0.0, 1.0), vec3(0.0, 1.0, 0.0), vec2(0.0, 0.0) }
+};
+
+// The sphere is drawn indexed, in one of its levels of detail.  A loaded
+// file gives one level; "icosphere" generates a chain of them.  For flat
+// shading a level is welded on position and normal, which is exact; for
+// smooth shading it has smooth normals (faces further apart than the
+// crease angle stay hard); the unlit shadow is welded on position only.
+// On the GPU the vertices are PackedVertex (see mesh.h), decoded with the
+// level's position scale and bias; the color is the same for every vertex
+// and is set as a constant attribute instead of being stored.  The packed
+// meshes are built in IndexedMeshes, or mapped from the level's cache,
+// which hold their data until it is uploaded.
+struct SphereLevel {
+	PackedMesh flat, smooth, shadow;
+	GLuint flat_buffer, smooth_buffer, shadow_buffer;
+	GLuint flat_index_buffer, smooth_index_buffer, shadow_index_buffer;
+	GLuint flat_vao, smooth_vao, shadow_vao;
+	vec3 position_scale, position_bias;
+	IndexedMesh flat_mesh, smooth_mesh, shadow_mesh;
+	MeshCache cache;
+};
+const color4 sphere_color(1.0, 0.84, 0.0, 1.0);
+const color4 sphere_shadow_color(0.25, 0.25, 0.25, 0.65);
+// Smooth shading averages the faces around a vertex only where they meet
+// at less than the crease angle, so the hard edges of a cube or a machined
+// part stay hard.  Set per file with -crease on the command line or after
+// the name at the prompt; 180 smooths everything.
+const GLfloat default_crease_angle = 60.0;
+const GLfloat sphere_radius = 1.0;
+const GLfloat sphere_lod_edge_pixels = 8.0;  // the longest edge wanted on screen
+int window_height = 512;
+
+// Every loaded file also gets coarser levels of detail, made with
+// SimplifyMesh() from these fractions of its triangles and cached next to
+// it like the file itself (see MeshCachePath()).
+const GLfloat sphere_lod_fractions[] = { 0.5, 0.25, 0.1 };
+const int sphere_NumLodFractions = sizeof(sphere_lod_fractions) / sizeof(sphere_lod_fractions[0]);
+
+// Room for all the levels of the four sphere.* files that come with the
+// program, loaded together.
+const int MaxSphereFiles = 4;
+const int MaxSphereLevels = MaxSphereFiles * (1 + sphere_NumLodFractions);
+SphereLevel* sphere_levels[MaxSphereLevels];  // on the GPU, coarse to fine
+int sphere_NumLevels = 0;
+
+// Levels are built (by readFile(), or by a background thread for paths
+// given on the command line) and handed to the GL thread through
+// sphere_pending; a timer then uploads them a slice per frame.  While the
+// first file loads, a coarse icosphere stands in for it.
+struct SphereFile {
+	string path;
+	GLfloat crease_angle;
+};
+vector<SphereFile> sphere_files;
+std::mutex sphere_pending_lock;
+std::deque<SphereLevel*> sphere_pending;     // built, not on the GPU yet
+bool sphere_loading = false;                 // the background thread runs (under the lock)
+std::thread sphere_loader;
+std::atomic<bool> sphere_cancel(false);      // asks the background thread to stop
+SphereLevel* sphere_uploading = NULL;
+BufferUploader sphere_uploader;
+bool sphere_placeholder = false;
+const GLsizeiptr upload_bytes_per_frame = GLsizeiptr(4) << 20;
+
+// axes: x (red), y (magenta) and z (blue), each from the origin to 10
 const int axes_NumVertices = 6;  //(3 axis)*(1 lines/axis)*(2 vertices/line)
-point4 axes_points[axes_NumVertices];
-color4 axes_colors[axes_NumVertices];
+const LineVertex axes_vertices[axes_NumVertices] = {
+	{ point4(0.0, 0.0, 0.0, 1.0), color4(1.0, 0.0, 0.0, 1.0) }, { point4(10.0, 0.0, 0.0, 1.0), color4(1.0, 0.0, 0.0, 1.0) },
+	{ point4(0.0, 0.0, 0.0, 1.0), color4(1.0, 0.0, 1.0, 1.0) }, { point4(0.0, 10.0, 0.0, 1.0), color4(1.0, 0.0, 1.0, 1.0) },
+	{ point4(0.0, 0.0, 0.0, 1.0), color4(0.0, 0.0, 1.0, 1.0) }, { point4(0.0, 0.0, 10.0, 1.0), color4(0.0, 0.0, 1.0, 1.0) }
+};
 
 const int fireworks_NumParticles = 300;
-point4 fireworks_points[fireworks_NumParticles];
-color4 fireworks_colors[fireworks_NumParticles];
-vec4 fireworks_velocities[fireworks_NumParticles];
+ParticleVertex fireworks_vertices[fireworks_NumParticles];
 
 float elapsed_time = 0.0;
 float sub_time = 0.0f;
@@ -121,7 +295,7 @@ vec4 translate = pointA;
 vec4 vecOY = vec4(0.0, 1.0, 0.0, 0.0);
 double rotateX, rotateY, rotateZ;
 
-mat4 accum_rotation = mat4();
+quat accum_rotation; // rolling accumulated over the finished path segments
 
 //vec4 light_source = vec4(-14.0, 12.0, -3.0, 1.0);
 
@@ -146,7 +320,7 @@ float point_quad_att = 0.001;
 //spotlight
 vec4 spotlight_destination_position(-6.0, 0.0, -4.5, 1.0);
 float spotlight_exponent = 15.0;
-float splotlight_cutoff_angle = 20.0;
+float spotlight_cutoff_angle = 20.0;
 
 //background material
 color4 ground_material_ambient(0.2, 0.2, 0.2, 1.0);
@@ -171,112 +345,269 @@ int Index = 0; // YJC: This must be a global variable since quad() is called
                //      multiple times and Index should then go up to 36 for
                //      the 36 vertices and colors
 
-// quad(): generate two triangles for each face and assign colors to the vertices
-
-//-------------------------------
-// generate 2 triangles: 6 vertices and 6 colors
-void floor()
-{
-	point4 p1 = point4(5.0, 0.0, 8.0, 1.0);
-	point4 p2 = point4(5.0, 0.0, -4.0, 1.0);
-	point4 p3 = point4(-5.0, 0.0, -4.0, 1.0);
-	point4 p4 = point4(-5.0, 0.0, 8.0, 1.0);
+//----------------------------------------------------------------------------
 
-	color4 c = color4(0.0, 1.0, 0.0, 1.0);
-	vec3 normal = vec3(0.0, 1.0, 0.0);
+void fireworks() {
+	for (int i = 0; i < fireworks_NumParticles; i++) {
+		fireworks_vertices[i].position = point4(0.0, 0.1, 0.0, 1.0);
+		fireworks_vertices[i].color = color4(
+			(rand() % 256) / 256.0,
+			(rand() % 256) / 256.0,
+			(rand() % 256) / 256.0,
+			1.0);
+		fireworks_vertices[i].velocity = vec4(
+			10.0*2.0*((rand() % 256) / 256.0 - 0.5),
+			10.0*1.2*2.0*((rand() % 256) / 256.0),
+			10.0*2.0*((rand() % 256) / 256.0 - 0.5),
+			0.0);
+	}
+}
 
-	floor_colors[0] = c; floor_points[0] = p1; floor_normals[0] = normal;
-	floor_colors[1] = c; floor_points[1] = p2; floor_normals[1] = normal;
-	floor_colors[2] = c; floor_points[2] = p3; floor_normals[2] = normal;
+// Meshlet order costs about 0.1 in ACMR at every size, and culling only
+// makes up for that when it skips more than about a tenth of the mesh;
+// smaller meshes (all of the sphere.* files) split into one to ten
+// meshlets that are rarely culled, so they are drawn whole.
+const int sphere_meshlet_min_triangles = 2048;
+
+// Reorders an indexed mesh for the GPU and, if it is large enough, splits
+// it into meshlets (see mesh.h), and reports the post-transform cache
+// statistics before and after, unless name is NULL.
+void optimizeMesh(IndexedMesh& mesh, const char* name) {
+	VertexCacheStats before = mesh.analyze_vertex_cache();
+	mesh.optimize_vertex_cache();
+	mesh.optimize_overdraw();
+	if (mesh.index_count() / 3 >= sphere_meshlet_min_triangles)
+		mesh.build_meshlets();
+	mesh.optimize_vertex_fetch();
+	VertexCacheStats after = mesh.analyze_vertex_cache();
+	if (name)
+		printf("%s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %d meshlets\n", name, before.acmr, after.acmr,
+			before.atvr, after.atvr, (int)mesh.meshlets().size());
+}
 
-	floor_colors[3] = c; floor_points[3] = p3; floor_normals[3] = normal;
-	floor_colors[4] = c; floor_points[4] = p4; floor_normals[4] = normal;
-	floor_colors[5] = c; floor_points[5] = p1; floor_normals[5] = normal;
+// Builds the flat and shadow meshes of a level from its triangles.  The
+// shadow only needs the positions, so it is taken from the indexed
+// triangles of an imported file instead if there are any.
+void buildSphereLevel(SphereLevel& level, const point4* points, const vec3* normals, int count, bool report,
+	const ImportedMesh* imported = NULL) {
+	level.flat_mesh.build(points, normals, count, true);
+	if (imported && !imported->indices.empty())
+		level.shadow_mesh.build(&imported->positions[0], (int)imported->positions.size(), &imported->indices[0],
+			(int)imported->indices.size());
+	else
+		level.shadow_mesh.build(points, normals, count, false);
+	optimizeMesh(level.flat_mesh, report ? "sphere" : NULL);
+	optimizeMesh(level.shadow_mesh, report ? "sphere shadow" : NULL);
+}
 
-	floor_texCoord[0] = vec2(0.0, 0.0);
-	floor_texCoord[1] = vec2(0.0, 1.5);
-	floor_texCoord[2] = vec2(1.25, 1.5);
+// Packs the three meshes of a built level for the GPU.  They all have the
+// same positions, so they share the bounds of the flat one.
+void packSphereLevel(SphereLevel& level) {
+	level.flat_mesh.packed_bounds(level.position_scale, level.position_bias);
+	level.flat_mesh.pack(level.flat, level.position_scale, level.position_bias);
+	level.smooth_mesh.pack(level.smooth, level.position_scale, level.position_bias);
+	level.shadow_mesh.pack(level.shadow, level.position_scale, level.position_bias);
+}
 
-	floor_texCoord[3] = vec2(1.25, 1.5);
-	floor_texCoord[4] = vec2(1.25, 0.0);
-	floor_texCoord[5] = vec2(0.0, 0.0);
+void addPendingSphereLevel(SphereLevel* level) {
+	std::lock_guard<std::mutex> guard(sphere_pending_lock);
+	sphere_pending.push_back(level);
 }
 
-//----------------------------------------------------------------------------
+// Icosphere subdivision level l has 20 * 4^l triangles, with exact normals.
+SphereLevel* generateSphereLevel(int subdivisions) {
+	SphereLevel* level = new SphereLevel;
+	level->smooth_mesh.build_icosphere(subdivisions);
+	optimizeMesh(level->smooth_mesh, NULL);
+	Mesh flat;
+	level->smooth_mesh.unroll(flat);
+	buildSphereLevel(*level, flat.points(), flat.normals(), flat.size(), false);
+	packSphereLevel(*level);
+	return level;
+}
 
-void axes() {
-	point4 origin = point4(0.0, 0.0, 0.0, 1.0);
-	point4 x_axis_point = point4(10.0, 0.0, 0.0, 1.0);
-	point4 y_axis_point = point4(0.0, 10.0, 0.0, 1.0);
-	point4 z_axis_point = point4(0.0, 0.0, 10.0, 1.0);
-	color4 red = color4(1.0, 0.0, 0.0, 1.0);
-	color4 magenta = color4(1.0, 0.0, 1.0, 1.0);
-	color4 blue = color4(0.0, 0.0, 1.0, 1.0);
+// The level of a loaded or simplified triangle list, or of an imported
+// file (whose triangles are also given unrolled, for the flat mesh).  The
+// smooth mesh starts from the shadow, which is already welded on position.
+SphereLevel* buildLoadedSphereLevel(const point4* points, const vec3* normals, int count, GLfloat crease_angle,
+	ThreadPool& pool, bool report, const ImportedMesh* imported = NULL) {
+	SphereLevel* level = new SphereLevel;
+	buildSphereLevel(*level, points, normals, count, report, imported);
+	level->smooth_mesh.build_smooth(level->shadow_mesh, crease_angle, NormalWeightAngle, &pool);
+	optimizeMesh(level->smooth_mesh, report ? "smooth sphere" : NULL);
+	packSphereLevel(*level);
+	return level;
+}
 
-	axes_colors[0] = red; axes_points[0] = origin;
-	axes_colors[1] = red; axes_points[1] = x_axis_point;
+// What a cached level depends on besides its file: the versions of the
+// code that made it (SimplifyMeshVersion for a simplified level, 0 for the
+// file's own) and the parameters it was made with.
+uint64_t sphereLevelKey(GLfloat crease_angle, unsigned simplify_version) {
+	uint64_t key = MeshCacheKey(&PackedMeshVersion, sizeof(PackedMeshVersion));
+	key = MeshCacheKey(&simplify_version, sizeof(simplify_version), key);
+	key = MeshCacheKey(&crease_angle, sizeof(crease_angle), key);
+	return MeshCacheKey(&sphere_meshlet_min_triangles, sizeof(sphere_meshlet_min_triangles), key);
+}
 
-	axes_colors[2] = magenta; axes_points[2] = origin;
-	axes_colors[3] = magenta; axes_points[3] = y_axis_point;
+// The level cached at "cache_path", mapped, if the cache is still valid
+// for "filename" and "key"; NULL otherwise.
+SphereLevel* openCachedSphereLevel(const string& cache_path, const string& filename, uint64_t key) {
+	SphereLevel* level = new SphereLevel;
+	if (!level->cache.open(cache_path.c_str(), filename.c_str(), key) || level->cache.mesh_count() != 3) {
+		delete level;
+		return NULL;
+	}
+	level->flat = level->cache.mesh(0);
+	level->smooth = level->cache.mesh(1);
+	level->shadow = level->cache.mesh(2);
+	level->position_scale = level->cache.position_scale();
+	level->position_bias = level->cache.position_bias();
+	return level;
+}
 
-	axes_colors[4] = blue; axes_points[4] = origin;
-	axes_colors[5] = blue; axes_points[5] = z_axis_point;
+void writeSphereLevelCache(const SphereLevel& level, const string& cache_path, const string& filename, uint64_t key) {
+	const PackedMesh meshes[3] = { level.flat, level.smooth, level.shadow };
+	if (!WriteMeshCache(cache_path.c_str(), filename.c_str(), meshes, 3, level.position_scale, level.position_bias,
+			key))
+		printf("Warning: could not write the mesh cache %s\n", cache_path.c_str());
 }
 
-void fireworks() {
-	for (int i = 0; i < fireworks_NumParticles; i++) {
-		fireworks_points[i] = point4(0.0, 0.1, 0.0, 1.0);
-		fireworks_colors[i] = color4(
-			(rand() % 256) / 256.0,
-			(rand() % 256) / 256.0,
-			(rand() % 256) / 256.0,
-			1.0);
-		fireworks_velocities[i] = vec4(
-			10.0*2.0*((rand() % 256) / 256.0 - 0.5),
-			10.0*1.2*2.0*((rand() % 256) / 256.0),
-			10.0*2.0*((rand() % 256) / 256.0 - 0.5),
-			0.0);
+// Parses a mesh file (polygons, OBJ, PLY or STL) into "mesh", and, if it
+// is imported, also into "imported".  Returns false after printing why if
+// it cannot be read.
+bool parseSphereFile(const string& filename, Mesh& mesh, ImportedMesh& imported, ThreadPool& pool) {
+	// Polygon files are memory-mapped and parsed in place, in parallel
+	// if they are large; OBJ, PLY and STL files are streamed through
+	// an importer (see mesh_io.h).  The mesh grows to whatever size it has.
+	MeshParseError err;
+	bool loaded;
+	if (MeshFormatOf(filename.c_str()) == MeshFormatPolygons)
+		loaded = LoadPolygonFile(filename.c_str(), mesh, err, &pool);
+	else {
+		loaded = ImportMeshFile(filename.c_str(), imported, err);
+		if (loaded)
+			imported.unroll(mesh);
+	}
+	if (!loaded) {
+		if (err.line == 0)
+			printf("Error! %s: %s\n", filename.c_str(), err.message);
+		else
+			printf("Error! %s:%d:%d: %s\n", filename.c_str(), err.line, err.column, err.message);
 	}
+	return loaded;
 }
 
-void readFile() {
-	cout << "Please type in a filename." << endl;
-	string filename;
-	cin >> filename;
-
-	ifstream ifs(filename);
-	int numPolygons;
-	int numVertices;
-	int index = 0;
-	ifs >> numPolygons;
-	for (int i = 0; i < numPolygons; i++) {
-		ifs >> numVertices;
-		vec3 vertices[3];
-
-		for (int j = 0; j < numVertices; j++) {
-			ifs >> vertices[j][0] >> vertices[j][1] >> vertices[j][2];
+// Loads a mesh file (polygons, OBJ, PLY or STL), and builds its level and those of its simplified
+// versions, smoothed up to "crease_angle" degrees.  Safe to call from any thread.  Returns false (after printing
+// why) if the file cannot be read; the levels already drawn stay.  Stops
+// between levels once sphere_cancel is set.
+bool loadSphereLevels(const string& filename, GLfloat crease_angle, ThreadPool& pool) {
+	Mesh mesh;
+	ImportedMesh imported;
+	bool parsed = false;
+
+	// A level whose cache is still valid for this file and crease angle is
+	// mapped and uploaded straight from the mapping; the file is only
+	// parsed if some level has to be built.
+	string cache_path = MeshCachePath(filename.c_str());
+	uint64_t key = sphereLevelKey(crease_angle, 0);
+	SphereLevel* level = openCachedSphereLevel(cache_path, filename, key);
+	if (level == NULL) {
+		if (!parseSphereFile(filename, mesh, imported, pool))
+			return false;
+		parsed = true;
+		level = buildLoadedSphereLevel(mesh.points(), mesh.normals(), mesh.size(), crease_angle, pool, true,
+			&imported);
+		writeSphereLevelCache(*level, cache_path, filename, key);
+	}
+	int triangles = level->flat.index_count / 3;   // welding keeps every triangle
+	addPendingSphereLevel(level);
+
+	// The coarser levels, always simplified from the full mesh.
+	uint64_t lod_key = sphereLevelKey(crease_angle, SimplifyMeshVersion);
+	for (int f = 0; f < sphere_NumLodFractions && !sphere_cancel; f++) {
+		int target = (int)(sphere_lod_fractions[f] * triangles);
+		if (target < 4 || target >= triangles)
+			continue;
+		char suffix[16];
+		snprintf(suffix, sizeof(suffix), ".lod%d", (int)(sphere_lod_fractions[f] * 100 + 0.5));
+		string lod_path = cache_path + suffix;
+		SphereLevel* lod_level = openCachedSphereLevel(lod_path, filename, lod_key);
+		if (lod_level == NULL) {
+			if (!parsed && !parseSphereFile(filename, mesh, imported, pool))
+				return false;
+			parsed = true;
+			Mesh lod;
+			GLfloat error = SimplifyMesh(mesh.points(), mesh.size(), target, lod, &pool);
+			printf("%s: %d%% level of detail, %d triangles, error %g\n", filename.c_str(),
+				(int)(sphere_lod_fractions[f] * 100 + 0.5), lod.size() / 3, error);
+			lod_level = buildLoadedSphereLevel(lod.points(), lod.normals(), lod.size(), crease_angle, pool, false);
+			writeSphereLevelCache(*lod_level, lod_path, filename, lod_key);
 		}
+		addPendingSphereLevel(lod_level);
+	}
+	return true;
+}
 
-		vec4 u = vertices[1] - vertices[0];
-		vec4 v = vertices[2] - vertices[1];
-		vec3 normal = normalize(cross(u, v));
-
-		for (int j = 0; j < numVertices; j++) {
-			sphere_points[index] = point4(vertices[j][0], vertices[j][1], vertices[j][2], 1.0);
-			sphere_normals[index] = normal;
-			sphere_colors[index] = color4(1.0, 0.84, 0.0, 1.0);
-			sphere_shadow_colors[index] = color4(0.25, 0.25, 0.25, 0.65);
+// A crease angle in degrees, from 0 to 180.
+bool parseCreaseAngle(const string& text, GLfloat& angle) {
+	char* end;
+	double a = strtod(text.c_str(), &end);
+	if (text.empty() || *end != '\0' || !(a >= 0.0 && a <= 180.0))
+		return false;
+	angle = (GLfloat)a;
+	return true;
+}
 
-			index++;
+// Asks for a file until one loads.
+void readFile() {
+	ThreadPool pool;
+	for (;;) {
+		cout << "Please type in a filename (a polygon, .obj, .ply or .stl file, or \"icosphere\" for a generated sphere)," << endl
+			<< "optionally followed by the crease angle for smooth shading (default " << default_crease_angle << " degrees)." << endl;
+		string line;
+		if (!getline(cin, line))
+			exit(-1);
+		istringstream words(line);
+		string filename, angle_text;
+		if (!(words >> filename))
+			continue;
+		GLfloat crease_angle = default_crease_angle;
+		if (words >> angle_text && !parseCreaseAngle(angle_text, crease_angle)) {
+			printf("Error! The crease angle must be a number of degrees from 0 to 180\n");
+			continue;
 		}
 
-		
+		if (filename == "icosphere") {
+			for (int l = 0; l <= 5; l++)
+				addPendingSphereLevel(generateSphereLevel(l));
+			printf("icosphere: 6 levels, 20 to 20480 triangles\n");
+			return;
+		}
+		if (loadSphereLevels(filename, crease_angle, pool))
+			return;
 	}
+}
 
-	sphere_NumVertices = numPolygons * numVertices;
-
+// The background loader for the paths given on the command line.  Files
+// that cannot be read are skipped; if none can, the placeholder stays.
+void loadSpheresInBackground() {
+	ThreadPool pool;
+	for (size_t i = 0; i < sphere_files.size() && !sphere_cancel; i++)
+		loadSphereLevels(sphere_files[i].path, sphere_files[i].crease_angle, pool);
+	std::lock_guard<std::mutex> guard(sphere_pending_lock);
+	sphere_loading = false;
 }
 
+// Ends the program, after the background loader (if any) has stopped, so
+// that it does not run on while the globals are destroyed.
+void quit(int status) {
+	if (sphere_loader.joinable()) {
+		sphere_cancel = true;
+		sphere_loader.join();
+	}
+	exit(status);
+}
 
 
 /*************************************************************
@@ -339,74 +670,222 @@ void image_set_up(void)
 } /* end function */
 
 
+// Creates the vertex buffer (in PackedVertex format), the element buffer
+// and the vertex array object of a packed mesh, and queues the buffers'
+// contents on "up".
+void queuePackedMesh(const PackedMesh& mesh, GLuint& buffer, GLuint& index_buffer, GLuint& vao, BufferUploader& up)
+{
+	buffer = CreateVertexBuffer(PackedFormat, NULL, mesh.vertex_count);
+	up.add(GL_ARRAY_BUFFER, buffer, 0, mesh.vertices, sizeof(PackedVertex) * mesh.vertex_count);
+
+	glGenBuffers(1, &index_buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.index_size() * mesh.index_count, NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	up.add(GL_ELEMENT_ARRAY_BUFFER, index_buffer, 0, mesh.indices, mesh.index_size() * mesh.index_count);
+
+	vao = CreateVertexArray(PackedFormat, packed_locations, buffer, index_buffer);
+}
+
+void queueSphereLevel(SphereLevel& level, BufferUploader& up)
+{
+	queuePackedMesh(level.flat, level.flat_buffer, level.flat_index_buffer, level.flat_vao, up);
+	queuePackedMesh(level.smooth, level.smooth_buffer, level.smooth_index_buffer, level.smooth_vao, up);
+	queuePackedMesh(level.shadow, level.shadow_buffer, level.shadow_index_buffer, level.shadow_vao, up);
+}
+
+void deleteSphereLevel(SphereLevel* level)
+{
+	GLuint buffers[6] = { level->flat_buffer, level->smooth_buffer, level->shadow_buffer,
+		level->flat_index_buffer, level->smooth_index_buffer, level->shadow_index_buffer };
+	glDeleteBuffers(6, buffers);
+	GLuint vaos[3] = { level->flat_vao, level->smooth_vao, level->shadow_vao };
+	glDeleteVertexArrays(3, vaos);
+	delete level;
+}
+
+// Makes an uploaded level drawable: its CPU copies are freed (or its cache
+// unmapped), and it is inserted by triangle count, replacing the placeholder.
+void addSphereLevel(SphereLevel* level)
+{
+	level->flat_mesh.release();
+	level->smooth_mesh.release();
+	level->shadow_mesh.release();
+	level->cache.close();
+
+	if (sphere_placeholder) {
+		deleteSphereLevel(sphere_levels[0]);
+		sphere_NumLevels = 0;
+		sphere_placeholder = false;
+	}
+	if (sphere_NumLevels == MaxSphereLevels) {
+		printf("Warning: only %d levels of detail are kept\n", MaxSphereLevels);
+		deleteSphereLevel(level);
+		return;
+	}
+	int l = sphere_NumLevels++;
+	for (; l > 0 && sphere_levels[l - 1]->flat.index_count > level->flat.index_count; l--)
+		sphere_levels[l] = sphere_levels[l - 1];
+	sphere_levels[l] = level;
+}
+
+// Uploads at most upload_bytes_per_frame of the pending levels, one level
+// at a time.
+void updateSphereLoading()
+{
+	if (sphere_uploading == NULL) {
+		std::lock_guard<std::mutex> guard(sphere_pending_lock);
+		if (sphere_pending.empty())
+			return;
+		sphere_uploading = sphere_pending.front();
+		sphere_pending.pop_front();
+		queueSphereLevel(*sphere_uploading, sphere_uploader);
+	}
+	if (sphere_uploader.step(upload_bytes_per_frame)) {
+		addSphereLevel(sphere_uploading);
+		sphere_uploading = NULL;
+	}
+}
+
+// Runs every frame's worth of time until all command-line files are on the
+// GPU, independently of the animation (idle() is off while it is paused).
+void loadingTimer(int)
+{
+	updateSphereLoading();
+	glutPostRedisplay();
+	std::lock_guard<std::mutex> guard(sphere_pending_lock);
+	if (sphere_loading || !sphere_pending.empty() || sphere_uploading != NULL)
+		glutTimerFunc(16, loadingTimer, 0);
+}
+
+// Looks up every uniform of the program once; names that do not resolve
+// (and uniforms that nothing sets) are reported.
+void resolveUniforms()
+{
+	ProgramUniforms table(program);
+	ShaderUniforms& u = uniforms;
+	table.bind("model_view", u.model_view);
+	table.bind("projection", u.projection);
+	table.bind("texture_2D", u.texture_2D);
+	table.bind("lighting_flag", u.lighting_flag);
+	table.bind("light_source_flag", u.light_source_flag);
+	table.bind("vertical_slanted_flag", u.vertical_slanted_flag);
+	table.bind("object_eye_frame_flag", u.object_eye_frame_flag);
+	table.bind("upright_tilted_flag", u.upright_tilted_flag);
+	table.bind("lattice_flag", u.lattice_flag);
+	table.bind("is_sphere_flag", u.is_sphere_flag);
+	table.bind("is_sphere_shadow_flag", u.is_sphere_shadow_flag);
+	table.bind("is_floor_flag", u.is_floor_flag);
+	table.bind("is_fireworks_flag", u.is_fireworks_flag);
+	table.bind("texture_ground_flag", u.texture_ground_flag);
+	table.bind("texture_sphere_flag", u.texture_sphere_flag);
+	table.bind("elapsed_time", u.elapsed_time);
+	table.bind("packed_flag", u.packed_flag);
+	table.bind("position_scale", u.position_scale);
+	table.bind("position_bias", u.position_bias);
+	table.bind_block("LightSet", LightBinding, sizeof(LightBlock));
+	table.bind_block("Material", MaterialBinding, sizeof(MaterialBlock));
+	table.bind_block("Frame", FrameBinding, sizeof(FrameBlock));
+	table.report_unbound();
+}
+
+// Copies the light, material and fog values into their blocks, and
+// uploads whatever changed since the last frame (usually nothing, or the
+// eye-frame light positions when the view moves).
+void updateUniformBlocks(const affine3x4& view)
+{
+	light_block.set(&LightBlock::global_light_ambient, global_light_ambient);
+	light_block.set(&LightBlock::directional_light_ambient, directional_light_ambient);
+	light_block.set(&LightBlock::directional_light_diffuse, directional_light_diffuse);
+	light_block.set(&LightBlock::directional_light_specular, directional_light_specular);
+	light_block.set(&LightBlock::directional_light_direction, directional_light_direction);
+	light_block.set(&LightBlock::point_light_ambient, point_light_ambient);
+	light_block.set(&LightBlock::point_light_diffuse, point_light_diffuse);
+	light_block.set(&LightBlock::point_light_specular, point_light_specular);
+	light_block.set(&LightBlock::point_const_att, point_const_att);
+	light_block.set(&LightBlock::point_linear_att, point_linear_att);
+	light_block.set(&LightBlock::point_quad_att, point_quad_att);
+	light_block.set(&LightBlock::spotlight_exponent, spotlight_exponent);
+	light_block.set(&LightBlock::spotlight_cutoff_angle, spotlight_cutoff_angle);
+	light_block.flush();
+
+	const color4* ambient[NumMaterials] = { &ground_material_ambient, &sphere_material_ambient };
+	const color4* diffuse[NumMaterials] = { &ground_material_diffuse, &sphere_material_diffuse };
+	const color4* specular[NumMaterials] = { &ground_material_specular, &sphere_material_specular };
+	const float* shininess[NumMaterials] = { &ground_material_shininess, &sphere_material_shininess };
+	for (int m = 0; m < NumMaterials; m++) {
+		material_blocks.set(m, &MaterialBlock::ambient, *ambient[m]);
+		material_blocks.set(m, &MaterialBlock::diffuse, *diffuse[m]);
+		material_blocks.set(m, &MaterialBlock::specular, *specular[m]);
+		material_blocks.set(m, &MaterialBlock::shininess, *shininess[m]);
+	}
+	material_blocks.flush();
+
+	frame_block.set(&FrameBlock::point_light_position_eyeFrame, view * point_light_position);
+	frame_block.set(&FrameBlock::spotlight_destination_position_eyeFrame, view * spotlight_destination_position);
+	frame_block.set(&FrameBlock::fog_color, fog_color);
+	frame_block.set(&FrameBlock::fog_linear_start, fog_linear_start);
+	frame_block.set(&FrameBlock::fog_linear_end, fog_linear_end);
+	frame_block.set(&FrameBlock::fog_exponential_density, fog_exponential_density);
+	frame_block.set(&FrameBlock::fog_flag, fogFlag);
+	frame_block.flush();
+}
+
 // OpenGL initialization
 void init()
 {
-	readFile();
-
-#if 0 //YJC: The following is not needed
-    // Create a vertex array object
-    GLuint vao;
-    glGenVertexArrays( 1, &vao );
-    glBindVertexArray( vao );
-#endif
-
-    floor();     
- // Create and initialize a vertex buffer object for floor, to be used in display()
-    glGenBuffers(1, &floor_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, floor_buffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(floor_points) + sizeof(floor_colors) + sizeof(vec3) * floor_NumVertices + sizeof(vec2) * floor_NumVertices,
-		 NULL, GL_STATIC_DRAW);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(floor_points), floor_points);
-    glBufferSubData(GL_ARRAY_BUFFER, sizeof(floor_points), sizeof(floor_colors),
-                    floor_colors);
-	glBufferSubData(GL_ARRAY_BUFFER, sizeof(floor_points) + sizeof(floor_colors), sizeof(vec3) * floor_NumVertices, floor_normals);
-	glBufferSubData(GL_ARRAY_BUFFER, sizeof(floor_points) + sizeof(floor_colors) + sizeof(vec3) * floor_NumVertices, sizeof(vec2) * floor_NumVertices, floor_texCoord);
-
- // Sphere
-	glGenBuffers(1, &sphere_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, sphere_buffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(point4) * sphere_NumVertices + sizeof(color4) * sphere_NumVertices + sizeof(vec3) * sphere_NumVertices,
-		NULL, GL_STATIC_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(point4) * sphere_NumVertices, sphere_points);
-	glBufferSubData(GL_ARRAY_BUFFER, sizeof(point4) * sphere_NumVertices, sizeof(color4) * sphere_NumVertices,
-		sphere_colors);
-	glBufferSubData(GL_ARRAY_BUFFER, sizeof(point4) * sphere_NumVertices + sizeof(color4) * sphere_NumVertices, sizeof(vec3) * sphere_NumVertices, sphere_normals);
-
- // Sphere shadow
-	glGenBuffers(1, &sphere_shadow_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, sphere_shadow_buffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(point4) * sphere_NumVertices + sizeof(color4) * sphere_NumVertices + sizeof(vec3) * sphere_NumVertices,
-		NULL, GL_STATIC_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(point4) * sphere_NumVertices, sphere_points);
-	glBufferSubData(GL_ARRAY_BUFFER, sizeof(point4) * sphere_NumVertices, sizeof(color4) * sphere_NumVertices,
-		sphere_shadow_colors);
-	glBufferSubData(GL_ARRAY_BUFFER, sizeof(point4) * sphere_NumVertices + sizeof(color4) * sphere_NumVertices, sizeof(vec3) * sphere_NumVertices, sphere_normals);
-
- // Axes
-	axes();
-	glGenBuffers(1, &axes_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, axes_buffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(point4) * axes_NumVertices + sizeof(color4) * axes_NumVertices + sizeof(vec3) * sphere_NumVertices,
-		NULL, GL_STATIC_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(point4) * axes_NumVertices, axes_points);
-	glBufferSubData(GL_ARRAY_BUFFER, sizeof(point4) * axes_NumVertices, sizeof(color4) * axes_NumVertices,
-		axes_colors);
-	glBufferSubData(GL_ARRAY_BUFFER, sizeof(point4) * axes_NumVertices + sizeof(color4) * axes_NumVertices, sizeof(vec3) * sphere_NumVertices, sphere_normals);
+ // Load shaders and create a shader program (to be used in display()),
+ // and look up where each vertex format's attributes and each uniform go
+    program = InitShader("vshader42.glsl", "fshader42.glsl");
+	floor_locations = ResolveVertexLocations(FloorFormat, program);
+	line_locations = ResolveVertexLocations(LineFormat, program);
+	particle_locations = ResolveVertexLocations(ParticleFormat, program);
+	packed_locations = ResolveVertexLocations(PackedFormat, program);
+	vColor_location = glGetAttribLocation(program, "vColor");
+	resolveUniforms();
+	light_block.create(LightBinding);
+	material_blocks.create(MaterialBinding, NumMaterials);
+	frame_block.create(FrameBinding);
+	light_block.bind();
+	frame_block.bind();
+
+	if (sphere_files.empty()) {
+		// Interactive: ask for the file and upload it before the first frame.
+		readFile();
+		while (!sphere_pending.empty()) {
+			SphereLevel* level = sphere_pending.front();
+			sphere_pending.pop_front();
+			queueSphereLevel(*level, sphere_uploader);
+			sphere_uploader.finish();
+			addSphereLevel(level);
+		}
+	}
+	else {
+		// Paths on the command line: draw a coarse icosphere right away and
+		// load the files in the background (see updateSphereLoading()).
+		SphereLevel* placeholder = generateSphereLevel(2);
+		queueSphereLevel(*placeholder, sphere_uploader);
+		sphere_uploader.finish();
+		addSphereLevel(placeholder);
+		sphere_placeholder = true;
+		sphere_loading = true;
+		sphere_loader = std::thread(loadSpheresInBackground);
+		glutTimerFunc(16, loadingTimer, 0);
+	}
+
+ // Create and initialize a vertex buffer object and a vertex array object
+ // for floor, to be used in display()
+	floor_buffer = CreateVertexBuffer(FloorFormat, floor_vertices, floor_NumVertices);
+	floor_vao = CreateVertexArray(FloorFormat, floor_locations, floor_buffer);
+
+ // Axes (no normals: the axes are not lit)
+	axes_buffer = CreateVertexBuffer(LineFormat, axes_vertices, axes_NumVertices);
+	axes_vao = CreateVertexArray(LineFormat, line_locations, axes_buffer);
 
  // Fireworks
 	fireworks();
-	glGenBuffers(1, &fireworks_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, fireworks_buffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(point4) * fireworks_NumParticles + sizeof(color4) * fireworks_NumParticles + sizeof(vec4) * fireworks_NumParticles,
-		NULL, GL_STATIC_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(point4) * fireworks_NumParticles, fireworks_points);
-	glBufferSubData(GL_ARRAY_BUFFER, sizeof(point4) * fireworks_NumParticles, sizeof(color4) * fireworks_NumParticles,
-		fireworks_colors);
-	glBufferSubData(GL_ARRAY_BUFFER, sizeof(point4) * fireworks_NumParticles + sizeof(color4) * fireworks_NumParticles, sizeof(vec4) * fireworks_NumParticles, fireworks_velocities);
-	
- // Load shaders and create a shader program (to be used in display())
-    program = InitShader("vshader42.glsl", "fshader42.glsl");
+	fireworks_buffer = CreateVertexBuffer(ParticleFormat, fireworks_vertices, fireworks_NumParticles);
+	fireworks_vao = CreateVertexArray(ParticleFormat, particle_locations, fireworks_buffer);
     
     glEnable( GL_DEPTH_TEST );
     glClearColor( 0.529, 0.807, 0.92, 0.0 ); 
@@ -449,147 +928,128 @@ void init()
 
 }
 //----------------------------------------------------------------------------
-// drawObj(buffer, num_vertices):
+// drawObj(buffer, vao, num_vertices):
 //   draw the object that is associated with the vertex buffer object "buffer"
-//   and has "num_vertices" vertices.
+//   (which picks its uniforms) and the vertex array object "vao", and has
+//   "num_vertices" vertices.
+// drawObj(buffer, vao, num_vertices, drawType, num_indices, index_type):
+//   the same for an indexed object: "num_indices" indices of "index_type"
+//   (GL_UNSIGNED_SHORT or GL_UNSIGNED_INT) from the element buffer of "vao".
+// drawObj(..., draws):
+//   only the parts of the index buffer in "draws", with glMultiDrawElements().
 //
-void drawObj(GLuint buffer, int num_vertices, GLuint drawType)
+void drawObj(GLuint buffer, GLuint vao, int num_vertices, GLuint drawType,
+	int num_indices = 0, GLenum index_type = GL_UNSIGNED_INT, const MeshletDraws* draws = NULL)
 {
-	if (buffer == sphere_shadow_buffer && shadowBlendingFlag == 1) {
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	}
-    //--- Activate the vertex buffer object to be drawn ---//
-    glBindBuffer(GL_ARRAY_BUFFER, buffer);
-
-	GLuint vPosition = glGetAttribLocation(program, "vPosition");
-	GLuint vColor = glGetAttribLocation(program, "vColor");
-	GLuint vNormal = glGetAttribLocation(program, "vNormal");
-	GLuint vTexCoord = glGetAttribLocation(program, "vTexCoord");
-	GLuint vVelocity = glGetAttribLocation(program, "vVelocity");
-    /*----- Set up vertex attribute arrays for each vertex attribute -----*/
-    
-	if (buffer == fireworks_buffer) {
-		glEnableVertexAttribArray(vPosition);
-		glVertexAttribPointer(vPosition, 4, GL_FLOAT, GL_FALSE, 0,
-			BUFFER_OFFSET(0));
-
-		glEnableVertexAttribArray(vColor);
-		glVertexAttribPointer(vColor, 4, GL_FLOAT, GL_FALSE, 0,
-			BUFFER_OFFSET(sizeof(point4) * num_vertices));
-
-		glEnableVertexAttribArray(vVelocity);
-		glVertexAttribPointer(vVelocity, 4, GL_FLOAT, GL_FALSE, 0,
-			BUFFER_OFFSET(sizeof(point4) * num_vertices + sizeof(color4) * num_vertices));
-
-	}
-	else {
-		glEnableVertexAttribArray(vPosition);
-		glVertexAttribPointer(vPosition, 4, GL_FLOAT, GL_FALSE, 0,
-			BUFFER_OFFSET(0));
-
-		glEnableVertexAttribArray(vColor);
-		glVertexAttribPointer(vColor, 4, GL_FLOAT, GL_FALSE, 0,
-			BUFFER_OFFSET(sizeof(point4) * num_vertices));
-		// the offset is the (total) size of the previous vertex attribute array(s)
-
-		glEnableVertexAttribArray(vNormal);
-		glVertexAttribPointer(vNormal, 3, GL_FLOAT, GL_FALSE, 0,
-			BUFFER_OFFSET(sizeof(point4) * num_vertices + sizeof(color4) * num_vertices));
-
-		glEnableVertexAttribArray(vTexCoord);
-		glVertexAttribPointer(vTexCoord, 2, GL_FLOAT, GL_FALSE, 0,
-			BUFFER_OFFSET(sizeof(point4) * num_vertices + sizeof(color4) * num_vertices + sizeof(vec3) * num_vertices));
+	bool is_sphere = buffer == sphere_buffer || buffer == sphere_smooth_buffer;
+	bool is_packed = is_sphere || buffer == sphere_shadow_buffer;
+	render_state.blend(buffer == sphere_shadow_buffer && shadowBlendingFlag == 1, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    //--- Activate the vertex array object, with all of its attributes ---//
+	glBindVertexArray(vao);
+	if (is_packed && vColor_location >= 0) {
+		// the color is constant over the mesh
+		glVertexAttrib4fv(vColor_location, buffer == sphere_shadow_buffer ? sphere_shadow_color : sphere_color);
 	}
     
 	if (buffer == floor_buffer) {
-		glUniform1i(glGetUniformLocation(program, "texture_2D"), 0);
+		uniforms.texture_2D.set(0);
 	}
-	else if (buffer == sphere_buffer) {
+	else if (is_sphere) {
 		if (textureSphereFlag == 1)
-			glUniform1i(glGetUniformLocation(program, "texture_2D"), 1);
+			uniforms.texture_2D.set(1);
 		else if (textureSphereFlag == 2)
-			glUniform1i(glGetUniformLocation(program, "texture_2D"), 0);
-	}
-	if (buffer == sphere_buffer) {
-		glUniform4fv(glGetUniformLocation(program, "material_ambient"), 1, sphere_material_ambient);
-		glUniform4fv(glGetUniformLocation(program, "material_diffuse"), 1, sphere_material_diffuse);
-		glUniform4fv(glGetUniformLocation(program, "material_specular"), 1, sphere_material_specular);
-		glUniform1f(glGetUniformLocation(program, "material_shininess"), sphere_material_shininess);
-	}
-	else {
-		glUniform4fv(glGetUniformLocation(program, "material_ambient"), 1, ground_material_ambient);
-		glUniform4fv(glGetUniformLocation(program, "material_diffuse"), 1, ground_material_diffuse);
-		glUniform4fv(glGetUniformLocation(program, "material_specular"), 1, ground_material_specular);
-		glUniform1f(glGetUniformLocation(program, "material_shininess"), ground_material_shininess);
+			uniforms.texture_2D.set(0);
 	}
+	material_blocks.bind(is_sphere ? SphereMaterial : GroundMaterial);
 
-	if (buffer == axes_buffer || buffer == sphere_shadow_buffer || (buffer == sphere_buffer && sphereFlag == 0))
-		glUniform1f(glGetUniformLocation(program, "lighting_flag"), 0);
+	if (buffer == axes_buffer || buffer == sphere_shadow_buffer || (is_sphere && sphereFlag == 0))
+		uniforms.lighting_flag.set(0);
 	else
-		glUniform1f(glGetUniformLocation(program, "lighting_flag"), lightingFlag);
+		uniforms.lighting_flag.set(lightingFlag);
 
-	if (buffer == sphere_buffer) {
-		glUniform1f(glGetUniformLocation(program, "is_sphere_flag"), 1);
+	if (is_sphere) {
+		uniforms.is_sphere_flag.set(1);
 	}
 	else {
-		glUniform1f(glGetUniformLocation(program, "is_sphere_flag"), 0);
+		uniforms.is_sphere_flag.set(0);
 	}
 
 	if (buffer == sphere_shadow_buffer) {
-		glUniform1f(glGetUniformLocation(program, "is_sphere_shadow_flag"), 1);
+		uniforms.is_sphere_shadow_flag.set(1);
 	}
 	else {
-		glUniform1f(glGetUniformLocation(program, "is_sphere_shadow_flag"), 0);
+		uniforms.is_sphere_shadow_flag.set(0);
 	}
 
 	if (buffer == floor_buffer) {
-		glUniform1f(glGetUniformLocation(program, "is_floor_flag"), 1);
+		uniforms.is_floor_flag.set(1);
 	}
 	else {
-		glUniform1f(glGetUniformLocation(program, "is_floor_flag"), 0);
+		uniforms.is_floor_flag.set(0);
 	}
 
-	glUniform1f(glGetUniformLocation(program, "texture_ground_flag"), textureGroundFlag);
+	uniforms.texture_ground_flag.set(textureGroundFlag);
 
-	if (buffer == sphere_buffer && sphereFlag == 1)
-		glUniform1f(glGetUniformLocation(program, "texture_sphere_flag"), textureSphereFlag);
+	if (is_sphere && sphereFlag == 1)
+		uniforms.texture_sphere_flag.set(textureSphereFlag);
 	else
-		glUniform1f(glGetUniformLocation(program, "texture_sphere_flag"), 0);
+		uniforms.texture_sphere_flag.set(0);
 
 	if (buffer == fireworks_buffer)
-		glUniform1f(glGetUniformLocation(program, "is_fireworks_flag"), 1);
+		uniforms.is_fireworks_flag.set(1);
 	else
-		glUniform1f(glGetUniformLocation(program, "is_fireworks_flag"), 0);
+		uniforms.is_fireworks_flag.set(0);
+
+	uniforms.packed_flag.set(is_packed ? 1 : 0);
+	if (is_packed) {
+		uniforms.position_scale.set(sphere_position_scale);
+		uniforms.position_bias.set(sphere_position_bias);
+	}
     /* Draw a sequence of geometric objs (triangles) from the vertex buffer
        (using the attributes specified in each enabled vertex attribute array) */
-	glDrawArrays(drawType, 0, num_vertices);
-
-    /*--- Disable each vertex attribute array being enabled ---*/
-    glDisableVertexAttribArray(vPosition);
-    glDisableVertexAttribArray(vColor);
-	glDisableVertexAttribArray(vNormal);
-	glDisableVertexAttribArray(vTexCoord);
-	if (buffer == sphere_shadow_buffer && shadowBlendingFlag == 1) {
-		glDisable(GL_BLEND);
+	if (num_indices > 0 && draws != NULL) {
+		if (draws->size() > 0)
+			glMultiDrawElements(drawType, &draws->counts[0], index_type, &draws->offsets[0], draws->size());
+	}
+	else if (num_indices > 0)
+		glDrawElements(drawType, num_indices, index_type, BUFFER_OFFSET(0));
+	else
+		glDrawArrays(drawType, 0, num_vertices);
+
+    /*--- Unbind the vertex array object, so that buffer uploads cannot change it ---*/
+	glBindVertexArray(0);
+}
+//----------------------------------------------------------------------------
+// The sphere's level of detail under the model-view matrix "mv": the
+// coarsest level whose triangle edges are at most sphere_lod_edge_pixels
+// long on screen.  A sphere of T triangles has edges of about
+// sqrt(16 pi / (sqrt(3) T)) times its radius.
+int sphereLevel(const mat4& mv)
+{
+	if (sphere_NumLevels == 1)
+		return 0;
+	vec4 center = mv * vec4(0.0, 0.0, 0.0, 1.0);
+	GLfloat distance = -center.z;
+	if (distance <= zNear)
+		return sphere_NumLevels - 1;
+	GLfloat radius_pixels = sphere_radius * 0.5 * window_height / (tan(0.5 * fovy * DegreesToRadians) * distance);
+	for (int l = 0; l < sphere_NumLevels - 1; l++) {
+		GLfloat triangles = sphere_levels[l]->flat.index_count / 3;
+		if (radius_pixels * sqrt(16.0 * M_PI / (sqrt(3.0) * triangles)) <= sphere_lod_edge_pixels)
+			return l;
 	}
+	return sphere_NumLevels - 1;
 }
 //----------------------------------------------------------------------------
 void display( void )
 {
-	GLuint  model_view;  // model-view matrix uniform shader variable location
-	GLuint  projection;  // projection matrix uniform shader variable location
-
     glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
 
     glUseProgram(program); // Use the shader program
 
-    model_view = glGetUniformLocation(program, "model_view" );
-    projection = glGetUniformLocation(program, "projection" );
-
     /*---  Set up and pass on Projection matrix to the shader ---*/
     mat4  p = Perspective(fovy, aspect, zNear, zFar);
-    glUniformMatrix4fv(projection, 1, GL_TRUE, p); // GL_TRUE: matrix is row-major
+    uniforms.projection.set(p); // transposed: mat4 is row-major
 
     /*---  Set up and pass on Model-View matrix to the shader ---*/
     // eye is a global variable of vec4 set to init_eye and updated by keyboard()
@@ -599,101 +1059,99 @@ void display( void )
 	mat4 mv;
     //mat4  mv = LookAt(eye, at, up);
 
-	glUniform4fv(glGetUniformLocation(program, "global_light_ambient"), 1, global_light_ambient);
-	glUniform4fv(glGetUniformLocation(program, "directional_light_ambient"), 1, directional_light_ambient);
-	glUniform4fv(glGetUniformLocation(program, "directional_light_diffuse"), 1, directional_light_diffuse);
-	glUniform4fv(glGetUniformLocation(program, "directional_light_specular"), 1, directional_light_specular);
-	glUniform4fv(glGetUniformLocation(program, "directional_light_direction"), 1, directional_light_direction);
-	glUniform4fv(glGetUniformLocation(program, "point_light_ambient"), 1, point_light_ambient);
-	glUniform4fv(glGetUniformLocation(program, "point_light_diffuse"), 1, point_light_diffuse);
-	glUniform4fv(glGetUniformLocation(program, "point_light_specular"), 1, point_light_specular);
-
-	glUniform1f(glGetUniformLocation(program, "point_const_att"), point_const_att);
-	glUniform1f(glGetUniformLocation(program, "point_linear_att"), point_linear_att);
-	glUniform1f(glGetUniformLocation(program, "point_quad_att"), point_quad_att);
-
-	glUniform1f(glGetUniformLocation(program, "spotlight_exponent"), spotlight_exponent);
-	glUniform1f(glGetUniformLocation(program, "splotlight_cutoff_angle"), splotlight_cutoff_angle);
-
-	glUniform1f(glGetUniformLocation(program, "shading_flag"), shadingFlag);
-	glUniform1f(glGetUniformLocation(program, "light_source_flag"), lightSourceFlag);
-	glUniform1f(glGetUniformLocation(program, "vertical_slanted_flag"), verticalSlantedFlag);
-	glUniform1f(glGetUniformLocation(program, "object_eye_frame_flag"), objectEyeFrameFlag);
-	glUniform1f(glGetUniformLocation(program, "upright_tilted_flag"), uprightTiltedFlag);
-	glUniform1f(glGetUniformLocation(program, "lattice_flag"), latticeFlag);
-
-	glUniform1f(glGetUniformLocation(program, "fog_linear_start"), fog_linear_start);
-	glUniform1f(glGetUniformLocation(program, "fog_linear_end"), fog_linear_end);
-	glUniform1f(glGetUniformLocation(program, "fog_exponential_density"), fog_exponential_density);
-	glUniform4fv(glGetUniformLocation(program, "fog_color"), 1, fog_color);
-	glUniform1f(glGetUniformLocation(program, "fog_flag"), fogFlag);
-
-	glUniform1f(glGetUniformLocation(program, "elapsed_time"), elapsed_time);
-
-	mv = LookAt(eye, at, up) * Translate(translate) * Rotate(angle, rotateX, rotateY, rotateZ) * accum_rotation;
-	glUniformMatrix4fv(model_view, 1, GL_TRUE, mv); // GL_TRUE: matrix is row-major
-	if (sphereFlag == 1) // Filled sphere
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-	else              // Wireframe sphere
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-	drawObj(sphere_buffer, sphere_NumVertices, GL_TRIANGLES);  // draw the sphere
-	
-	glDepthMask(GL_FALSE);
-
-	mv = LookAt(eye, at, up);
-	glUniformMatrix4fv(model_view, 1, GL_TRUE, mv); // GL_TRUE: matrix is row-major
-	if (floorFlag == 1) // Filled floor
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-	else              // Wireframe floor
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-	drawObj(floor_buffer, floor_NumVertices, GL_TRIANGLES);  // draw the floor
+	// All of these are affine, so they are built and composed as affine3x4's
+	// and only widened to mat4 for upload.
+	affine3x4 view = AffineLookAt(eye, at, up);
+	affine3x4 sphere_model = AffineTranslate(translate) * AffineRotate(QuatRotate(angle, rotateX, rotateY, rotateZ) * accum_rotation);
+
+	updateUniformBlocks(view);
+
+	uniforms.light_source_flag.set(lightSourceFlag);
+	uniforms.vertical_slanted_flag.set(verticalSlantedFlag);
+	uniforms.object_eye_frame_flag.set(objectEyeFrameFlag);
+	uniforms.upright_tilted_flag.set(uprightTiltedFlag);
+	uniforms.lattice_flag.set(latticeFlag);
+
+	uniforms.elapsed_time.set(elapsed_time);
+
+	mv = view * sphere_model;
+	uniforms.model_view.set(mv);
+	render_state.depth_mask(GL_TRUE);
+	render_state.color_mask(GL_TRUE);
+	render_state.polygon_mode(sphereFlag == 1 ? GL_FILL : GL_LINE);  // filled or wireframe sphere
+	SphereLevel& level = *sphere_levels[sphereLevel(mv)];
+	sphere_buffer = level.flat_buffer;
+	sphere_smooth_buffer = level.smooth_buffer;
+	sphere_shadow_buffer = level.shadow_buffer;
+	sphere_position_scale = level.position_scale;
+	sphere_position_bias = level.position_bias;
+	// Meshlets outside the frustum, or (when filled) facing away from the
+	// eye, are skipped; the eye is taken into the sphere's own frame.
+	// Levels without meshlets are drawn whole.
+	vec4 sphere_eye = inverseRigid(view * sphere_model) * vec4(0.0, 0.0, 0.0, 1.0);
+	PackedMesh& sphere_mesh = shadingFlag == 1 ? level.smooth : level.flat;
+	const MeshletDraws* draws = NULL;
+	if (!sphere_mesh.meshlets.empty()) {
+		CullMeshlets(sphere_mesh.meshlets, sphere_mesh.index_size(), p * mv, vec3(sphere_eye.x, sphere_eye.y, sphere_eye.z),
+			sphereFlag == 1, sphere_draws);
+		draws = &sphere_draws;
+	}
+	if (shadingFlag == 1) // Smooth shading
+		drawObj(sphere_smooth_buffer, level.smooth_vao, level.smooth.vertex_count, GL_TRIANGLES,
+			level.smooth.index_count, level.smooth.index_type, draws);
+	else
+		drawObj(sphere_buffer, level.flat_vao, level.flat.vertex_count, GL_TRIANGLES,
+			level.flat.index_count, level.flat.index_type, draws);  // draw the sphere
+
+	// The floor and the shadow on it are drawn without writing depth, so
+	// that the shadow is not hidden by the floor ...
+	mv = view;
+	uniforms.model_view.set(mv);
+	render_state.depth_mask(GL_FALSE);
+	render_state.polygon_mode(floorFlag == 1 ? GL_FILL : GL_LINE);  // filled or wireframe floor
+	drawObj(floor_buffer, floor_vao, floor_NumVertices, GL_TRIANGLES);  // draw the floor
 
 	if (shadowFlag == 1) {
 		mat4 shadow = mat4(vec4(1.0, 0.0, 0.0, 0.0), vec4(0.0, 0.0, 0.0, 0.0), vec4(0.0, 0.0, 1.0, 0.0), vec4(0.0, -1.0 / point_light_position.y, 0.0, 0.0));
-		mat4 N = Translate(point_light_position.x, 0.0, point_light_position.z) * shadow * Translate(-point_light_position.x, -point_light_position.y, -point_light_position.z);
-		mv = LookAt(eye, at, up) * N * Translate(translate) * Rotate(angle, rotateX, rotateY, rotateZ) * accum_rotation;
-		glUniformMatrix4fv(model_view, 1, GL_TRUE, mv); // GL_TRUE: matrix is row-major
-		if (sphereFlag == 1) // Filled sphere
-			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-		else              // Wireframe sphere
-			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-		drawObj(sphere_shadow_buffer, sphere_NumVertices, GL_TRIANGLES);  // draw the sphere
+		// mv = view * N * sphere_model, N = T(light) * shadow * T(-light), in one pass
+		mv = chain(view) * Translate(point_light_position.x, 0.0, point_light_position.z) * shadow
+			* Translate(-point_light_position.x, -point_light_position.y, -point_light_position.z) * sphere_model;
+		uniforms.model_view.set(mv);
+		render_state.depth_mask(GL_FALSE);
+		render_state.polygon_mode(sphereFlag == 1 ? GL_FILL : GL_LINE);
+		// the shadow faces every way, so only the frustum culls it
+		const MeshletDraws* shadow_draws = NULL;
+		if (!level.shadow.meshlets.empty()) {
+			CullMeshlets(level.shadow.meshlets, level.shadow.index_size(), p * mv, vec3(0.0, 0.0, 0.0), false, sphere_draws);
+			shadow_draws = &sphere_draws;
+		}
+		drawObj(sphere_shadow_buffer, level.shadow_vao, level.shadow.vertex_count, GL_TRIANGLES,
+			level.shadow.index_count, level.shadow.index_type, shadow_draws);  // draw the sphere
 	}
 
-	glDepthMask(GL_TRUE);
-	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-
-	mv = LookAt(eye, at, up);
-	glUniformMatrix4fv(model_view, 1, GL_TRUE, mv); // GL_TRUE: matrix is row-major
-	if (floorFlag == 1) // Filled floor
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-	else              // Wireframe floor
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-	drawObj(floor_buffer, floor_NumVertices, GL_TRIANGLES);  // draw the floor
-
-	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	// ... and then again into the depth buffer only.
+	mv = view;
+	uniforms.model_view.set(mv);
+	render_state.depth_mask(GL_TRUE);
+	render_state.color_mask(GL_FALSE);
+	render_state.polygon_mode(floorFlag == 1 ? GL_FILL : GL_LINE);
+	drawObj(floor_buffer, floor_vao, floor_NumVertices, GL_TRIANGLES);  // draw the floor
 
 	if (fireworksFlag == 1) {
-		mv = LookAt(eye, at, up);
-		glUniformMatrix4fv(model_view, 1, GL_TRUE, mv); // GL_TRUE: matrix is row-major
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-		drawObj(fireworks_buffer, fireworks_NumParticles, GL_POINTS);  // draw the floor
+		mv = view;
+		uniforms.model_view.set(mv);
+		render_state.depth_mask(GL_TRUE);
+		render_state.color_mask(GL_TRUE);
+		render_state.polygon_mode(GL_FILL);
+		drawObj(fireworks_buffer, fireworks_vao, fireworks_NumParticles, GL_POINTS);  // draw the floor
 	}
 
-	mv = LookAt(eye, at, up);
-	glUniformMatrix4fv(model_view, 1, GL_TRUE, mv); // GL_TRUE: matrix is row-major
-	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-	drawObj(axes_buffer, axes_NumVertices, GL_LINES);  // draw the axes
-	
-
-	mat3 normal_matrix = NormalMatrix(mv, 0);
-	glUniformMatrix3fv(glGetUniformLocation(program, "Normal_Matrix"), 1, GL_TRUE, normal_matrix);
-
-	vec4 point_light_position_eyeFrame = mv * point_light_position;
-	glUniform4fv(glGetUniformLocation(program, "point_light_position_eyeFrame"), 1, point_light_position_eyeFrame);
-
-	vec4 spotlight_destination_position_eyeFrame= mv * spotlight_destination_position;
-	glUniform4fv(glGetUniformLocation(program, "spotlight_destination_position_eyeFrame"), 1, spotlight_destination_position_eyeFrame);
+	mv = view;
+	uniforms.model_view.set(mv);
+	render_state.depth_mask(GL_TRUE);
+	render_state.color_mask(GL_TRUE);
+	render_state.polygon_mode(GL_FILL);
+	drawObj(axes_buffer, axes_vao, axes_NumVertices, GL_LINES);  // draw the axes
 
     glutSwapBuffers();
 }
@@ -731,17 +1189,20 @@ void idle (void)
 
 
 	if (translate.z < pointB.z && translate.x < pointB.x && direction.z < 0 && direction.x < 0) {
-		accum_rotation = Rotate(angle, rotateX, rotateY, rotateZ) * accum_rotation;
+		accum_rotation = QuatRotate(angle, rotateX, rotateY, rotateZ) * accum_rotation;
+		accum_rotation.renormalize();
 		pathState = 1;
 		angle = 0;
 	}
 	else if (translate.z < pointC.z && translate.x > pointC.x && direction.z < 0 && direction.x > 0) {
-		accum_rotation = Rotate(angle, rotateX, rotateY, rotateZ) * accum_rotation;
+		accum_rotation = QuatRotate(angle, rotateX, rotateY, rotateZ) * accum_rotation;
+		accum_rotation.renormalize();
 		pathState = 2;
 		angle = 0;
 	}
 	else if (translate.z > pointA.z && direction.z > 0) {
-		accum_rotation = Rotate(angle, rotateX, rotateY, rotateZ) * accum_rotation;
+		accum_rotation = QuatRotate(angle, rotateX, rotateY, rotateZ) * accum_rotation;
+		accum_rotation.renormalize();
 		pathState = 0;
 		angle = 0;
 	}
@@ -756,7 +1217,8 @@ void keyboard(unsigned char key, int x, int y)
     switch(key) {
 	case 033: // Escape Key
 	case 'q': case 'Q':
-	    exit( EXIT_SUCCESS );
+		printf("%u render state changes, %u redundant ones filtered\n", render_state.issued(), render_state.filtered());
+	    quit( EXIT_SUCCESS );
 	    break;
 
 	case 'X': eye[0] += 1.0; break;
@@ -821,7 +1283,7 @@ void mouse(int button, int state, int x, int y) {
 void menu(int id) {
 	switch (id) {
 	case 1:
-		exit(0);
+		quit(0);
 		break;
 	case 2:
 		eye = init_eye;
@@ -962,6 +1424,7 @@ void reshape(int width, int height)
 {
     glViewport(0, 0, width, height);
     aspect = (GLfloat) width  / (GLfloat) height;
+    window_height = height;
     glutPostRedisplay();
 }
 //----------------------------------------------------------------------------
@@ -969,6 +1432,21 @@ int main(int argc, char **argv)
 { int err;
 
     glutInit(&argc, argv);
+	// Any remaining arguments are sphere files, loaded in the background;
+	// "-crease <degrees>" sets the crease angle of the files after it.
+	GLfloat crease_angle = default_crease_angle;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-crease") == 0) {
+			if (i + 1 == argc || !parseCreaseAngle(argv[i + 1], crease_angle)) {
+				printf("Error: -crease needs a number of degrees from 0 to 180\n");
+				exit(1);
+			}
+			i++;
+			continue;
+		}
+		SphereFile file = { argv[i], crease_angle };
+		sphere_files.push_back(file);
+	}
     glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH);
     glutInitWindowSize(512, 512);
     // glutInitContextVersion(3, 2);
@@ -0,0 +1,167 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- thread_pool.h ---
+//
+//   A small fixed-size pool of worker threads for data-parallel loops.
+//
+//   ThreadPool pool;               // one worker per hardware thread
+//   pool.parallel_for(0, n, 4096, [&](int begin, int end) { ... });
+//
+//   parallel_for() splits [begin, end) into pieces of at least "grain"
+//   items, hands them to the workers *and* the calling thread, and returns
+//   once every piece is done.  Only one parallel_for() may run on a pool at
+//   a time; the pool is meant to be owned by the code that drives the loop.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ANGEL_THREAD_POOL_H__
+#define __ANGEL_THREAD_POOL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Angel {
+
+class ThreadPool {
+
+    std::vector<std::thread>  _workers;
+    std::mutex                _lock;
+    std::condition_variable   _wake;     // workers wait here for a new job
+    std::condition_variable   _done;     // the caller waits here for the end
+
+    // The current job, set and read under _lock: job(piece) for piece in
+    // [0, _pieces).  NULL once the caller has all pieces back.
+    const std::function<void(int)>*  _job;
+    int                _pieces;
+    std::atomic<int>   _next;            // next piece to hand out
+    int                _finished;        // pieces completed (under _lock)
+    int                _busy;            // workers inside drain() (under _lock)
+    unsigned           _generation;      // bumped for every job
+    bool               _quit;
+
+    ThreadPool( const ThreadPool& );             // not copyable
+    ThreadPool& operator = ( const ThreadPool& );
+
+    // Take pieces of "job" until none are left; returns how many this
+    // thread ran.  The job and its size are the caller's copies, taken
+    // under _lock, so that nothing here reads what run() writes.
+    int drain( const std::function<void(int)>& job, int pieces ) {
+	int count = 0;
+	for ( int i = _next++; i < pieces; i = _next++ ) {
+	    job( i );
+	    ++count;
+	}
+	return count;
+    }
+
+    void worker() {
+	unsigned seen = 0;
+	for ( ;; ) {
+	    const std::function<void(int)>* job;
+	    int pieces;
+	    {
+		std::unique_lock<std::mutex> guard( _lock );
+		while ( !_quit && _generation == seen ) { _wake.wait( guard ); }
+		if ( _quit ) { return; }
+		seen = _generation;
+		if ( _job == NULL ) { continue; }    // woke too late, the job is over
+		job = _job;
+		pieces = _pieces;
+		++_busy;
+	    }
+
+	    int count = drain( *job, pieces );
+
+	    // run() does not return, nor start another job (which resets
+	    // _next), while a worker is still in drain().
+	    std::lock_guard<std::mutex> guard( _lock );
+	    _finished += count;
+	    --_busy;
+	    if ( _finished == _pieces && _busy == 0 ) { _done.notify_one(); }
+	}
+    }
+
+   public:
+    //
+    //  --- Constructors and Destructors ---
+    //
+
+    // threads == 0: one thread per hardware thread (the caller counts as one)
+    explicit ThreadPool( int threads = 0 ) :
+	_job(NULL), _pieces(0), _next(0), _finished(0), _busy(0), _generation(0), _quit(false)
+    {
+	if ( threads <= 0 ) { threads = (int) std::thread::hardware_concurrency(); }
+	for ( int i = 1; i < threads; ++i ) {
+	    _workers.push_back( std::thread( &ThreadPool::worker, this ) );
+	}
+    }
+
+    ~ThreadPool() {
+	{
+	    std::lock_guard<std::mutex> guard( _lock );
+	    _quit = true;
+	}
+	_wake.notify_all();
+	for ( size_t i = 0; i < _workers.size(); ++i ) { _workers[i].join(); }
+    }
+
+    // Number of threads that run a job, including the calling thread.
+    int size() const { return (int) _workers.size() + 1; }
+
+    //
+    //  --- Loops ---
+    //
+
+    // Run job(piece) for every piece in [0, pieces) and wait for all of them.
+    void run( int pieces, const std::function<void(int)>& job ) {
+	if ( pieces <= 0 ) { return; }
+	if ( _workers.empty() || pieces == 1 ) {
+	    for ( int i = 0; i < pieces; ++i ) { job( i ); }
+	    return;
+	}
+
+	{
+	    std::lock_guard<std::mutex> guard( _lock );
+	    _job = &job;
+	    _pieces = pieces;
+	    _finished = 0;
+	    _next = 0;
+	    ++_generation;
+	}
+	_wake.notify_all();
+
+	int count = drain( job, pieces );
+
+	std::unique_lock<std::mutex> guard( _lock );
+	_finished += count;
+	while ( _finished < _pieces || _busy > 0 ) { _done.wait( guard ); }
+	_job = NULL;
+    }
+
+    // Call body(b, e) over [begin, end) split into ranges of >= grain items.
+    template <class Body>
+    void parallel_for( int begin, int end, int grain, const Body& body ) {
+	int n = end - begin;
+	if ( n <= 0 ) { return; }
+	if ( grain < 1 ) { grain = 1; }
+
+	// A few pieces per thread keeps the load balanced without tiny tasks.
+	int pieces = size() * 4;
+	if ( pieces > n / grain ) { pieces = n / grain; }
+	if ( pieces < 1 ) { pieces = 1; }
+
+	run( pieces, [&]( int i ) {
+	    int b = begin + (int) ( (long long) n * i / pieces );
+	    int e = begin + (int) ( (long long) n * (i + 1) / pieces );
+	    body( b, e );
+	} );
+    }
+};
+
+}  // namespace Angel
+
+#endif // __ANGEL_THREAD_POOL_H__
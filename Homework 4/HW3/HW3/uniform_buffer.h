@@ -0,0 +1,126 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- uniform_buffer.h ---
+//
+//   A uniform buffer object holding one or more std140 blocks, with a CPU
+//   copy that tracks which bytes changed, so that values that stay the
+//   same from frame to frame are uploaded once.
+//
+//   struct Material { color4 ambient; GLfloat shininess; };  // the block's
+//                                                  // std140 layout in C++
+//   UniformBuffer<Material> materials;
+//   materials.create(1, 2);            // binding point 1, 2 entries
+//   ...
+//   materials.set(0, &Material::shininess, 125.0f);   // no GL call
+//   materials.flush();                 // uploads what changed, if anything
+//   materials.bind(0);                 // entry 0 to binding point 1
+//
+//   Entries after the first start at multiples of
+//   GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, so each can be bound on its own
+//   with glBindBufferRange(); bind() skips the call if the entry is bound
+//   already.  The program's blocks are attached to the binding points
+//   with ProgramUniforms::bind_block() (program_uniforms.h).
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ANGEL_UNIFORM_BUFFER_H__
+#define __ANGEL_UNIFORM_BUFFER_H__
+
+#include "Angel-yjc.h"
+#include <string.h>
+#include <vector>
+
+namespace Angel {
+
+template <class Block>
+class UniformBuffer {
+
+    GLuint             _buffer;
+    GLuint             _binding;
+    int                _count;
+    GLsizeiptr         _stride;       // bytes from one entry to the next
+    std::vector<char>  _data;         // what the buffer should hold
+    size_t             _dirty_begin;  // bytes of _data not uploaded yet
+    size_t             _dirty_end;
+    int                _bound;        // entry bound to _binding, -1 if none
+    unsigned           _uploads;
+
+    UniformBuffer( const UniformBuffer& );           // not copyable
+    UniformBuffer& operator = ( const UniformBuffer& );
+
+    // Offset of "member" in Block.
+    template <class T>
+    static size_t member_offset( T Block::* member ) {
+	static const Block probe = Block();
+	return (size_t) ( reinterpret_cast<const char*>( &( probe.*member ) ) -
+			  reinterpret_cast<const char*>( &probe ) );
+    }
+
+   public:
+    UniformBuffer() : _buffer(0), _binding(0), _count(0), _stride(0), _dirty_begin(0), _dirty_end(0),
+	_bound(-1), _uploads(0) {}
+    ~UniformBuffer() { if ( _buffer ) { glDeleteBuffers( 1, &_buffer ); } }
+
+    // Makes the buffer, for "count" entries that are all zero to begin with.
+    void create( GLuint binding, int count = 1 ) {
+	GLint alignment = 1;
+	glGetIntegerv( GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment );
+	_binding = binding;
+	_count = count;
+	_stride = ( (GLsizeiptr) sizeof(Block) + alignment - 1 ) / alignment * alignment;
+	_data.assign( (size_t) ( _stride * count ), 0 );
+	glGenBuffers( 1, &_buffer );
+	glBindBuffer( GL_UNIFORM_BUFFER, _buffer );
+	glBufferData( GL_UNIFORM_BUFFER, (GLsizeiptr) _data.size(), &_data[0], GL_DYNAMIC_DRAW );
+	glBindBuffer( GL_UNIFORM_BUFFER, 0 );
+	_dirty_begin = _dirty_end = 0;
+	_bound = -1;
+    }
+
+    // Sets a member of an entry in the CPU copy; only a new value marks
+    // it for upload.
+    template <class T, class V>
+    void set( int entry, T Block::* member, const V& value ) {
+	const T v = value;
+	size_t offset = (size_t) ( _stride * entry ) + member_offset( member );
+	if ( memcmp( &_data[offset], &v, sizeof(T) ) == 0 ) { return; }
+	memcpy( &_data[offset], &v, sizeof(T) );
+	if ( _dirty_begin == _dirty_end ) {
+	    _dirty_begin = offset;
+	    _dirty_end = offset + sizeof(T);
+	} else {
+	    _dirty_begin = offset < _dirty_begin ? offset : _dirty_begin;
+	    _dirty_end = offset + sizeof(T) > _dirty_end ? offset + sizeof(T) : _dirty_end;
+	}
+    }
+    template <class T, class V>
+    void set( T Block::* member, const V& value ) { set( 0, member, value ); }
+
+    // Uploads the changed bytes (as one range); returns true if there were any.
+    bool flush() {
+	if ( _dirty_begin == _dirty_end ) { return false; }
+	glBindBuffer( GL_UNIFORM_BUFFER, _buffer );
+	glBufferSubData( GL_UNIFORM_BUFFER, (GLintptr) _dirty_begin, (GLsizeiptr) ( _dirty_end - _dirty_begin ),
+			 &_data[_dirty_begin] );
+	glBindBuffer( GL_UNIFORM_BUFFER, 0 );
+	_dirty_begin = _dirty_end = 0;
+	++_uploads;
+	return true;
+    }
+
+    // Makes "entry" the block that the shaders see at the binding point.
+    void bind( int entry = 0 ) {
+	if ( entry == _bound ) { return; }
+	glBindBufferRange( GL_UNIFORM_BUFFER, _binding, _buffer, offset( entry ), (GLsizeiptr) sizeof(Block) );
+	_bound = entry;
+    }
+
+    GLintptr offset( int entry ) const { return (GLintptr) ( _stride * entry ); }
+    GLuint binding() const { return _binding; }
+    int count() const { return _count; }
+    unsigned uploads() const { return _uploads; }
+};
+
+}  // namespace Angel
+
+#endif // __ANGEL_UNIFORM_BUFFER_H__
@@ -9,6 +9,51 @@
 
 #include "Angel-yjc.h"
 
+//----------------------------------------------------------------------------
+//
+//  --- SIMD configuration ---
+//
+//   The mat4 kernels in mat-yjc-new.h are selected at compile time:
+//     ANGEL_AVX  - 256-bit AVX (two matrix rows per instruction),
+//                  plus ANGEL_FMA for fused multiply-add
+//     ANGEL_SSE2 - 128-bit SSE2 baseline (any x86-64 or /arch:SSE2 build)
+//     (neither)  - portable scalar loops
+//   Define ANGEL_NO_SIMD before including this file to force the scalar path.
+//
+
+#if !defined(ANGEL_NO_SIMD)
+#  if defined(__SSE2__) || defined(_M_X64) || \
+      (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define ANGEL_SSE2 1
+#    include <emmintrin.h>
+#  endif
+#  if defined(__AVX__)
+#    define ANGEL_AVX 1
+#    include <immintrin.h>
+#  endif
+#  if defined(__FMA__) || (defined(_MSC_VER) && defined(__AVX2__))
+#    define ANGEL_FMA 1
+#  endif
+#endif // !ANGEL_NO_SIMD
+
+// vec4 and mat4 are aligned to 16 bytes so that a vec4 always sits in a
+// single SSE register lane group and never straddles a cache line.
+#if defined(_MSC_VER)
+#  define ANGEL_ALIGN( n )  __declspec(align(n))
+#else
+#  define ANGEL_ALIGN( n )  __attribute__((aligned(n)))
+#endif
+
+// The constructors and the simple operators are constexpr where the
+// compiler has it (not Visual Studio 2013), so constant vectors and
+// matrices such as Translate(1, 2, 3) can be built at compile time.
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+#  define ANGEL_HAS_CONSTEXPR 1
+#  define ANGEL_CONSTEXPR  constexpr
+#else
+#  define ANGEL_CONSTEXPR
+#endif
+
 namespace Angel {
 
 //////////////////////////////////////////////////////////////////////////////
@@ -25,15 +70,12 @@ struct vec2 {
     //  --- Constructors and Destructors ---
     //
 
-    vec2( GLfloat s = GLfloat(0.0) ) :
+    ANGEL_CONSTEXPR vec2( GLfloat s = GLfloat(0.0) ) :
 	x(s), y(s) {}
 
-    vec2( GLfloat x, GLfloat y ) :
+    ANGEL_CONSTEXPR vec2( GLfloat x, GLfloat y ) :
 	x(x), y(y) {}
 
-    vec2( const vec2& v )
-	{ x = v.x;  y = v.y;  }
-
     //
     //  --- Indexing Operator ---
     //
@@ -45,22 +87,22 @@ struct vec2 {
     //  --- (non-modifying) Arithematic Operators ---
     //
 
-    vec2 operator - () const // unary minus operator
+    ANGEL_CONSTEXPR vec2 operator - () const // unary minus operator
 	{ return vec2( -x, -y ); }
 
-    vec2 operator + ( const vec2& v ) const
+    ANGEL_CONSTEXPR vec2 operator + ( const vec2& v ) const
 	{ return vec2( x + v.x, y + v.y ); }
 
-    vec2 operator - ( const vec2& v ) const
+    ANGEL_CONSTEXPR vec2 operator - ( const vec2& v ) const
 	{ return vec2( x - v.x, y - v.y ); }
 
-    vec2 operator * ( const GLfloat s ) const
+    ANGEL_CONSTEXPR vec2 operator * ( const GLfloat s ) const
 	{ return vec2( s*x, s*y ); }
 
-    vec2 operator * ( const vec2& v ) const
+    ANGEL_CONSTEXPR vec2 operator * ( const vec2& v ) const
 	{ return vec2( x*v.x, y*v.y ); }
 
-    friend vec2 operator * ( const GLfloat s, const vec2& v )
+    friend ANGEL_CONSTEXPR vec2 operator * ( const GLfloat s, const vec2& v )
 	{ return v * s; }
 
     vec2 operator / ( const GLfloat s ) const {
@@ -133,7 +175,7 @@ struct vec2 {
 //  Non-class vec2 Methods
 //
 
-inline
+inline ANGEL_CONSTEXPR
 GLfloat dot( const vec2& u, const vec2& v ) {
     return u.x * v.x + u.y * v.y;
 }
@@ -164,15 +206,14 @@ struct vec3 {
     //  --- Constructors and Destructors ---
     //
 
-    vec3( GLfloat s = GLfloat(0.0) ) :
+    ANGEL_CONSTEXPR vec3( GLfloat s = GLfloat(0.0) ) :
 	x(s), y(s), z(s) {}
 
-    vec3( GLfloat x, GLfloat y, GLfloat z ) :
+    ANGEL_CONSTEXPR vec3( GLfloat x, GLfloat y, GLfloat z ) :
 	x(x), y(y), z(z) {}
 
-    vec3( const vec3& v ) { x = v.x;  y = v.y;  z = v.z; }
-
-    vec3( const vec2& v, const float f ) { x = v.x;  y = v.y;  z = f; }
+    ANGEL_CONSTEXPR vec3( const vec2& v, const float f ) :
+	x(v.x), y(v.y), z(f) {}
 
     //
     //  --- Indexing Operator ---
@@ -185,22 +226,22 @@ struct vec3 {
     //  --- (non-modifying) Arithematic Operators ---
     //
 
-    vec3 operator - () const  // unary minus operator
+    ANGEL_CONSTEXPR vec3 operator - () const  // unary minus operator
 	{ return vec3( -x, -y, -z ); }
 
-    vec3 operator + ( const vec3& v ) const
+    ANGEL_CONSTEXPR vec3 operator + ( const vec3& v ) const
 	{ return vec3( x + v.x, y + v.y, z + v.z ); }
 
-    vec3 operator - ( const vec3& v ) const
+    ANGEL_CONSTEXPR vec3 operator - ( const vec3& v ) const
 	{ return vec3( x - v.x, y - v.y, z - v.z ); }
 
-    vec3 operator * ( const GLfloat s ) const
+    ANGEL_CONSTEXPR vec3 operator * ( const GLfloat s ) const
 	{ return vec3( s*x, s*y, s*z ); }
 
-    vec3 operator * ( const vec3& v ) const
+    ANGEL_CONSTEXPR vec3 operator * ( const vec3& v ) const
 	{ return vec3( x*v.x, y*v.y, z*v.z ); }
 
-    friend vec3 operator * ( const GLfloat s, const vec3& v )
+    friend ANGEL_CONSTEXPR vec3 operator * ( const GLfloat s, const vec3& v )
 	{ return v * s; }
 
     vec3 operator / ( const GLfloat s ) const {
@@ -273,7 +314,7 @@ struct vec3 {
 //  Non-class vec3 Methods
 //
 
-inline
+inline ANGEL_CONSTEXPR
 GLfloat dot( const vec3& u, const vec3& v ) {
     return u.x*v.x + u.y*v.y + u.z*v.z ;
 }
@@ -288,7 +329,7 @@ vec3 normalize( const vec3& v ) {
     return v / length(v);
 }
 
-inline
+inline ANGEL_CONSTEXPR
 vec3 cross(const vec3& a, const vec3& b )
 {
     return vec3( a.y * b.z - a.z * b.y,
@@ -303,7 +344,7 @@ vec3 cross(const vec3& a, const vec3& b )
 //
 //////////////////////////////////////////////////////////////////////////////
 
-struct vec4 {
+struct ANGEL_ALIGN(16) vec4 {
 
     GLfloat  x;
     GLfloat  y;
@@ -314,19 +355,17 @@ struct vec4 {
     //  --- Constructors and Destructors ---
     //
 
-    vec4( GLfloat s = GLfloat(0.0) ) :
+    ANGEL_CONSTEXPR vec4( GLfloat s = GLfloat(0.0) ) :
 	x(s), y(s), z(s), w(s) {}
 
-    vec4( GLfloat x, GLfloat y, GLfloat z, GLfloat w ) :
+    ANGEL_CONSTEXPR vec4( GLfloat x, GLfloat y, GLfloat z, GLfloat w ) :
 	x(x), y(y), z(z), w(w) {}
 
-    vec4( const vec4& v ) { x = v.x;  y = v.y;  z = v.z;  w = v.w; }
-
-    vec4( const vec3& v, const float w = 1.0 ) : w(w)
-	{ x = v.x;  y = v.y;  z = v.z; }
+    ANGEL_CONSTEXPR vec4( const vec3& v, const float w = 1.0 ) :
+	x(v.x), y(v.y), z(v.z), w(w) {}
 
-    vec4( const vec2& v, const float z, const float w ) : z(z), w(w)
-	{ x = v.x;  y = v.y; }
+    ANGEL_CONSTEXPR vec4( const vec2& v, const float z, const float w ) :
+	x(v.x), y(v.y), z(z), w(w) {}
 
     //
     //  --- Indexing Operator ---
@@ -339,22 +378,22 @@ struct vec4 {
     //  --- (non-modifying) Arithematic Operators ---
     //
 
-    vec4 operator - () const  // unary minus operator
+    ANGEL_CONSTEXPR vec4 operator - () const  // unary minus operator
 	{ return vec4( -x, -y, -z, -w ); }
 
-    vec4 operator + ( const vec4& v ) const
+    ANGEL_CONSTEXPR vec4 operator + ( const vec4& v ) const
 	{ return vec4( x + v.x, y + v.y, z + v.z, w + v.w ); }
 
-    vec4 operator - ( const vec4& v ) const
+    ANGEL_CONSTEXPR vec4 operator - ( const vec4& v ) const
 	{ return vec4( x - v.x, y - v.y, z - v.z, w - v.w ); }
 
-    vec4 operator * ( const GLfloat s ) const
+    ANGEL_CONSTEXPR vec4 operator * ( const GLfloat s ) const
 	{ return vec4( s*x, s*y, s*z, s*w ); }
 
-    vec4 operator * ( const vec4& v ) const
-	{ return vec4( x*v.x, y*v.y, z*v.z, w*v.z ); }
+    ANGEL_CONSTEXPR vec4 operator * ( const vec4& v ) const
+	{ return vec4( x*v.x, y*v.y, z*v.z, w*v.w ); }
 
-    friend vec4 operator * ( const GLfloat s, const vec4& v )
+    friend ANGEL_CONSTEXPR vec4 operator * ( const GLfloat s, const vec4& v )
 	{ return v * s; }
 
     vec4 operator / ( const GLfloat s ) const {
@@ -443,7 +482,7 @@ vec4 normalize( const vec4& v ) {
     return v / length(v);
 }
 
-inline
+inline ANGEL_CONSTEXPR
 vec3 cross(const vec4& a, const vec4& b )
 {
     return vec3( a.y * b.z - a.z * b.y,
@@ -452,6 +491,20 @@ vec3 cross(const vec4& a, const vec4& b )
 }
 
 //----------------------------------------------------------------------------
+//
+//  Layout guarantees: arrays of vectors are uploaded to OpenGL as tightly
+//  packed floats, and copied with memcpy().
+//
+
+static_assert( sizeof(vec2) == 2 * sizeof(GLfloat), "vec2 must be 2 packed floats" );
+static_assert( sizeof(vec3) == 3 * sizeof(GLfloat), "vec3 must be 3 packed floats" );
+static_assert( sizeof(vec4) == 4 * sizeof(GLfloat), "vec4 must be 4 packed floats" );
+static_assert( std::alignment_of<vec4>::value == 16, "vec4 must be 16-byte aligned" );
+static_assert( std::is_standard_layout<vec4>::value && offsetof(vec4, w) == 3 * sizeof(GLfloat),
+	       "vec4 must be laid out as x, y, z, w" );
+static_assert( std::is_trivially_copyable<vec2>::value &&
+	       std::is_trivially_copyable<vec3>::value &&
+	       std::is_trivially_copyable<vec4>::value, "vectors must be trivially copyable" );
 
 }  // namespace Angel
 
@@ -0,0 +1,105 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- vertex_format.h ---
+//
+//   Interleaved vertex formats: one struct per vertex, and one description
+//   of its attributes that both the upload and the draw code use.
+//
+//   struct LineVertex { point4 position; color4 color; };
+//   const VertexFormat LineFormat = { sizeof(LineVertex), 2, {
+//       { "vPosition", 4, GL_FLOAT, GL_FALSE, offsetof(LineVertex, position) },
+//       { "vColor",    4, GL_FLOAT, GL_FALSE, offsetof(LineVertex, color) } } };
+//
+//   GLuint buffer = CreateVertexBuffer(LineFormat, vertices, n);  // one upload
+//
+//   program = InitShader(...);
+//   VertexLocations locations = ResolveVertexLocations(LineFormat, program);
+//   GLuint vao = CreateVertexArray(LineFormat, locations, buffer);
+//   ...
+//   glBindVertexArray(vao);      // all the attribute setup a draw needs
+//   glDrawArrays(...);
+//
+//   The locations are looked up by name once, after linking; attributes
+//   the shader does not have (or has optimized away) are skipped.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ANGEL_VERTEX_FORMAT_H__
+#define __ANGEL_VERTEX_FORMAT_H__
+
+#include "Angel-yjc.h"
+#include <stddef.h>
+
+namespace Angel {
+
+struct VertexAttribute {
+    const char*  name;        // in the vertex shader
+    GLint        size;        // number of components
+    GLenum       type;        // of each component
+    GLboolean    normalized;  // integer types: map to [0, 1] or [-1, 1]
+    size_t       offset;      // in the vertex struct
+};
+
+const int MaxVertexAttributes = 8;
+
+struct VertexFormat {
+    GLsizei          stride;  // sizeof the vertex struct
+    int              count;
+    VertexAttribute  attributes[MaxVertexAttributes];
+};
+
+// A new GL_ARRAY_BUFFER with "count" vertices of "format" from "data"
+// (NULL to fill it later, e.g. with a BufferUploader).
+inline GLuint
+CreateVertexBuffer( const VertexFormat& format, const void* data, int count, GLenum usage = GL_STATIC_DRAW )
+{
+    GLuint buffer;
+    glGenBuffers( 1, &buffer );
+    glBindBuffer( GL_ARRAY_BUFFER, buffer );
+    glBufferData( GL_ARRAY_BUFFER, (GLsizeiptr) format.stride * count, data, usage );
+    return buffer;
+}
+
+// The location in a linked program of each attribute of a format; -1
+// for those it does not have.
+struct VertexLocations {
+    GLint  location[MaxVertexAttributes];
+};
+
+inline VertexLocations
+ResolveVertexLocations( const VertexFormat& format, GLuint program )
+{
+    VertexLocations locations;
+    for ( int i = 0; i < MaxVertexAttributes; ++i ) {
+	locations.location[i] = i < format.count ? glGetAttribLocation( program, format.attributes[i].name ) : -1;
+    }
+    return locations;
+}
+
+// A vertex array object with the attributes of "format" pointed at
+// "buffer", and "index_buffer" (if not 0) as its element buffer.  Leaves
+// no vertex array bound, so that later buffer bindings cannot change it.
+inline GLuint
+CreateVertexArray( const VertexFormat& format, const VertexLocations& locations, GLuint buffer,
+		   GLuint index_buffer = 0 )
+{
+    GLuint vao;
+    glGenVertexArrays( 1, &vao );
+    glBindVertexArray( vao );
+    glBindBuffer( GL_ARRAY_BUFFER, buffer );
+    for ( int i = 0; i < format.count; ++i ) {
+	const VertexAttribute& a = format.attributes[i];
+	GLint location = locations.location[i];
+	if ( location < 0 ) { continue; }
+	glEnableVertexAttribArray( location );
+	glVertexAttribPointer( location, a.size, a.type, a.normalized, format.stride, BUFFER_OFFSET( a.offset ) );
+    }
+    if ( index_buffer != 0 ) { glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, index_buffer ); }
+    glBindVertexArray( 0 );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    return vao;
+}
+
+}  // namespace Angel
+
+#endif // __ANGEL_VERTEX_FORMAT_H__
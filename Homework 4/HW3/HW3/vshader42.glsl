@@ -7,6 +7,11 @@
  *
  * - This vertex shader uses the Model-View and Projection matrices passed
  *   on from the OpenGL program as uniform variables of type mat4.
+ *
+ * - With packed_flag set, vPosition and vNormal are a PackedVertex (see
+ *   mesh.h): 16-bit integers in [-32767, 32767], the position mapped
+ *   onto the mesh's bounding box by position_scale and position_bias and
+ *   the normal octahedral-encoded.
  ***************************/
 
  #version 150  // YJC: Comment/un-comment this line to resolve compilation errors
@@ -25,32 +30,46 @@ out vec2 latticeTexCoord;
 out float z;
 out float discard_fireworks_particle;
 
-uniform vec4 global_light_ambient;
-
-uniform vec4 directional_light_ambient;
-uniform vec4 directional_light_diffuse;
-uniform vec4 directional_light_specular;
-uniform vec4 directional_light_direction;
-
-uniform vec4 point_light_ambient;
-uniform vec4 point_light_diffuse;
-uniform vec4 point_light_specular;
-uniform vec4 point_light_position_eyeFrame;
-uniform float point_const_att;
-uniform float point_linear_att;
-uniform float point_quad_att;
-
-uniform vec4 spotlight_destination_position_eyeFrame;
-uniform float spotlight_exponent;
-uniform float spotlight_cutoff_angle;
-
-uniform vec4 material_ambient;
-uniform vec4 material_diffuse;
-uniform vec4 material_specular;
-uniform float material_shininess;
+// Uniform blocks, filled from uniform buffers (see uniform_buffer.h) that
+// are only rewritten when a value changes.  The C++ structs LightBlock,
+// MaterialBlock and FrameBlock in rolling_sphere.cpp must match them.
+layout(std140) uniform LightSet {
+	vec4 global_light_ambient;
+
+	vec4 directional_light_ambient;
+	vec4 directional_light_diffuse;
+	vec4 directional_light_specular;
+	vec4 directional_light_direction;
+
+	vec4 point_light_ambient;
+	vec4 point_light_diffuse;
+	vec4 point_light_specular;
+	float point_const_att;
+	float point_linear_att;
+	float point_quad_att;
+
+	float spotlight_exponent;
+	float spotlight_cutoff_angle;
+};
+
+layout(std140) uniform Material {   // bound per object
+	vec4 material_ambient;
+	vec4 material_diffuse;
+	vec4 material_specular;
+	float material_shininess;
+};
+
+layout(std140) uniform Frame {      // the same block as in fshader42.glsl
+	vec4 point_light_position_eyeFrame;
+	vec4 spotlight_destination_position_eyeFrame;
+	vec4 fog_color;
+	float fog_linear_start;
+	float fog_linear_end;
+	float fog_exponential_density;
+	float fog_flag;
+};
 
 uniform float lighting_flag;
-uniform float shading_flag;
 uniform float light_source_flag;
 uniform float vertical_slanted_flag;
 uniform float object_eye_frame_flag;
@@ -64,16 +83,33 @@ uniform float texture_sphere_flag;
 
 uniform float elapsed_time;
 
+uniform float packed_flag;
+uniform vec3 position_scale;
+uniform vec3 position_bias;
+
 uniform mat4 model_view;
 uniform mat4 projection;
 
-uniform mat3 Normal_Matrix;
+vec3 decode_octahedral(vec2 e)
+{
+	e = max(e / 32767.0, -1.0);
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
 
 void main() 
 {
+	vec4 position = vPosition;
+	vec3 normal = vNormal;
+	if (packed_flag == 1) {
+		position = vec4(position_bias + position_scale * vPosition.xyz, 1.0);
+		normal = decode_octahedral(vNormal.xy);
+	}
 	
 	if (is_fireworks_flag == 1) {
-		vec3 pos = (model_view * vPosition).xyz;
+		vec3 pos = (model_view * position).xyz;
 		gl_Position = projection * vec4(
 			pos.x + (0.0001 * vVelocity.x * elapsed_time),
 			pos.y + (0.0001 * vVelocity.y * elapsed_time) + (0.5 * -0.00000049 * elapsed_time * elapsed_time),
@@ -86,10 +122,10 @@ void main()
 			discard_fireworks_particle = 0;
 	}
 	else {
-		gl_Position = projection * model_view * vPosition;
+		gl_Position = projection * model_view * position;
 		z = gl_Position.z;
 
-		vec3 pos = (model_view * vPosition).xyz;
+		vec3 pos = (model_view * position).xyz;
 		if (lighting_flag == 0) {
 			color = vColor;
 		}
@@ -101,13 +137,7 @@ void main()
 
 			// Transform vertex position into eye coordinates
 			
-			if (shading_flag == 1 && is_sphere_flag == 1) {
-				N = normalize( model_view*vec4(vPosition.xyz, 0.0) ).xyz;
-			}
-			else {
-				N = normalize( model_view*vec4(vNormal, 0.0) ).xyz;
-				//N = normalize(Normal_Matrix * vNormal);
-			}
+			N = normalize( model_view*vec4(normal, 0.0) ).xyz;
 			//GLOBAL AMBIENT LIGHT
 			vec4 global_ambient = global_light_ambient * material_ambient;
 
@@ -175,9 +205,9 @@ void main()
 		else if (is_sphere_flag) {
 			if (texture_sphere_flag == 1) {
 				if (vertical_slanted_flag == 0 && object_eye_frame_flag == 0)
-					texCoord = vec2(2.5 * vPosition.x, 0.0);
+					texCoord = vec2(2.5 * position.x, 0.0);
 				else if (vertical_slanted_flag == 1 && object_eye_frame_flag == 0)
-					texCoord = vec2(1.5 * (vPosition.x + vPosition.y + vPosition.z), 0.0);
+					texCoord = vec2(1.5 * (position.x + position.y + position.z), 0.0);
 				else if (vertical_slanted_flag == 0 && object_eye_frame_flag == 1)
 					texCoord = vec2(2.5 * pos.x, 0.0);
 				else if (vertical_slanted_flag == 1 && object_eye_frame_flag == 1)
@@ -185,9 +215,9 @@ void main()
 			}
 			else if (texture_sphere_flag == 2) {
 				if (vertical_slanted_flag == 0 && object_eye_frame_flag == 0)
-					texCoord = vec2(0.5 * (vPosition.x + 1), 0.5 * (vPosition.y + 1));
+					texCoord = vec2(0.5 * (position.x + 1), 0.5 * (position.y + 1));
 				else if (vertical_slanted_flag == 1 && object_eye_frame_flag == 0)
-					texCoord = vec2(0.3 * (vPosition.x + vPosition.y + vPosition.z), 0.3 * (vPosition.x - vPosition.y + vPosition.z));
+					texCoord = vec2(0.3 * (position.x + position.y + position.z), 0.3 * (position.x - position.y + position.z));
 				else if (vertical_slanted_flag == 0 && object_eye_frame_flag == 1)
 					texCoord = vec2(0.5 * (pos.x + 1), 0.5 * (pos.y + 1));
 				else if (vertical_slanted_flag == 1 && object_eye_frame_flag == 1)
@@ -197,9 +227,9 @@ void main()
 	
 		if ((is_sphere_flag == 1 || is_sphere_shadow_flag == 1) && lattice_flag == 1) {
 			if (upright_tilted_flag == 0)
-				latticeTexCoord = vec2(0.5 * (vPosition.x + 1), 0.5 * (vPosition.y + 1));
+				latticeTexCoord = vec2(0.5 * (position.x + 1), 0.5 * (position.y + 1));
 			else if (upright_tilted_flag == 1)
-				latticeTexCoord = vec2(0.3 * (vPosition.x + vPosition.y + vPosition.z), 0.3 * (vPosition.x - vPosition.y + vPosition.z));
+				latticeTexCoord = vec2(0.3 * (position.x + position.y + position.z), 0.3 * (position.x - position.y + position.z));
 		}
 	}
 } 